@@ -0,0 +1,71 @@
+#!/usr/bin/env python3
+"""Write the desktop wallpaper as an 8 bpp palette BMP.
+
+    scripts/make_logo.py build/logo.bmp
+
+The image is a soft ring on the desktop color with a vertical blue ramp,
+drawn from a 256-entry palette so the kernel's palette path gets used.
+"""
+
+import math
+import struct
+import sys
+
+WIDTH = 160
+HEIGHT = 96
+DESKTOP = (0x1C, 0x24, 0x33)
+RING = (0x60, 0x73, 0x9A)
+GLOW = (0xB4, 0xD5, 0xFF)
+
+
+def mix(a, b, t):
+    return tuple(int(round(x + (y - x) * t)) for x, y in zip(a, b))
+
+
+def palette():
+    """Index 0-127 fade desktop to ring, 128-255 fade ring to glow."""
+    entries = []
+    for i in range(256):
+        if i < 128:
+            entries.append(mix(DESKTOP, RING, i / 127))
+        else:
+            entries.append(mix(RING, GLOW, (i - 128) / 127))
+    return entries
+
+
+def pixel(x, y):
+    cx, cy = WIDTH / 2, HEIGHT / 2
+    d = math.hypot((x - cx) / (HEIGHT / 2), (y - cy) / (HEIGHT / 2))
+    ring = max(0.0, 1.0 - abs(d - 0.7) / 0.12)
+    ramp = 1.0 - y / HEIGHT
+    if ring <= 0.0:
+        return 0
+    return min(255, int(ring * (127 + 128 * ramp)))
+
+
+def main():
+    if len(sys.argv) != 2:
+        sys.exit("usage: make_logo.py OUTPUT.bmp")
+
+    stride = (WIDTH + 3) & ~3
+    pal = palette()
+    pixel_offset = 14 + 40 + len(pal) * 4
+    size = pixel_offset + stride * HEIGHT
+
+    out = bytearray()
+    out += struct.pack("<2sIHHI", b"BM", size, 0, 0, pixel_offset)
+    out += struct.pack("<IiiHHIIiiII", 40, WIDTH, HEIGHT, 1, 8, 0, stride * HEIGHT,
+                       2835, 2835, len(pal), 0)
+    for r, g, b in pal:
+        out += bytes((b, g, r, 0))
+    # Bottom-up rows, padded to four bytes
+    for y in reversed(range(HEIGHT)):
+        row = bytes(pixel(x, y) for x in range(WIDTH))
+        out += row + bytes(stride - WIDTH)
+
+    with open(sys.argv[1], "wb") as f:
+        f.write(out)
+
+
+if __name__ == "__main__":
+    main()
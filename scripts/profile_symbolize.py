@@ -0,0 +1,100 @@
+#!/usr/bin/env python3
+"""Symbolize a kernel EIP histogram into a ranked list and folded stacks.
+
+Run the kernel headless with the serial console on stdio, type 'p' to dump
+the profile (F11 does the same from the guest keyboard), then quit:
+
+    qemu-system-i386 -fda build/main_floppy.img -display none -serial stdio | tee serial.log
+    scripts/profile_symbolize.py serial.log --folded profile.folded
+
+The ranked function list goes to stdout. profile.folded can be fed to
+flamegraph.pl or speedscope. Only the sampled EIP is recorded, so each stack
+is a single frame.
+"""
+
+import argparse
+import bisect
+import shutil
+import subprocess
+import sys
+
+
+def load_symbols(elf, nm):
+    out = subprocess.run([nm, "-n", "--defined-only", elf],
+                         check=True, capture_output=True, text=True).stdout
+    addrs, names = [], []
+    for line in out.splitlines():
+        fields = line.split()
+        if len(fields) != 3 or fields[1] not in "tTwW":
+            continue
+        addrs.append(int(fields[0], 16))
+        names.append(fields[2])
+    return addrs, names
+
+
+def parse_profile(lines):
+    """Return (samples, dropped, {eip: count}) for the last complete dump."""
+    result = None
+    current = None
+    for line in lines:
+        fields = line.strip().split()
+        if len(fields) < 2 or fields[0] != "PROFILE":
+            continue
+        if fields[1] == "BEGIN":
+            current = (int(fields[2]), int(fields[3]), {})
+        elif current is None:
+            continue
+        elif fields[1] == "S" and len(fields) == 4:
+            eip = int(fields[2], 16)
+            current[2][eip] = current[2].get(eip, 0) + int(fields[3])
+        elif fields[1] == "END":
+            result = current
+            current = None
+    return result
+
+
+def symbolize(eip, addrs, names):
+    i = bisect.bisect_right(addrs, eip) - 1
+    if i < 0:
+        return "0x%08x" % eip
+    return names[i]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("log", help="captured serial output containing a PROFILE dump")
+    parser.add_argument("--elf", default="build/kernel.elf")
+    parser.add_argument("--nm", default=shutil.which("i686-elf-nm") or "nm")
+    parser.add_argument("--folded", help="write flamegraph folded stacks here")
+    parser.add_argument("--top", type=int, default=40)
+    args = parser.parse_args()
+
+    with open(args.log, errors="replace") as f:
+        profile = parse_profile(f)
+    if profile is None:
+        sys.stderr.write("no PROFILE BEGIN/END block found\n")
+        return 1
+    samples, dropped, hist = profile
+    addrs, names = load_symbols(args.elf, args.nm)
+
+    per_func = {}
+    for eip, count in hist.items():
+        name = symbolize(eip, addrs, names)
+        per_func[name] = per_func.get(name, 0) + count
+
+    total = sum(per_func.values()) or 1
+    ranked = sorted(per_func.items(), key=lambda kv: kv[1], reverse=True)
+    print("%d samples, %d dropped (histogram full)" % (samples, dropped))
+    print("%8s %7s  %s" % ("samples", "share", "function"))
+    for name, count in ranked[:args.top]:
+        print("%8d %6.2f%%  %s" % (count, 100.0 * count / total, name))
+
+    if args.folded:
+        with open(args.folded, "w") as f:
+            for name, count in ranked:
+                f.write("kernel;%s %d\n" % (name, count))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,83 @@
+#!/usr/bin/env python3
+"""Convert a kernel trace dump into Chrome trace-event JSON.
+
+Capture the serial log (for example `qemu-system-i386 ... -serial file:serial.log`),
+press F12 in the guest (or let a panic dump the ring), then run:
+
+    scripts/trace_to_json.py serial.log > trace.json
+
+and open trace.json in chrome://tracing or https://ui.perfetto.dev.
+"""
+
+import json
+import sys
+
+
+def parse_dump(lines):
+    """Yield (tsc_khz, names, records) for every TRACE BEGIN/END block."""
+    block = None
+    for line in lines:
+        fields = line.strip().split()
+        if len(fields) < 2 or fields[0] != "TRACE":
+            continue
+        kind = fields[1]
+        if kind == "BEGIN":
+            block = {"tsc_khz": int(fields[2]), "names": {}, "records": []}
+        elif block is None:
+            continue
+        elif kind == "NAME":
+            block["names"][int(fields[2])] = fields[3]
+        elif kind == "R" and len(fields) == 7:
+            block["records"].append((
+                int(fields[2], 16),     # tsc
+                int(fields[3]),         # event id
+                fields[4],              # phase
+                int(fields[5], 16),     # arg0
+                int(fields[6], 16),     # arg1
+            ))
+        elif kind == "END":
+            yield block["tsc_khz"], block["names"], block["records"]
+            block = None
+
+
+def to_events(tsc_khz, names, records):
+    if not records:
+        return []
+    base = min(r[0] for r in records)
+    per_us = max(tsc_khz, 1) / 1000.0
+    events = []
+    for tsc, event_id, phase, arg0, arg1 in records:
+        event = {
+            "name": names.get(event_id, "event_%d" % event_id),
+            "ph": phase,
+            "ts": (tsc - base) / per_us,
+            "pid": 1,
+            "tid": 1,
+            "args": {"arg0": arg0, "arg1": arg1},
+        }
+        if phase == "i":
+            event["s"] = "t"
+        events.append(event)
+    events.sort(key=lambda e: e["ts"])
+    return events
+
+
+def main(argv):
+    if len(argv) > 2:
+        sys.stderr.write("usage: %s [serial.log]\n" % argv[0])
+        return 2
+    with (open(argv[1], errors="replace") if len(argv) == 2 else sys.stdin) as f:
+        dumps = list(parse_dump(f))
+    if not dumps:
+        sys.stderr.write("no TRACE BEGIN/END block found\n")
+        return 1
+    # The most recent dump wins
+    tsc_khz, names, records = dumps[-1]
+    json.dump({"traceEvents": to_events(tsc_khz, names, records),
+               "displayTimeUnit": "ms"}, sys.stdout)
+    sys.stdout.write("\n")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
@@ -156,7 +156,10 @@ start:
     mov dl, [ebr_drive_number]
     call disk_read
 
-    add bx, [bdb_bytes_per_sector]
+    ; advance es rather than bx, so the kernel may grow past 64 KB
+    mov ax, es
+    add ax, 512 / 16
+    mov es, ax
 
     ; compute location of next cluster
     mov ax, [kernel_cluster]
@@ -197,11 +200,6 @@ start:
 
     jmp KERNEL_LOAD_SEGMENT:KERNEL_LOAD_OFFSET
 
-    jmp wait_key_and_reboot             ; should never happen
-
-    cli                                 ; disable interrupts, this way CPU can't get out of "halt" state
-    hlt
-
 
 ;
 ; Error handlers
@@ -0,0 +1,27 @@
+#ifndef ACPI_H
+#define ACPI_H
+
+#include <stdint.h>
+
+/* Common header of every ACPI system description table */
+typedef struct {
+    char signature[4];
+    uint32_t length;
+    uint8_t revision;
+    uint8_t checksum;
+    char oem_id[6];
+    char oem_table_id[8];
+    uint32_t oem_revision;
+    uint32_t creator_id;
+    uint32_t creator_revision;
+} __attribute__((packed)) AcpiHeader;
+
+/* Locate the RSDP and return the first table with this signature whose
+   checksum holds, or NULL; tables are reached through the identity map */
+const AcpiHeader *acpi_find_table(const char *signature);
+
+/* Local APIC ids of the enabled processors listed in the MADT; returns
+   the count, or 0 without a usable MADT */
+int acpi_madt_cpus(uint8_t *apic_ids, int max);
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef APIC_H
+#define APIC_H
+
+#include <stdint.h>
+
+/* Local APIC vectors, above the remapped PIC range */
+#define APIC_TIMER_VECTOR       0x30
+#define APIC_RESCHEDULE_VECTOR  0x31    /* IPI: something was queued for this CPU */
+#define APIC_TLB_VECTOR         0x32    /* IPI: reload CR3, see smp_flush_tlb */
+#define APIC_SPURIOUS_VECTOR    0x3F    /* Low nibble must be all ones on P6 */
+
+/* Map the BSP's local APIC, keep the 8259 routed through LINT0 and
+   calibrate the APIC timer against the PIT. Returns -1 without an APIC. */
+int apic_init(void);
+int apic_present(void);
+
+/* On each AP: enable its APIC and start the scheduler tick at TIMER_HZ */
+void apic_init_ap(void);
+
+uint8_t apic_id(void);
+void apic_eoi(void);
+void apic_send_ipi(uint8_t dest, uint8_t vector);
+
+/* INIT, then up to two STARTUP IPIs aimed at vector_page << 12; returns
+   once *online is set or -1 after the timeout. Sleeps, so thread context. */
+int apic_start_ap(uint8_t dest, uint8_t vector_page, volatile int *online);
+
+#endif
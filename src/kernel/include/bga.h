@@ -0,0 +1,28 @@
+#ifndef BGA_H
+#define BGA_H
+
+#include <stdint.h>
+#include "framebuffer.h"
+
+/* Bochs/QEMU display adapter (VBE DISPI interface, ports 0x1CE/0x1CF) */
+
+/* Returns the DISPI version (0xB0C0..0xB0C5), or 0 if the adapter is absent */
+uint16_t bga_detect(void);
+
+/* Program a linear-framebuffer mode without clearing video memory; the
+   virtual width equals the visible width. Returns 0 on success; a mode
+   outside the DISPI limits is refused untouched, and one the adapter
+   rejects is rolled back to the previous mode. */
+int bga_set_mode(uint16_t width, uint16_t height, uint8_t bpp);
+
+/* Scanlines of video memory addressable at the current width and depth */
+uint16_t bga_virtual_height(void);
+
+/* Start scanout at line y of the LFB; takes effect at the next refresh */
+void bga_set_y_offset(uint16_t y);
+
+/* Re-set the framebuffer's mode through DISPI and, if two screens fit in
+   video memory, present it by flipping pages. Returns 0 if flipping is on. */
+int bga_enable_page_flip(Framebuffer *fb);
+
+#endif
@@ -3,8 +3,51 @@
 
 #include <stdint.h>
 
+/* Real-mode BIOS services, run through the trampoline in bios_thunk.S.
+   A batch of requests costs one protected -> real -> protected round trip. */
+
+#define BIOS_BATCH_MAX      16
+
+/* Bounce buffer for BIOS data transfers: one 64 KB-aligned block below
+   1 MB, so ISA DMA (int 13h floppy reads) never crosses a 64 KB boundary */
+#define BIOS_BOUNCE_SEG     0x7000
+#define BIOS_BOUNCE_ADDR    0x70000u
+#define BIOS_BOUNCE_SIZE    0x10000u
+
+#define BIOS_FLAG_CF        0x0001
+
+/* One INT n request; the same frame holds the registers after the call.
+   Layout is shared with bios_thunk.S. */
+typedef struct {
+    uint32_t eax, ebx, ecx, edx, esi, edi, ebp;
+    uint16_t ds, es;
+    uint16_t flags;     /* Out: FLAGS after the call */
+    uint8_t vector;     /* In: interrupt number */
+    uint8_t pad;
+} __attribute__((packed)) BiosRegs;
+
+/* Run up to BIOS_BATCH_MAX requests in order in a single real-mode visit.
+   Paging is switched off and the PICs moved back to the BIOS vectors for
+   the duration; timer ticks that land in real mode are not counted.
+   Returns the number of requests run, -1 if count is out of range. */
+int bios_call_batch(BiosRegs *calls, int count);
+int bios_call(BiosRegs *regs);
+
+/* Protected-mode view of the bounce buffer at a real-mode offset */
+static inline void *bios_bounce_ptr(uint32_t offset) {
+    return (void *)(uintptr_t)(BIOS_BOUNCE_ADDR + offset);
+}
+
 void bios_putc(char c);
 uint8_t bios_get_key(void);
 int bios_get_drive_params(uint8_t drive, uint16_t *cylinders, uint8_t *heads, uint8_t *spt);
 
+/* Read sectors with int 13h, one request per track run, batched through the
+   bounce buffer. Returns the number of sectors read. */
+int bios_read_sectors(uint8_t drive, uint32_t lba, uint32_t count, void *buffer);
+
+/* Fetch the 256-byte VBE mode info block for each mode in one batch;
+   out receives count blocks. Returns how many modes the BIOS accepted. */
+int bios_vbe_mode_info(const uint16_t *modes, int count, void *out);
+
 #endif
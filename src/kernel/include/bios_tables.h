@@ -0,0 +1,18 @@
+#ifndef BIOS_TABLES_H
+#define BIOS_TABLES_H
+
+#include <stdint.h>
+
+/* Accepts a candidate whose signature already matched */
+typedef int (*BiosTableCheck)(const void *table);
+
+/* Byte sum of length bytes; BIOS and ACPI structures sum to zero */
+uint8_t bios_checksum(const void *data, uint32_t length);
+
+/* Find a structure on a 16-byte boundary that starts with the first
+   signature_length bytes of signature and passes check. Searches the first
+   KB of the EBDA, the last KB of base memory, then the BIOS ROM area at
+   0xE0000-0xFFFFF, which covers both the ACPI and the MP search order. */
+const void *bios_tables_find(const char *signature, uint32_t signature_length, BiosTableCheck check);
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef BLIT_H
+#define BLIT_H
+
+#include <stdint.h>
+
+/* Pick the fastest fill/copy kernels for this CPU (call after cpu_enable_sse) */
+void blit_init(void);
+
+/* 32-bit pixel spans into cacheable memory (back buffers, surfaces) */
+void blit_fill32(uint32_t *dst, uint32_t value, uint32_t count);
+void blit_copy32(uint32_t *dst, const uint32_t *src, uint32_t count);
+
+/* Same, with non-temporal stores for write-combining targets (the LFB) */
+void blit_fill32_stream(uint32_t *dst, uint32_t value, uint32_t count);
+void blit_copy32_stream(uint32_t *dst, const uint32_t *src, uint32_t count);
+
+/* 16-bit (RGB565/555) and packed 24-bit spans; built on the 32-bit kernels
+   above, so they stream the same way when the target is the LFB */
+void blit_fill16(uint16_t *dst, uint16_t value, uint32_t count);
+void blit_fill16_stream(uint16_t *dst, uint16_t value, uint32_t count);
+void blit_fill24(uint8_t *dst, uint32_t value, uint32_t count);
+
+/* Byte-length copies for any pixel size: word-aligned bulk plus byte edges */
+void blit_copy_bytes(void *dst, const void *src, uint32_t bytes);
+void blit_copy_bytes_stream(void *dst, const void *src, uint32_t bytes);
+
+/* Premultiplied ARGB (0xAARRGGBB) composited over 32-bit spans in cacheable
+   memory; blending reads dst, so never point these at the LFB. The source
+   must use dst's channel order; the byte above the channels carries alpha. */
+void blit_blend32(uint32_t *dst, const uint32_t *src, uint32_t count);
+void blit_blend32_alpha(uint32_t *dst, const uint32_t *src, uint32_t count, uint8_t alpha);
+void blit_blend_fill32(uint32_t *dst, uint32_t argb, uint32_t count);
+
+/* Premultiply 0xRRGGBB by alpha, giving the argb for blit_blend_fill32 */
+uint32_t blit_premultiply(uint32_t rgb, uint8_t alpha);
+
+/* SSE2 kernels from blit_sse2.S */
+void blit_fill32_sse2(uint32_t *dst, uint32_t value, uint32_t count);
+void blit_fill32_sse2_nt(uint32_t *dst, uint32_t value, uint32_t count);
+void blit_copy32_sse2(uint32_t *dst, const uint32_t *src, uint32_t count);
+void blit_copy32_sse2_nt(uint32_t *dst, const uint32_t *src, uint32_t count);
+void blit_blend32_sse2(uint32_t *dst, const uint32_t *src, uint32_t count);
+void blit_blend32_alpha_sse2(uint32_t *dst, const uint32_t *src, uint32_t count, uint32_t alpha);
+void blit_blend_fill32_sse2(uint32_t *dst, uint32_t argb, uint32_t count);
+
+#endif
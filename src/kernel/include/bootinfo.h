@@ -16,6 +16,14 @@ struct BootInfo {
     uint32_t font_ptr;
     uint8_t boot_drive;
     uint8_t pad[3];
+    /* VBE direct-color masks: channel width in bits and bit position */
+    uint8_t red_size;
+    uint8_t red_pos;
+    uint8_t green_size;
+    uint8_t green_pos;
+    uint8_t blue_size;
+    uint8_t blue_pos;
+    uint8_t pad2[2];
 } __attribute__((packed));
 
 #endif
@@ -0,0 +1,33 @@
+#ifndef CURSOR_H
+#define CURSOR_H
+
+#include <stdint.h>
+#include "framebuffer.h"
+
+#define CURSOR_MAX_W 16
+#define CURSOR_MAX_H 24
+
+/* Sprite art: one string per row, '.' transparent, 'X' outline, 'o' fill */
+typedef struct {
+    int width;
+    int height;
+    int hot_x;
+    int hot_y;
+    const char *const *rows;
+    uint32_t outline_color;
+    uint32_t fill_color;
+} CursorSprite;
+
+/* Load a sprite (NULL selects the default arrow); the cursor starts hidden */
+void cursor_init(const CursorSprite *sprite);
+
+/* Save the pixels under the sprite, then draw it with its hot spot at (x, y) */
+void cursor_show(Framebuffer *fb, int x, int y);
+
+/* Put the saved pixels back; must be called before redrawing under the cursor */
+void cursor_hide(Framebuffer *fb);
+
+void cursor_move(Framebuffer *fb, int x, int y);
+int cursor_is_visible(void);
+
+#endif
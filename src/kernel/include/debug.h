@@ -2,6 +2,7 @@
 #define DEBUG_H
 
 #include <stdint.h>
+#include <stdarg.h>
 
 /* Log levels */
 typedef enum {
@@ -11,18 +12,101 @@ typedef enum {
     LOG_ERROR = 3
 } LogLevel;
 
+/* Subsystems with their own runtime switch; a file picks one by defining
+   LOG_CATEGORY (e.g. "#define LOG_CATEGORY FDC") before including debug.h */
+typedef enum {
+    LOG_CAT_CORE = 0,
+    LOG_CAT_FDC,
+    LOG_CAT_FAT,
+    LOG_CAT_FB,
+    LOG_CAT_UI,
+    LOG_CAT_MOUSE,
+    LOG_CAT_COUNT
+} LogCategory;
+
+#define LOG_CAT_ALL ((1u << LOG_CAT_COUNT) - 1)
+
+/* Compile-time floor: calls below it expand to nothing, string and all.
+   Set from the Makefile (LOG_MIN_LEVEL=2 drops DEBUG and INFO); each
+   category can be raised separately with LOG_MIN_LEVEL_<CATEGORY>. */
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL 0
+#endif
+#ifndef LOG_MIN_LEVEL_CORE
+#define LOG_MIN_LEVEL_CORE LOG_MIN_LEVEL
+#endif
+#ifndef LOG_MIN_LEVEL_FDC
+#define LOG_MIN_LEVEL_FDC LOG_MIN_LEVEL
+#endif
+#ifndef LOG_MIN_LEVEL_FAT
+#define LOG_MIN_LEVEL_FAT LOG_MIN_LEVEL
+#endif
+#ifndef LOG_MIN_LEVEL_FB
+#define LOG_MIN_LEVEL_FB LOG_MIN_LEVEL
+#endif
+#ifndef LOG_MIN_LEVEL_UI
+#define LOG_MIN_LEVEL_UI LOG_MIN_LEVEL
+#endif
+#ifndef LOG_MIN_LEVEL_MOUSE
+#define LOG_MIN_LEVEL_MOUSE LOG_MIN_LEVEL
+#endif
+
+#ifndef LOG_CATEGORY
+#define LOG_CATEGORY CORE
+#endif
+
+/* Output sinks */
+#define DEBUG_SINK_SERIAL   0x01    /* COM1, drained from the TX ring */
+#define DEBUG_SINK_E9       0x02    /* Emulator debug console port 0xE9 */
+
+#define DEBUG_SERIAL_BAUD   115200
+#define DEBUG_TX_RING_SIZE  8192    /* Power of two */
+
+/* Polled COM1 output until debug_start_async hooks the UART interrupt;
+   after that received bytes arrive as EVENT_SERIAL (debug commands) */
 void debug_init(void);
+void debug_start_async(void);
+
 void debug_set_level(LogLevel level);
+void debug_set_category_mask(unsigned mask);
+unsigned debug_get_category_mask(void);
+void debug_set_sinks(unsigned mask);
+unsigned debug_get_sinks(void);
+
+/* Push everything still queued out of the UART (crash paths) */
+void debug_flush(void);
+uint32_t debug_dropped(void);
+
 void debug_putc(char c);
 void debug_puts(const char *str);
 void debug_puthex(uint32_t value);
+void debug_vprintf(const char *fmt, va_list args);
+void kprintf(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
 void debug_log(const char *msg);
-void debug_log_level(LogLevel level, const char *msg);
+void debug_log_level(LogLevel level, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+void debug_log_cat(LogCategory cat, LogLevel level, const char *fmt, ...) __attribute__((format(printf, 3, 4)));
+
+/* Runtime filter state, read inline so filtered calls never format */
+extern LogLevel debug_runtime_level;
+extern unsigned debug_category_mask;
+
+/* Log, dump the trace ring, flush every sink and halt */
+void panic(const char *fmt, ...) __attribute__((format(printf, 1, 2), noreturn));
+
+/* Log in a category; the extra level lets LOG_CATEGORY expand first */
+#define LOG_AT(cat, level, msg, ...) LOG_AT_(cat, level, msg, ##__VA_ARGS__)
+#define LOG_AT_(cat, level, msg, ...) \
+    do { \
+        if ((level) >= LOG_MIN_LEVEL_##cat && (level) >= debug_runtime_level && \
+            (debug_category_mask & (1u << LOG_CAT_##cat))) { \
+            debug_log_cat(LOG_CAT_##cat, (level), msg, ##__VA_ARGS__); \
+        } \
+    } while (0)
 
-/* Convenience macros */
-#define DEBUG(msg, ...) debug_log_level(LOG_DEBUG, msg)
-#define INFO(msg, ...) debug_log_level(LOG_INFO, msg)
-#define WARN(msg, ...) debug_log_level(LOG_WARN, msg)
-#define ERROR(msg, ...) debug_log_level(LOG_ERROR, msg)
+/* Convenience macros, in the including file's LOG_CATEGORY */
+#define DEBUG(msg, ...) LOG_AT(LOG_CATEGORY, LOG_DEBUG, msg, ##__VA_ARGS__)
+#define INFO(msg, ...) LOG_AT(LOG_CATEGORY, LOG_INFO, msg, ##__VA_ARGS__)
+#define WARN(msg, ...) LOG_AT(LOG_CATEGORY, LOG_WARN, msg, ##__VA_ARGS__)
+#define ERROR(msg, ...) LOG_AT(LOG_CATEGORY, LOG_ERROR, msg, ##__VA_ARGS__)
 
 #endif
@@ -0,0 +1,24 @@
+#ifndef ELF_H
+#define ELF_H
+
+#include <stdint.h>
+
+/* Programs are static i386 executables linked inside this window, which
+   is taken out of the identity map and paged in on demand */
+#define ELF_WINDOW_BASE     0x40000000u
+#define ELF_WINDOW_SIZE     0x01000000u     /* 16 MB, four page tables */
+#define ELF_MAX_SEGMENTS    8               /* PT_LOAD headers per program */
+#define ELF_MAX_PHDRS       16
+
+/* Reserve the program window; needs paging, the heap and smp_init */
+int elf_init(void);
+
+/* Read only the ELF and program headers of filename and start its entry
+   point (int entry(void), ring 0) in a new thread. Pages of each PT_LOAD
+   segment are read from the file the first time they are touched; the
+   BSS is zero-filled on demand. When the entry returns, its frames are
+   freed and the window is unmapped. One program at a time: -1 if one is
+   running, or the file is missing or not a loadable executable. */
+int elf_exec(const char *filename, int priority);
+
+#endif
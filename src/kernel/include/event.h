@@ -0,0 +1,63 @@
+#ifndef EVENT_H
+#define EVENT_H
+
+#include <stdint.h>
+
+#define EVENT_QUEUE_SIZE 256    /* Power of two */
+
+typedef enum {
+    EVENT_NONE = 0,
+    EVENT_MOUSE,        /* Pointer motion or button change */
+    EVENT_KEY,          /* Raw keyboard scancode */
+    EVENT_TIMER,        /* A timer armed with timer_arm expired */
+    EVENT_DISK,         /* A floppy transfer finished */
+    EVENT_SERIAL,       /* A byte received on the debug UART */
+    EVENT_TASK          /* A background thread finished a job */
+} EventType;
+
+typedef struct {
+    uint8_t type;
+    uint32_t time;      /* timer_ms() when posted */
+    union {
+        struct {
+            int16_t dx, dy;     /* Screen direction: +y is down */
+            int16_t dz;         /* Wheel clicks */
+            uint8_t buttons;
+        } mouse;
+        struct {
+            uint8_t scancode;
+        } key;
+        struct {
+            uint32_t id;
+        } timer;
+        struct {
+            uint8_t ch;
+        } serial;
+        struct {
+            uint32_t lba;
+            int32_t status;     /* 0 on success, FdcError otherwise */
+        } disk;
+        struct {
+            uint32_t id;        /* Chosen by whoever started the thread */
+            int32_t status;
+        } task;
+    };
+} Event;
+
+void event_init(void);
+
+/* Safe from interrupt handlers; returns -1 (and counts a drop) when full.
+   Mouse motion with unchanged buttons is merged into a still-queued mouse
+   event, so a burst of packets costs one event per frame. */
+int event_post(const Event *event);
+
+/* Take the oldest event; returns 0 if the queue is empty */
+int event_poll(Event *event);
+
+/* Block until an event arrives (hlt before the scheduler runs); leaves
+   interrupts enabled. Meant for a single consumer thread. */
+void event_wait(Event *event);
+
+uint32_t event_dropped(void);
+
+#endif
@@ -54,4 +54,11 @@ int fdc_write_sector(uint32_t lba, const uint8_t *buffer);
 int fdc_motor_on(void);
 int fdc_motor_off(void);
 
+/* Post an EVENT_DISK for every finished sector transfer. Off by default:
+   nothing in the main loop consumes them, and file work already reports
+   back as EVENT_TASK. Once the controller is up and the buffer is valid,
+   each read or write posts exactly one, with its FdcError status whether
+   it succeeded or failed in the motor, recalibrate, seek or data phase. */
+void fdc_set_notify(int enabled);
+
 #endif /* FDC_H */
@@ -0,0 +1,12 @@
+#ifndef FORMAT_H
+#define FORMAT_H
+
+#include <stdarg.h>
+#include <stddef.h>
+
+/* printf subset: %d %i %u %x %X %p %c %s %%, with '-', '0', width and the
+   l/ll length modifiers. Always NUL-terminates; returns the untruncated length. */
+int kvsnprintf(char *buf, size_t size, const char *fmt, va_list args);
+int ksnprintf(char *buf, size_t size, const char *fmt, ...) __attribute__((format(printf, 3, 4)));
+
+#endif
@@ -2,24 +2,125 @@
 #define FRAMEBUFFER_H
 
 #include <stdint.h>
+#include "rect.h"
 
 struct BootInfo;
 
+#define FB_MAX_DIRTY 16
+#define FB_CLIP_DEPTH 8
+
+/* Show the page starting at scanline y_offset of the LFB */
+typedef void (*FbFlipFn)(uint16_t y_offset);
+
+/* Span kernels for one pixel size, picked once in fb_init */
+typedef struct {
+    void (*fill)(uint8_t *dst, uint32_t pixel, uint32_t count);         /* Cached memory */
+    void (*fill_stream)(uint8_t *dst, uint32_t pixel, uint32_t count);  /* The LFB */
+} FbPixelOps;
+
 typedef struct {
-    uint32_t *addr;          /* Visible framebuffer */
-    uint32_t *back_buffer;   /* Off-screen buffer for double buffering */
+    uint8_t *addr;           /* Visible framebuffer */
+    uint8_t *back_buffer;    /* Off-screen buffer for double buffering */
     uint16_t width;
     uint16_t height;
     uint16_t pitch;
     uint8_t bpp;
+    uint8_t bytes_per_pixel;
+    /* Direct-color layout: an 8-bit channel is shifted right by *_loss,
+       then left into *_pos */
+    uint8_t red_pos, red_loss;
+    uint8_t green_pos, green_loss;
+    uint8_t blue_pos, blue_loss;
+    const FbPixelOps *ops;
     const uint8_t *font;
+    FbRect dirty[FB_MAX_DIRTY];  /* Back buffer regions not yet presented */
+    int dirty_count;
+    FbRect clip;                 /* Drawing is limited to this rectangle */
+    FbRect clip_stack[FB_CLIP_DEPTH];  /* Clips saved by fb_push_clip */
+    FbRect clip_full;            /* Clip when the stack filled up */
+    int clip_depth;              /* Pushes not yet popped, may exceed FB_CLIP_DEPTH */
+    /* Page flipping: two screens stacked in the LFB, one scanned out */
+    FbFlipFn flip;
+    uint8_t *page_base;
+    uint8_t front_page;
+    FbRect prev_dirty[FB_MAX_DIRTY];  /* Damage the hidden page has not seen */
+    int prev_dirty_count;
 } Framebuffer;
 
-void fb_init(Framebuffer *fb, const struct BootInfo *info);
-void fb_enable_double_buffer(Framebuffer *fb, uint32_t *buffer);
+/* Drawing APIs take 0xRRGGBB; this converts to the surface's pixel value */
+static inline uint32_t fb_pack_color(const Framebuffer *fb, uint32_t rgb) {
+    return ((((rgb >> 16) & 0xFF) >> fb->red_loss) << fb->red_pos) |
+           ((((rgb >> 8) & 0xFF) >> fb->green_loss) << fb->green_pos) |
+           (((rgb & 0xFF) >> fb->blue_loss) << fb->blue_pos);
+}
+
+/* Row y of whatever is being drawn into (back buffer if there is one) */
+static inline uint8_t *fb_target_row(const Framebuffer *fb, int y) {
+    return (fb->back_buffer ? fb->back_buffer : fb->addr) + ((uint32_t)y * fb->pitch);
+}
+
+static inline uint32_t fb_read_pixel(const Framebuffer *fb, const uint8_t *p) {
+    switch (fb->bytes_per_pixel) {
+        case 2:
+            return *(const uint16_t *)p;
+        case 3:
+            return p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16);
+        default:
+            return *(const uint32_t *)p;
+    }
+}
+
+static inline void fb_write_pixel(const Framebuffer *fb, uint8_t *p, uint32_t pixel) {
+    switch (fb->bytes_per_pixel) {
+        case 2:
+            *(uint16_t *)p = (uint16_t)pixel;
+            break;
+        case 3:
+            p[0] = (uint8_t)pixel;
+            p[1] = (uint8_t)(pixel >> 8);
+            p[2] = (uint8_t)(pixel >> 16);
+            break;
+        default:
+            *(uint32_t *)p = pixel;
+            break;
+    }
+}
+
+/* Returns -1 for pixel sizes without a backend (only 15/16, 24 and 32 bpp) */
+int fb_init(Framebuffer *fb, const struct BootInfo *info);
+void fb_enable_double_buffer(Framebuffer *fb, void *buffer);
+
+/* Off-screen surface in the same pixel format as another framebuffer.
+   Drawing records damage in its dirty list; it is never swapped. */
+void fb_init_surface(Framebuffer *fb, const Framebuffer *format, uint16_t width, uint16_t height, void *pixels);
+void fb_set_clip(Framebuffer *fb, int x, int y, int w, int h);
+void fb_reset_clip(Framebuffer *fb);
+
+/* Narrow the clip to its intersection with a rectangle until the matching
+   fb_pop_clip, so every push must be popped. Past FB_CLIP_DEPTH pushes still
+   narrow, but their pops only go back to the clip the stack filled at. */
+void fb_push_clip(Framebuffer *fb, int x, int y, int w, int h);
+void fb_pop_clip(Framebuffer *fb);
+void fb_mark_dirty(Framebuffer *fb, int x, int y, int w, int h);
+
+/* Present by flipping between two LFB pages (needs a back buffer). The back
+   buffer stays the drawing target, so nothing is ever read back from video
+   memory; fb_swap streams this frame's and the last frame's damage into the
+   hidden page and flips to it, so scanout never sees a half-copied frame. */
+void fb_enable_page_flip(Framebuffer *fb, FbFlipFn flip);
 void fb_swap(Framebuffer *fb);
 void fb_clear(Framebuffer *fb, uint32_t color);
 void fb_draw_rect(Framebuffer *fb, int x, int y, int w, int h, uint32_t color);
+
+/* Copy a surface in the same pixel format to (x, y), clipped */
+void fb_blit(Framebuffer *fb, const Framebuffer *src, int x, int y);
+
+/* Translucent drawing; reads back what is underneath, so draw into a back
+   buffer or surface. fb_blend_rect covers with color at alpha (0-255);
+   fb_blend_image composites a premultiplied 0xAARRGGBB image (stride in
+   pixels), additionally faded by alpha. */
+void fb_blend_rect(Framebuffer *fb, int x, int y, int w, int h, uint32_t color, uint8_t alpha);
+void fb_blend_image(Framebuffer *fb, int x, int y, int w, int h, const uint32_t *argb, int stride, uint8_t alpha);
 void fb_draw_char(Framebuffer *fb, int x, int y, char c, uint32_t color);
 void fb_draw_text(Framebuffer *fb, int x, int y, const char *text, uint32_t color);
 
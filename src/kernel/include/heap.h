@@ -0,0 +1,21 @@
+#ifndef HEAP_H
+#define HEAP_H
+
+#include <stdint.h>
+
+/* Early bump allocator for large buffers above 1 MB (never freed), plus
+   a free list of whole pages that can be given back */
+#define HEAP_START  0x00100000u
+#define HEAP_END    0x01000000u  /* 16 MB, below the default QEMU/Bochs RAM */
+#define HEAP_PAGE_SIZE  4096
+
+void heap_init(uint32_t start, uint32_t end);
+void *heap_alloc(uint32_t size, uint32_t align);
+uint32_t heap_used(void);
+
+/* Page-aligned 4 KB frame, recycled from heap_free_page when possible;
+   contents undefined, NULL when the heap is exhausted */
+void *heap_alloc_page(void);
+void heap_free_page(void *page);
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <stdint.h>
+#include "framebuffer.h"
+
+#define IMAGE_CACHE_SIZE    16
+#define IMAGE_WINDOW        1024    /* File bytes buffered while decoding */
+#define IMAGE_MAX_DIM       2048
+
+/* Decode an uncompressed BMP (8 bpp palette, 24 or 32 bpp; bottom-up or
+   top-down) from the FAT12 volume into a new surface in format's pixel
+   layout. Rows stream through a small window, never the whole file.
+   Returns -1 on a missing, malformed or unsupported file. */
+int image_load_bmp(const char *filename, const Framebuffer *format, Framebuffer *out);
+
+/* Cached surface for filename in format's layout, decoded on first use;
+   NULL if it cannot be loaded. Entries live for the rest of the run. */
+const Framebuffer *image_get(const char *filename, const Framebuffer *format);
+
+#endif
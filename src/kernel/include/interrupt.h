@@ -0,0 +1,76 @@
+#ifndef INTERRUPT_H
+#define INTERRUPT_H
+
+#include <stdint.h>
+
+#define INTERRUPT_VECTORS   64      /* 32 CPU exceptions + 16 PIC IRQs + 16 local APIC */
+#define IRQ_BASE            0x20    /* PIC vectors are remapped above the exceptions */
+#define IRQ_COUNT           16
+#define LOCAL_VECTOR_BASE   0x30    /* Local APIC timer and IPIs, see apic.h */
+#define LOCAL_VECTOR_COUNT  16
+#define BIOS_IRQ_BASE       0x08    /* Where the BIOS expects the master PIC */
+#define BIOS_IRQ_BASE_SLAVE 0x70
+
+#define IRQ_TIMER           0
+#define IRQ_KEYBOARD        1
+#define IRQ_CASCADE         2
+#define IRQ_COM1            4
+#define IRQ_FLOPPY          6
+#define IRQ_MOUSE           12
+
+#define EFLAGS_IF           (1u << 9)
+
+/* Register state pushed by the common stub in isr.S (lowest address first) */
+typedef struct {
+    uint32_t gs, fs, es, ds;
+    uint32_t edi, esi, ebp, esp_unused, ebx, edx, ecx, eax;
+    uint32_t vector;
+    uint32_t error_code;
+    uint32_t eip, cs, eflags;
+} InterruptFrame;
+
+typedef void (*IrqHandler)(InterruptFrame *frame);
+
+/* Load the IDT and remap the PICs with every IRQ masked; interrupts stay off */
+void interrupt_init(void);
+
+/* Load the same IDT on an AP */
+void interrupt_init_ap(void);
+
+/* Handlers run with interrupts disabled; the EOI is sent after they return,
+   then the scheduler may switch threads */
+void irq_set_handler(int irq, IrqHandler handler);
+
+/* Local APIC vectors run on whichever CPU received them and get an APIC
+   EOI; the PIC lines only ever reach the BSP */
+void local_irq_set_handler(int vector, IrqHandler handler);
+void irq_mask(int irq);
+void irq_unmask(int irq);
+
+/* Reprogram the PIC vector bases, keeping the current masks; used to hand
+   the IRQs back to the BIOS around real-mode calls. Interrupts must be off. */
+void pic_set_vector_base(uint8_t master, uint8_t slave);
+
+static inline void interrupts_enable(void) {
+    __asm__ volatile ("sti" : : : "memory");
+}
+
+static inline void interrupts_disable(void) {
+    __asm__ volatile ("cli" : : : "memory");
+}
+
+/* Disable interrupts, returning the previous EFLAGS for irq_restore */
+static inline uint32_t irq_save(void) {
+    uint32_t flags;
+
+    __asm__ volatile ("pushfl; popl %0; cli" : "=r"(flags) : : "memory");
+    return flags;
+}
+
+static inline void irq_restore(uint32_t flags) {
+    if (flags & EFLAGS_IF) {
+        __asm__ volatile ("sti" : : : "memory");
+    }
+}
+
+#endif
@@ -14,6 +14,26 @@ static inline uint8_t inb(uint16_t port) {
     return value;
 }
 
+static inline void outw(uint16_t port, uint16_t value) {
+    __asm__ volatile ("outw %0, %1" : : "a"(value), "Nd"(port));
+}
+
+static inline uint16_t inw(uint16_t port) {
+    uint16_t value;
+
+    __asm__ volatile ("inw %1, %0" : "=a"(value) : "Nd"(port));
+    return value;
+}
+
+/* Word from low physical memory such as the BIOS data area; done in asm
+   because GCC treats constant addresses below 4 KB as null dereferences */
+static inline uint16_t phys_read16(uint32_t addr) {
+    uint16_t value;
+
+    __asm__ volatile ("movw (%1), %0" : "=r"(value) : "r"(addr) : "memory");
+    return value;
+}
+
 static inline void io_wait(void) {
     outb(0x80, 0);
 }
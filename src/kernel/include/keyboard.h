@@ -0,0 +1,7 @@
+#ifndef KEYBOARD_H
+#define KEYBOARD_H
+
+/* Hook IRQ1 and post each raw scancode as an EVENT_KEY */
+void keyboard_init(void);
+
+#endif
@@ -3,13 +3,30 @@
 
 #include <stdint.h>
 
+/* Resolution codes for mouse_configure (counts per millimetre) */
+#define MOUSE_RES_1_PER_MM  0
+#define MOUSE_RES_2_PER_MM  1
+#define MOUSE_RES_4_PER_MM  2
+#define MOUSE_RES_8_PER_MM  3
+
+#define MOUSE_DEFAULT_RATE          200     /* Samples per second */
+#define MOUSE_DEFAULT_RESOLUTION    MOUSE_RES_4_PER_MM
+
 typedef struct {
     int x;
     int y;
     uint8_t buttons;
+    int wheel;          /* Accumulated wheel clicks, + is towards the user */
 } MouseState;
 
+/* Enable the aux port, detect a wheel and post EVENT_MOUSE from IRQ12 */
 void mouse_init(void);
-int mouse_poll(MouseState *state);
+
+/* Rate must be 10, 20, 40, 60, 80, 100 or 200 Hz; returns -1 if rejected */
+int mouse_configure(uint8_t sample_rate, uint8_t resolution);
+
+int mouse_has_wheel(void);
+uint8_t mouse_sample_rate(void);
+uint8_t mouse_resolution(void);
 
 #endif
@@ -0,0 +1,11 @@
+#ifndef MPTABLE_H
+#define MPTABLE_H
+
+#include <stdint.h>
+
+/* Intel MultiProcessor Specification 1.4 tables, for machines without an
+   ACPI MADT. Fills the enabled processors' local APIC ids and returns the
+   count, or 0 if there is no configuration table. */
+int mptable_cpus(uint8_t *apic_ids, int max);
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef MUTEX_H
+#define MUTEX_H
+
+#include "thread.h"
+#include "spinlock.h"
+
+/* Sleeping lock for thread context (after thread_init); never take one in
+   an IRQ handler. All zeroes is a valid unlocked mutex. */
+typedef struct {
+    Spinlock lock;
+    Thread *owner;
+    WaitQueue waiters;
+} Mutex;
+
+void mutex_init(Mutex *m);
+void mutex_lock(Mutex *m);
+int mutex_trylock(Mutex *m);    /* 1 if taken */
+void mutex_unlock(Mutex *m);
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef PAGING_H
+#define PAGING_H
+
+#include <stdint.h>
+
+#define PAGE_SIZE_4M    0x400000u
+#define PAGE_SIZE       0x1000u
+
+/* Page directory entry bits (4 MB pages) */
+#define PDE_PRESENT     (1u << 0)
+#define PDE_WRITE       (1u << 1)
+#define PDE_PWT         (1u << 3)
+#define PDE_PCD         (1u << 4)
+#define PDE_LARGE       (1u << 7)
+#define PDE_LARGE_PAT   (1u << 12)
+
+/* Page table entry bits (4 KB pages inside a reserved window) */
+#define PTE_PRESENT     (1u << 0)
+#define PTE_WRITE       (1u << 1)
+
+/* Page fault error code */
+#define PF_PRESENT      (1u << 0)   /* Protection fault, not a missing page */
+#define PF_WRITE        (1u << 1)
+
+#define PAGING_MAX_WINDOWS  4
+
+/* Supplies the missing page at addr inside a window, typically by mapping
+   a fresh frame with paging_map. Runs in the faulting thread with
+   interrupts enabled, so it may sleep. 0 once the page is mapped, -1 to
+   treat the fault as fatal. */
+typedef int (*PageFaultHandler)(uint32_t addr, uint32_t error);
+
+/* Takes back the frame behind a page removed by paging_unmap_range */
+typedef void (*PageReleaseFn)(uint32_t phys);
+
+/* Identity-map the whole 4 GB space with 4 MB pages and enable paging.
+   Returns 0 on success, -1 if the CPU lacks PSE (paging stays off). */
+int paging_init(void);
+int paging_enabled(void);
+
+/* Mark a physical range write-combining (PAT if available, MTRR otherwise).
+   Like paging_set_uncached, the change is shot down on every online CPU;
+   the MTRR fallback only works before smp_init. */
+int paging_set_write_combining(uint32_t phys, uint32_t size);
+
+/* Map a physical range strong-uncacheable (PCD|PWT), e.g. for MMIO the
+   MTRRs may leave write-back */
+int paging_set_uncached(uint32_t phys, uint32_t size);
+
+/* Take [virt, virt + size) (4 MB aligned) out of the identity map and
+   give it empty 4 KB page tables; not-present faults there go to handler.
+   Thread context, after smp_init. */
+int paging_reserve(uint32_t virt, uint32_t size, PageFaultHandler handler);
+
+/* Entries inside a reserved window. Filling an empty entry needs no flush.
+   Unmapping shoots the translation down on every CPU before returning the
+   frame (or 0 if nothing was mapped); paging_unmap_range does a whole range
+   with one shootdown, then hands each frame to release. */
+int paging_map(uint32_t virt, uint32_t phys, uint32_t flags);
+uint32_t paging_unmap(uint32_t virt);
+void paging_unmap_range(uint32_t virt, uint32_t size, PageReleaseFn release);
+int paging_mapped(uint32_t virt);
+
+/* Whether a fault is a missing page inside a reserved window. Safe with
+   interrupts off; interrupt_dispatch checks it before enabling them. */
+int paging_fault_claimed(uint32_t addr, uint32_t error);
+
+/* Route a page fault to the window holding addr; -1 if none claims it.
+   interrupt_dispatch calls it with interrupts enabled. */
+int paging_fault(uint32_t addr, uint32_t error);
+
+/* On an AP, with paging still off: repeat the PAT and MTRR changes made on
+   the BSP, so every CPU agrees on memory types, then load the same page
+   directory. Later changes to present entries need smp_flush_tlb. */
+void paging_init_ap(void);
+
+#endif
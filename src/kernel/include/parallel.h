@@ -0,0 +1,17 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+/* One item of a parallel_for; items of one call must not depend on each other */
+typedef void (*ParallelFn)(void *arg, int index);
+
+/* Start one worker thread per CPU beyond the first; call after smp_init.
+   Returns the number of workers. */
+int parallel_init(void);
+int parallel_workers(void);
+
+/* Run fn(arg, i) for every i in [0, count) on the workers and the calling
+   thread, which takes items too; returns once all have finished. Without
+   workers the items simply run in order on the caller. Thread context. */
+void parallel_for(int count, ParallelFn fn, void *arg);
+
+#endif
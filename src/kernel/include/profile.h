@@ -0,0 +1,57 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdint.h>
+
+#define PROFILE_HASH_BITS 12
+#define PROFILE_BUCKETS (1u << PROFILE_HASH_BITS)  /* Distinct EIPs tracked */
+#define PROFILE_PROBES  8       /* Linear probe limit before a sample is dropped */
+
+/* Allocate the histogram; sampling starts immediately */
+int profile_init(void);
+
+void profile_start(void);
+void profile_stop(void);
+void profile_reset(void);
+
+/* Write 'PROFILE ...' lines for scripts/profile_symbolize.py, then reset */
+void profile_dump(void);
+
+typedef struct {
+    uint32_t eip;
+    uint32_t count;
+} ProfileBucket;
+
+extern ProfileBucket *profile_table;    /* NULL while not sampling */
+extern uint32_t profile_samples;
+extern uint32_t profile_dropped;
+
+/* Timer IRQ hook: count the interrupted EIP */
+static inline void profile_sample(uint32_t eip) {
+    uint32_t h;
+
+    if (!profile_table) {
+        return;
+    }
+
+    /* Fibonacci hash of the address, then a short linear probe */
+    h = (eip * 2654435761u) >> (32 - PROFILE_HASH_BITS);
+    for (int i = 0; i < PROFILE_PROBES; i++) {
+        ProfileBucket *b = &profile_table[(h + i) & (PROFILE_BUCKETS - 1)];
+
+        if (b->eip == eip) {
+            b->count++;
+            profile_samples++;
+            return;
+        }
+        if (b->count == 0) {
+            b->eip = eip;
+            b->count = 1;
+            profile_samples++;
+            return;
+        }
+    }
+    profile_dropped++;
+}
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef RECT_H
+#define RECT_H
+
+typedef struct {
+    int x, y;
+    int w, h;
+} FbRect;
+
+static inline int rect_area(const FbRect *r) {
+    return r->w * r->h;
+}
+
+static inline int rect_empty(const FbRect *r) {
+    return r->w <= 0 || r->h <= 0;
+}
+
+static inline void rect_union(FbRect *out, const FbRect *a, const FbRect *b) {
+    int x0 = a->x < b->x ? a->x : b->x;
+    int y0 = a->y < b->y ? a->y : b->y;
+    int x1 = (a->x + a->w) > (b->x + b->w) ? (a->x + a->w) : (b->x + b->w);
+    int y1 = (a->y + a->h) > (b->y + b->h) ? (a->y + a->h) : (b->y + b->h);
+
+    out->x = x0;
+    out->y = y0;
+    out->w = x1 - x0;
+    out->h = y1 - y0;
+}
+
+/* Returns 0 (and an empty out) when a and b do not overlap */
+static inline int rect_intersect(FbRect *out, const FbRect *a, const FbRect *b) {
+    int x0 = a->x > b->x ? a->x : b->x;
+    int y0 = a->y > b->y ? a->y : b->y;
+    int x1 = (a->x + a->w) < (b->x + b->w) ? (a->x + a->w) : (b->x + b->w);
+    int y1 = (a->y + a->h) < (b->y + b->h) ? (a->y + a->h) : (b->y + b->h);
+
+    out->x = x0;
+    out->y = y0;
+    out->w = x1 > x0 ? x1 - x0 : 0;
+    out->h = y1 > y0 ? y1 - y0 : 0;
+    return !rect_empty(out);
+}
+
+/* Add r to a small region list, merging neighbours whose union costs no
+   more than both apart; a full list folds r into its cheapest entry */
+void rect_list_add(FbRect *list, int *count, int max, const FbRect *r);
+
+/* a minus b as up to four disjoint bands (above, below, left, right);
+   returns the number of pieces written to out */
+int rect_subtract(FbRect out[4], const FbRect *a, const FbRect *b);
+
+/* Remove b from a list of disjoint rectangles, keeping them disjoint.
+   Returns -1 if the pieces did not fit in max (the list is then partial). */
+int rect_region_subtract(FbRect *list, int *count, int max, const FbRect *b);
+
+#endif
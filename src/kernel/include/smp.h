@@ -0,0 +1,60 @@
+#ifndef SMP_H
+#define SMP_H
+
+#include <stdint.h>
+#include "thread.h"
+
+#define SMP_MAX_CPUS        8
+#define SMP_AP_STACK_SIZE   8192        /* Becomes the AP's idle thread stack */
+#define SMP_TRAMPOLINE      0x7000u     /* Page-aligned, below 1 MB; SIPI vector 0x07 */
+
+/* Per-CPU data, reached through %gs (see cpu_self). The scheduler fields
+   belong to thread.c and are only touched under its lock. */
+typedef struct Cpu Cpu;
+
+struct Cpu {
+    Cpu *self;                  /* %gs:0 */
+    uint32_t id;                /* Dense index; the BSP is 0 */
+    uint8_t apic_id;
+    volatile int online;
+
+    Thread *current;
+    Thread *idle;
+    Thread *ready_head[THREAD_PRIORITIES];
+    Thread *ready_tail[THREAD_PRIORITIES];
+    uint32_t ready_count;
+    volatile int need_resched;
+    volatile int preempt_count;
+    uint32_t slice_left;
+
+    uint32_t switches;          /* Statistics */
+    uint32_t steals;
+};
+
+/* The CPU this code runs on. Only stable while the caller cannot migrate:
+   interrupts off, preemption disabled, or a spinlock held. */
+static inline Cpu *cpu_self(void) {
+    Cpu *cpu;
+
+    __asm__ volatile ("movl %%gs:0, %0" : "=r"(cpu));
+    return cpu;
+}
+
+/* Load a GDT with a per-CPU segment for each possible CPU and point %gs at
+   the BSP's; first thing after cpu_init, before anything calls cpu_self */
+void smp_early_init(void);
+
+/* Find the other CPUs in the ACPI MADT (or the MP tables) and start them
+   with INIT-SIPI-SIPI; needs the scheduler and the PIT running. Returns
+   the number of CPUs online. */
+int smp_init(void);
+
+/* Reload CR3 here and on every other online CPU, waiting until all have;
+   needed after a present page table entry is changed or removed. Thread
+   context with interrupts enabled. */
+void smp_flush_tlb(void);
+
+int smp_cpu_count(void);        /* Online CPUs */
+Cpu *smp_cpu(uint32_t index);
+
+#endif
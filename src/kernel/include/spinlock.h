@@ -0,0 +1,45 @@
+#ifndef SPINLOCK_H
+#define SPINLOCK_H
+
+#include <stdint.h>
+#include "interrupt.h"
+
+/* Busy-wait lock for state shared between CPUs. Anything an IRQ handler
+   also touches must be taken with the _irqsave variants, or the handler
+   could spin forever on a lock its own CPU holds. */
+typedef struct {
+    volatile uint32_t locked;
+} Spinlock;
+
+#define SPINLOCK_INIT { 0 }
+
+static inline void spin_lock(Spinlock *lock) {
+    while (__atomic_exchange_n(&lock->locked, 1, __ATOMIC_ACQUIRE)) {
+        /* Spin on a plain read so waiters do not bounce the line with xchg */
+        while (lock->locked) {
+            __asm__ volatile ("pause");
+        }
+    }
+}
+
+static inline int spin_trylock(Spinlock *lock) {
+    return !__atomic_exchange_n(&lock->locked, 1, __ATOMIC_ACQUIRE);
+}
+
+static inline void spin_unlock(Spinlock *lock) {
+    __atomic_store_n(&lock->locked, 0, __ATOMIC_RELEASE);
+}
+
+static inline uint32_t spin_lock_irqsave(Spinlock *lock) {
+    uint32_t flags = irq_save();
+
+    spin_lock(lock);
+    return flags;
+}
+
+static inline void spin_unlock_irqrestore(Spinlock *lock, uint32_t flags) {
+    spin_unlock(lock);
+    irq_restore(flags);
+}
+
+#endif
@@ -0,0 +1,13 @@
+#ifndef STRING_H
+#define STRING_H
+
+#include <stddef.h>
+
+/* GCC may emit calls to these even in freestanding builds */
+void *memcpy(void *dst, const void *src, size_t n);
+void *memmove(void *dst, const void *src, size_t n);
+void *memset(void *dst, int value, size_t n);
+int memcmp(const void *a, const void *b, size_t n);
+size_t strlen(const char *s);
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef TEXT_H
+#define TEXT_H
+
+#include <stdint.h>
+#include "framebuffer.h"
+
+struct BootInfo;
+
+typedef enum {
+    FONT_8X8 = 0,    /* Embedded font8x8_basic, ASCII 32-127 */
+    FONT_8X16 = 1    /* VGA BIOS font copied by the loader, all 256 codes */
+} FontId;
+
+/* Fixed-width 8-pixel fonts, pre-expanded to one mask per glyph row
+   with bit 7 as the leftmost pixel */
+typedef struct {
+    uint8_t width;
+    uint8_t height;
+    uint8_t masks[256][16];
+} Font;
+
+/* Expand both fonts and the mask-to-span table; call once after fb_init */
+void text_init(const struct BootInfo *info);
+const Font *text_font(FontId id);
+
+/* Draw a string clipped once against the surface; only set pixels are written */
+void text_draw(Framebuffer *fb, const Font *font, int x, int y, const char *text, uint32_t color);
+
+/* Pixel extent of a string (no line breaks) */
+int text_width(const Font *font, const char *text);
+void text_measure(const Font *font, const char *text, int *width, int *height);
+
+#endif
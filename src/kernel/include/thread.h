@@ -0,0 +1,88 @@
+#ifndef THREAD_H
+#define THREAD_H
+
+#include <stdint.h>
+#include "spinlock.h"
+
+#define THREAD_PRIORITIES   4       /* 0 lowest; the idle thread sits below all */
+#define THREAD_STACK_SIZE   32768   /* fat12_read keeps a cluster on the stack */
+#define THREAD_SLICE_MS     10      /* Round-robin quantum within a priority */
+
+#define THREAD_PRIO_LOW     0
+#define THREAD_PRIO_NORMAL  1
+#define THREAD_PRIO_HIGH    2
+
+typedef enum {
+    THREAD_READY,
+    THREAD_RUNNING,
+    THREAD_BLOCKED,     /* On a wait queue */
+    THREAD_SLEEPING,    /* Until wake_ms */
+    THREAD_DEAD
+} ThreadState;
+
+typedef void (*ThreadFn)(void *arg);
+
+typedef struct Thread Thread;
+
+struct Thread {
+    uint32_t esp;               /* Saved while switched out; thread_switch.S uses offset 0 */
+    uint32_t id;
+    const char *name;
+    ThreadState state;
+    int priority;
+    uint32_t wake_ms;
+    uint8_t *stack;
+    uint32_t cpu;               /* Last CPU it ran on; wakeups queue there */
+    ThreadFn entry;
+    void *arg;
+    Thread *next;               /* Run queue, wait queue, sleep or dead list */
+    uint8_t fpu[512] __attribute__((aligned(16)));  /* FXSAVE image */
+};
+
+/* Threads blocked on some condition, woken in FIFO order; the links are
+   protected by the scheduler lock */
+typedef struct {
+    Thread *head;
+    Thread *tail;
+} WaitQueue;
+
+/* Adopt the boot context as the first thread (THREAD_PRIO_NORMAL) and
+   create the BSP's idle thread; needs the heap. Preemption starts here. */
+void thread_init(void);
+int thread_active(void);
+
+/* Last step of AP bring-up: the boot stack becomes this CPU's idle thread
+   and the CPU starts taking work from the run queues */
+void thread_init_ap(void) __attribute__((noreturn));
+
+/* Ready to run at the next reschedule; NULL when out of memory */
+Thread *thread_create(const char *name, ThreadFn entry, void *arg, int priority);
+
+Thread *thread_current(void);
+void thread_yield(void);
+void thread_sleep(uint32_t ms);
+void thread_exit(void) __attribute__((noreturn));
+
+/* Scheduler hooks: each CPU's timer calls thread_tick every millisecond
+   (the PIT on the BSP, the APIC timer elsewhere), and interrupt_dispatch
+   calls thread_preempt after sending the EOI. Thread context may call
+   thread_preempt too, to act on a wakeup right away. */
+void thread_tick(uint32_t now);
+void thread_preempt(void);
+
+/* Keep the current thread on the CPU (interrupts still run), e.g. across a
+   PIO transfer the device will not wait for. Calls nest. */
+void thread_preempt_disable(void);
+void thread_preempt_enable(void);
+
+/* Sleep/wakeup. Test the condition holding the spinlock that guards it
+   (taken with spin_lock_irqsave) and call wait_queue_sleep in a loop until
+   it holds. The lock is dropped only once the thread is on the queue and
+   is held again on return, so a wakeup on another CPU or from an IRQ
+   handler cannot slip in between. The wake calls are IRQ-safe. */
+void wait_queue_init(WaitQueue *q);
+void wait_queue_sleep(WaitQueue *q, Spinlock *lock);
+void wait_queue_wake_one(WaitQueue *q);
+void wait_queue_wake_all(WaitQueue *q);
+
+#endif
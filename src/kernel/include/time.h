@@ -3,6 +3,26 @@
 
 #include <stdint.h>
 
+typedef struct {
+    uint16_t year;
+    uint8_t month;      /* 1-12 */
+    uint8_t day;        /* 1-31 */
+    uint8_t hours;      /* 0-23 */
+    uint8_t minutes;
+    uint8_t seconds;
+} WallTime;
+
+/* Read the CMOS RTC once and start the cached clock; needs the PIT running */
+void time_init(void);
+
+/* Cached wall clock, advanced by the system timer (no port I/O) */
+void time_get(WallTime *out);
 void time_get_hms(uint8_t *hours, uint8_t *minutes, uint8_t *seconds);
 
+/* Milliseconds until the cached clock's seconds next change */
+uint32_t time_ms_to_next_second(void);
+
+/* Read the RTC directly, waiting out any update in progress */
+int rtc_read(WallTime *out);
+
 #endif
@@ -0,0 +1,24 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <stdint.h>
+
+#define TIMER_HZ        1000    /* PIT channel 0 rate; one tick per millisecond */
+#define TIMER_SLOTS     8
+
+/* Program the PIT and hook IRQ0; call after interrupt_init */
+void timer_init(void);
+
+/* Milliseconds since timer_init (wraps after ~49 days) */
+uint32_t timer_ms(void);
+
+/* Post EVENT_TIMER with this id after delay_ms, then every period_ms
+   (0 for one-shot). Re-arming an id replaces it. Returns -1 if no slot. */
+int timer_arm(uint32_t id, uint32_t delay_ms, uint32_t period_ms);
+void timer_cancel(uint32_t id);
+
+/* Wait at least ms milliseconds; needs interrupts on. Once the scheduler
+   runs this blocks only the calling thread. */
+void timer_sleep(uint32_t ms);
+
+#endif
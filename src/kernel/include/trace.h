@@ -0,0 +1,79 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include "smp.h"
+
+#define TRACE_RECORDS   8192    /* Ring capacity, power of two */
+
+/* Record phases, matching Chrome trace-event "ph" values */
+#define TRACE_BEGIN     'B'
+#define TRACE_END       'E'
+#define TRACE_INSTANT   'i'
+#define TRACE_COUNTER   'C'
+
+/* Event ids; keep trace_event_names in trace.c in the same order */
+typedef enum {
+    TRACE_FDC_READ = 0,
+    TRACE_FDC_WRITE,
+    TRACE_FAT_READ,
+    TRACE_FRAME,
+    TRACE_UI_RENDER,
+    TRACE_FB_SWAP,
+    TRACE_EVENT_WAIT,
+    TRACE_MOUSE_PACKET,
+    TRACE_EVENT_DROP,
+    TRACE_THREAD_SWITCH,
+    TRACE_EVENT_COUNT
+} TraceEvent;
+
+typedef struct {
+    uint64_t tsc;
+    uint16_t id;
+    uint8_t phase;
+    uint8_t cpu;
+    uint32_t arg0;
+    uint32_t arg1;
+} __attribute__((packed)) TraceRecord;
+
+extern TraceRecord *trace_ring;
+extern volatile uint32_t trace_next;    /* Total records ever written */
+
+static inline uint64_t rdtsc(void) {
+    uint32_t lo, hi;
+
+    __asm__ volatile ("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+/* Tracepoint: one locked increment and a 20-byte store; a branch when off.
+   Any CPU may record; each record carries its CPU index. */
+static inline void trace(uint16_t id, uint8_t phase, uint32_t arg0, uint32_t arg1) {
+    TraceRecord *r;
+
+    if (!trace_ring) {
+        return;
+    }
+    r = &trace_ring[__atomic_fetch_add(&trace_next, 1, __ATOMIC_RELAXED) & (TRACE_RECORDS - 1)];
+    r->tsc = rdtsc();
+    r->id = id;
+    r->phase = phase;
+    r->cpu = (uint8_t)cpu_self()->id;
+    r->arg0 = arg0;
+    r->arg1 = arg1;
+}
+
+#define TRACE_SCOPE_BEGIN(id, a0, a1) trace((id), TRACE_BEGIN, (a0), (a1))
+#define TRACE_SCOPE_END(id, a0, a1) trace((id), TRACE_END, (a0), (a1))
+#define TRACE_MARK(id, a0, a1) trace((id), TRACE_INSTANT, (a0), (a1))
+
+/* Allocate the ring and calibrate the TSC against the PIT (needs the timer
+   running). Tracing stays a no-op until this succeeds. */
+int trace_init(void);
+void trace_set_enabled(int enabled);
+
+/* Write the ring as text lines on the debug sinks for scripts/trace_to_json.py;
+   blocks until the UART has sent everything */
+void trace_dump(void);
+
+#endif
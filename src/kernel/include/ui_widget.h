@@ -8,16 +8,18 @@
 typedef enum {
     WIDGET_BUTTON,
     WIDGET_LABEL,
-    WIDGET_PANEL
+    WIDGET_PANEL,
+    WIDGET_CONTAINER     /* Invisible grouping node */
 } WidgetType;
 
 typedef struct Widget Widget;
+typedef struct UIContext UIContext;
 
 typedef void (*WidgetCallback)(Widget *widget, void *user_data);
 
 struct Widget {
     WidgetType type;
-    int x, y;
+    int x, y;            /* Relative to the parent widget */
     int width, height;
     uint32_t bg_color;
     uint32_t fg_color;
@@ -25,35 +27,91 @@ struct Widget {
     const char *text;
     int visible;
     int hovered;
+    int dirty;           /* Appearance changed since the last ui_render */
+    int queued;          /* On its context's dirty list */
+    Widget *next;        /* Dirty list link, or free list link once released */
+    FbRect drawn;        /* Bounds covered at the last render (empty if hidden) */
     WidgetCallback on_click;
     void *user_data;
-    Widget *next;
+
+    /* Tree: children are kept bottom to top */
+    Widget *parent;
+    Widget **children;
+    int child_count;
+    int child_capacity;
+
+    /* Cached placement, valid while attached to a context */
+    UIContext *ctx;
+    int abs_x, abs_y;
+    int order;           /* Paint order across the whole tree */
+    int cell_x0, cell_y0, cell_x1, cell_y1;  /* Grid cells holding this widget */
+    int indexed;
 };
 
-typedef struct {
-    Widget *root;
+#define UI_MAX_WIDGETS 4096
+#define UI_MAX_DAMAGE 16
+#define UI_GRID_CELL 32         /* Hit-test bucket size in pixels */
+#define UI_GRID_NODES 16384     /* Widget-in-cell entries across the grid */
+#define UI_TILE 64              /* Render bin size in pixels */
+#define UI_TILE_ENTRIES 16384   /* Widget-in-tile bin entries per render */
+
+typedef struct UIGridNode UIGridNode;
+typedef struct UITile UITile;
+
+struct UIContext {
+    Widget *root;                   /* Full-screen container */
     int widget_count;
-} UIContext;
+    int width, height;
+    uint32_t bg_color;              /* Painted under widgets in damaged areas */
+    FbRect damage[UI_MAX_DAMAGE];   /* Screen regions to repaint on the next render */
+    int damage_count;
+    UIGridNode **grid;              /* grid_cols * grid_rows bucket lists */
+    int grid_cols, grid_rows;
+    int order_dirty;                /* Tree changed, paint order needs renumbering */
+    UITile *tiles;                  /* tile_cols * tile_rows render bins */
+    int *active_tiles;              /* Indices of the tiles with damage this render */
+    int tile_cols, tile_rows;
+    Widget *hovered;
+    Widget *dirty_list;             /* Widgets marked dirty since the last render */
+};
 
-/* UI Context management */
-void ui_context_init(UIContext *ctx);
+/* UI Context management; contexts draw widgets from one shared pool and
+   freeing a context returns only the widgets in its own tree */
+void ui_context_init(UIContext *ctx, int width, int height);
 void ui_context_free(UIContext *ctx);
 
 /* Widget creation */
 Widget* ui_create_button(const char *text, int x, int y, int width, int height);
 Widget* ui_create_label(const char *text, int x, int y, uint32_t color);
 Widget* ui_create_panel(int x, int y, int width, int height, uint32_t color);
+Widget* ui_create_container(int x, int y, int width, int height);
 
 /* Widget management */
 void ui_add_widget(UIContext *ctx, Widget *widget);
+void ui_add_child(Widget *parent, Widget *child);
 void ui_set_callback(Widget *widget, WidgetCallback callback, void *user_data);
 void ui_set_colors(Widget *widget, uint32_t bg, uint32_t fg, uint32_t hover);
+void ui_set_visible(Widget *widget, int visible);
+void ui_set_text(Widget *widget, const char *text);
+void ui_set_position(Widget *widget, int x, int y);
+void ui_set_background(UIContext *ctx, uint32_t color);
 
-/* Rendering */
+/* Damage tracking: setters mark widgets dirty; these add explicit regions */
+void ui_invalidate_widget(Widget *widget);
+void ui_invalidate(UIContext *ctx, int x, int y, int width, int height);
+
+/* Rendering: damage is split into UI_TILE squares and the widgets that
+   touch each one are binned to it, so every tile is painted on its own
+   from a short list while it stays in cache. Tiles run in parallel on the
+   worker threads when more than one CPU is online. Only damaged regions
+   are repainted. */
 void ui_render(UIContext *ctx, Framebuffer *fb);
 void ui_render_widget(Widget *widget, Framebuffer *fb);
 
-/* Event handling */
+/* Topmost visible widget at a screen point, from the grid index */
+Widget* ui_widget_at(UIContext *ctx, int x, int y);
+
+/* Event handling: returns 1 if a click was handled or any hover state changed */
 int ui_handle_mouse(UIContext *ctx, const MouseState *mouse, int clicked);
 
 #endif
@@ -0,0 +1,59 @@
+#ifndef WINDOW_H
+#define WINDOW_H
+
+#include <stdint.h>
+#include "framebuffer.h"
+
+#define WM_MAX_WINDOWS  16
+#define WM_MAX_CLIP     32      /* Disjoint rectangles per visible region */
+#define WM_MAX_DAMAGE   16
+
+/* A window owns an off-screen surface in the screen's pixel format. Draw
+   into it with the fb_* calls; its dirty list is what the compositor
+   copies out on the next wm_compose. */
+typedef struct {
+    int x, y;                   /* Screen position */
+    int width, height;
+    int visible;
+    Framebuffer surface;
+    FbRect clip[WM_MAX_CLIP];   /* Exposed part of the window, screen coordinates */
+    int clip_count;
+} Window;
+
+typedef struct {
+    Framebuffer *screen;
+    Window *windows[WM_MAX_WINDOWS];    /* Bottom to top */
+    int count;
+    uint32_t desktop_color;
+    const Framebuffer *wallpaper;       /* Centered on the desktop, or NULL */
+    FbRect desktop[WM_MAX_CLIP];        /* Screen not covered by any window */
+    int desktop_count;
+    FbRect damage[WM_MAX_DAMAGE];       /* Exposed by moves, restacking and hiding */
+    int damage_count;
+    int clips_dirty;                    /* Stacking changed, regions need recomputing */
+} WindowManager;
+
+void wm_init(WindowManager *wm, Framebuffer *screen, uint32_t desktop_color);
+
+/* Show an image (e.g. from image_get) centered behind every window */
+void wm_set_wallpaper(WindowManager *wm, const Framebuffer *image);
+
+/* New visible window on top of the stack; NULL when out of memory or slots */
+Window *wm_create_window(WindowManager *wm, int x, int y, int width, int height);
+
+void wm_move(WindowManager *wm, Window *win, int x, int y);
+void wm_raise(WindowManager *wm, Window *win);
+void wm_set_visible(WindowManager *wm, Window *win, int visible);
+
+/* Repaint a screen area from whatever covers it (e.g. after the screen was drawn over) */
+void wm_invalidate(WindowManager *wm, int x, int y, int width, int height);
+
+/* Topmost visible window containing a screen point */
+Window *wm_window_at(WindowManager *wm, int x, int y);
+
+/* Copy changed and exposed window areas into the screen, each clipped to
+   its visible region, and fill exposed desktop. Windows underneath a
+   change are never redrawn, only copied where they show. */
+void wm_compose(WindowManager *wm);
+
+#endif
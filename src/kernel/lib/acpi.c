@@ -0,0 +1,139 @@
+#include "acpi.h"
+#include "bios_tables.h"
+#include "string.h"
+#include "debug.h"
+#include <stddef.h>
+
+#define MADT_LOCAL_APIC     0
+#define MADT_APIC_ENABLED   0x01
+
+typedef struct {
+    char signature[8];          /* "RSD PTR " */
+    uint8_t checksum;           /* Over the first 20 bytes */
+    char oem_id[6];
+    uint8_t revision;           /* 0 for ACPI 1.0, 2 and up has the XSDT */
+    uint32_t rsdt_address;
+    uint32_t length;
+    uint32_t xsdt_address_low;
+    uint32_t xsdt_address_high;
+    uint8_t extended_checksum;
+    uint8_t reserved[3];
+} __attribute__((packed)) AcpiRsdp;
+
+typedef struct {
+    AcpiHeader header;
+    uint32_t lapic_address;
+    uint32_t flags;
+} __attribute__((packed)) AcpiMadt;
+
+typedef struct {
+    uint8_t type;
+    uint8_t length;
+    uint8_t processor_id;
+    uint8_t apic_id;
+    uint32_t flags;
+} __attribute__((packed)) MadtLocalApic;
+
+static const AcpiRsdp *rsdp = NULL;
+static int rsdp_searched = 0;
+
+/* The ACPI 1.0 checksum covers the first 20 bytes */
+static int rsdp_valid(const void *table) {
+    return bios_checksum(table, 20) == 0;
+}
+
+static const AcpiRsdp *find_rsdp(void) {
+    if (rsdp_searched) {
+        return rsdp;
+    }
+    rsdp_searched = 1;
+
+    rsdp = bios_tables_find("RSD PTR ", 8, rsdp_valid);
+    if (rsdp) {
+        INFO("ACPI revision %u RSDP at 0x%08x", rsdp->revision, (uint32_t)(uintptr_t)rsdp);
+    }
+    return rsdp;
+}
+
+static const AcpiHeader *valid_table(uint32_t addr, const char *signature) {
+    const AcpiHeader *h = (const AcpiHeader *)(uintptr_t)addr;
+
+    if (!addr || memcmp(h->signature, signature, 4) != 0) {
+        return NULL;
+    }
+    if (bios_checksum(h, h->length) != 0) {
+        WARN("ACPI table %s has a bad checksum", signature);
+        return NULL;
+    }
+    return h;
+}
+
+const AcpiHeader *acpi_find_table(const char *signature) {
+    const AcpiRsdp *r = find_rsdp();
+    const AcpiHeader *root;
+    uint32_t entries;
+
+    if (!r) {
+        return NULL;
+    }
+
+    /* Prefer the XSDT, but its 64-bit pointers are only usable below 4 GB */
+    if (r->revision >= 2 && r->xsdt_address_high == 0 &&
+        (root = valid_table(r->xsdt_address_low, "XSDT")) != NULL) {
+        const uint32_t *ptr = (const uint32_t *)(root + 1);
+
+        entries = (root->length - sizeof(AcpiHeader)) / 8;
+        for (uint32_t i = 0; i < entries; i++) {
+            const AcpiHeader *t;
+
+            if (ptr[i * 2 + 1] != 0) {
+                continue;
+            }
+            t = valid_table(ptr[i * 2], signature);
+            if (t) {
+                return t;
+            }
+        }
+        return NULL;
+    }
+
+    root = valid_table(r->rsdt_address, "RSDT");
+    if (!root) {
+        return NULL;
+    }
+    entries = (root->length - sizeof(AcpiHeader)) / 4;
+    for (uint32_t i = 0; i < entries; i++) {
+        const AcpiHeader *t = valid_table(((const uint32_t *)(root + 1))[i], signature);
+
+        if (t) {
+            return t;
+        }
+    }
+    return NULL;
+}
+
+int acpi_madt_cpus(uint8_t *apic_ids, int max) {
+    const AcpiMadt *madt = (const AcpiMadt *)acpi_find_table("APIC");
+    const uint8_t *p, *end;
+    int count = 0;
+
+    if (!madt) {
+        return 0;
+    }
+
+    p = (const uint8_t *)(madt + 1);
+    end = (const uint8_t *)madt + madt->header.length;
+    while (p + 2 <= end && p[1] >= 2 && p + p[1] <= end) {
+        if (p[0] == MADT_LOCAL_APIC && p[1] >= sizeof(MadtLocalApic)) {
+            const MadtLocalApic *lapic = (const MadtLocalApic *)p;
+
+            if ((lapic->flags & MADT_APIC_ENABLED) && count < max) {
+                apic_ids[count++] = lapic->apic_id;
+            }
+        }
+        p += p[1];
+    }
+
+    INFO("MADT lists %d processors", count);
+    return count;
+}
@@ -0,0 +1,186 @@
+#include "apic.h"
+#include "interrupt.h"
+#include "paging.h"
+#include "thread.h"
+#include "timer.h"
+#include "cpu.h"
+#include "debug.h"
+#include <stddef.h>
+
+#define MSR_APIC_BASE           0x1B
+#define APIC_BASE_ENABLE        (1u << 11)
+#define APIC_BASE_MASK          0xFFFFF000u
+
+/* Register offsets */
+#define LAPIC_ID                0x020
+#define LAPIC_TPR               0x080
+#define LAPIC_EOI               0x0B0
+#define LAPIC_SVR               0x0F0
+#define LAPIC_ESR               0x280
+#define LAPIC_ICR_LOW           0x300
+#define LAPIC_ICR_HIGH          0x310
+#define LAPIC_LVT_TIMER         0x320
+#define LAPIC_LVT_LINT0         0x350
+#define LAPIC_LVT_LINT1         0x360
+#define LAPIC_LVT_ERROR         0x370
+#define LAPIC_TIMER_INIT        0x380
+#define LAPIC_TIMER_CURRENT     0x390
+#define LAPIC_TIMER_DIVIDE      0x3E0
+
+#define SVR_ENABLE              (1u << 8)
+#define LVT_MASKED              (1u << 16)
+#define LVT_TIMER_PERIODIC      (1u << 17)
+#define LVT_DELIVERY_NMI        (4u << 8)
+#define LVT_DELIVERY_EXTINT     (7u << 8)
+#define TIMER_DIVIDE_16         0x3
+
+#define ICR_INIT                (5u << 8)
+#define ICR_STARTUP             (6u << 8)
+#define ICR_DELIVERY_PENDING    (1u << 12)
+#define ICR_LEVEL_ASSERT        (1u << 14)
+#define ICR_TRIGGER_LEVEL       (1u << 15)
+
+#define CALIBRATE_MS            10
+#define AP_START_TIMEOUT_MS     100
+
+static volatile uint32_t *lapic = NULL;
+static uint32_t timer_ticks_per_ms = 0;     /* At divide-by-16 */
+
+static inline uint32_t lapic_read(uint32_t reg) {
+    return lapic[reg / 4];
+}
+
+static inline void lapic_write(uint32_t reg, uint32_t value) {
+    lapic[reg / 4] = value;
+}
+
+/* The scheduler tick on APs; the BSP keeps the PIT for wall time */
+static void apic_timer_irq(InterruptFrame *frame) {
+    (void)frame;
+    thread_tick(timer_ms());
+}
+
+/* Nothing to do: thread_preempt runs after the EOI and picks up the work */
+static void apic_reschedule_irq(InterruptFrame *frame) {
+    (void)frame;
+}
+
+static void calibrate_timer(void) {
+    uint32_t start = timer_ms();
+    uint32_t elapsed;
+
+    lapic_write(LAPIC_TIMER_DIVIDE, TIMER_DIVIDE_16);
+    lapic_write(LAPIC_LVT_TIMER, LVT_MASKED | APIC_TIMER_VECTOR);
+
+    /* Start on a PIT edge so the window is whole ticks */
+    while (timer_ms() == start) {
+        __asm__ volatile ("hlt");
+    }
+    start = timer_ms();
+    lapic_write(LAPIC_TIMER_INIT, 0xFFFFFFFFu);
+    while (timer_ms() - start < CALIBRATE_MS) {
+        __asm__ volatile ("hlt");
+    }
+    elapsed = 0xFFFFFFFFu - lapic_read(LAPIC_TIMER_CURRENT);
+    lapic_write(LAPIC_TIMER_INIT, 0);
+
+    timer_ticks_per_ms = elapsed / CALIBRATE_MS;
+}
+
+int apic_init(void) {
+    uint64_t base;
+
+    if (!(cpu_features_edx() & CPUID_EDX_APIC) || !(cpu_features_edx() & CPUID_EDX_MSR)) {
+        return -1;
+    }
+
+    base = rdmsr(MSR_APIC_BASE);
+    wrmsr(MSR_APIC_BASE, base | APIC_BASE_ENABLE);
+    lapic = (volatile uint32_t *)(uintptr_t)((uint32_t)base & APIC_BASE_MASK);
+    paging_set_uncached((uint32_t)(uintptr_t)lapic, 4096);
+
+    /* Virtual wire mode: the 8259 keeps arriving through LINT0 */
+    lapic_write(LAPIC_TPR, 0);
+    lapic_write(LAPIC_LVT_LINT0, LVT_DELIVERY_EXTINT);
+    lapic_write(LAPIC_LVT_LINT1, LVT_DELIVERY_NMI);
+    lapic_write(LAPIC_LVT_ERROR, LVT_MASKED);
+    lapic_write(LAPIC_SVR, SVR_ENABLE | APIC_SPURIOUS_VECTOR);
+
+    local_irq_set_handler(APIC_TIMER_VECTOR, apic_timer_irq);
+    local_irq_set_handler(APIC_RESCHEDULE_VECTOR, apic_reschedule_irq);
+
+    calibrate_timer();
+    INFO("Local APIC %u at 0x%08x, timer %u kHz", apic_id(), (uint32_t)(uintptr_t)lapic,
+         timer_ticks_per_ms * 16);
+    return 0;
+}
+
+int apic_present(void) {
+    return lapic != NULL;
+}
+
+void apic_init_ap(void) {
+    uint64_t base = rdmsr(MSR_APIC_BASE);
+
+    wrmsr(MSR_APIC_BASE, base | APIC_BASE_ENABLE);
+    lapic_write(LAPIC_TPR, 0);
+    lapic_write(LAPIC_LVT_LINT0, LVT_MASKED);
+    lapic_write(LAPIC_LVT_LINT1, LVT_MASKED);
+    lapic_write(LAPIC_LVT_ERROR, LVT_MASKED);
+    lapic_write(LAPIC_SVR, SVR_ENABLE | APIC_SPURIOUS_VECTOR);
+
+    lapic_write(LAPIC_TIMER_DIVIDE, TIMER_DIVIDE_16);
+    lapic_write(LAPIC_LVT_TIMER, LVT_TIMER_PERIODIC | APIC_TIMER_VECTOR);
+    lapic_write(LAPIC_TIMER_INIT, timer_ticks_per_ms * 1000 / TIMER_HZ);
+}
+
+uint8_t apic_id(void) {
+    return (uint8_t)(lapic_read(LAPIC_ID) >> 24);
+}
+
+void apic_eoi(void) {
+    lapic_write(LAPIC_EOI, 0);
+}
+
+/* Interrupts off so an IPI sent from a handler cannot land between the
+   two ICR writes */
+static void icr_send(uint8_t dest, uint32_t command) {
+    uint32_t flags = irq_save();
+
+    lapic_write(LAPIC_ICR_HIGH, (uint32_t)dest << 24);
+    lapic_write(LAPIC_ICR_LOW, command);
+    while (lapic_read(LAPIC_ICR_LOW) & ICR_DELIVERY_PENDING) {
+        __asm__ volatile ("pause");
+    }
+    irq_restore(flags);
+}
+
+void apic_send_ipi(uint8_t dest, uint8_t vector) {
+    if (lapic) {
+        icr_send(dest, vector);
+    }
+}
+
+int apic_start_ap(uint8_t dest, uint8_t vector_page, volatile int *online) {
+    lapic_write(LAPIC_ESR, 0);
+
+    /* INIT assert then deassert; only the 82489DX needs the second one */
+    icr_send(dest, ICR_INIT | ICR_LEVEL_ASSERT | ICR_TRIGGER_LEVEL);
+    icr_send(dest, ICR_INIT | ICR_TRIGGER_LEVEL);
+    timer_sleep(10);
+
+    /* Two STARTUPs as the MP spec asks; a CPU already running ignores the second.
+       The spec's 200 us gap is below the PIT's resolution, so wait a tick. */
+    for (int i = 0; i < 2 && !*online; i++) {
+        icr_send(dest, ICR_STARTUP | vector_page);
+        timer_sleep(1);
+    }
+
+    for (uint32_t waited = 0; !*online; waited++) {
+        if (waited >= AP_START_TIMEOUT_MS) {
+            return -1;
+        }
+        timer_sleep(1);
+    }
+    return 0;
+}
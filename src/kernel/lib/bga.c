@@ -0,0 +1,160 @@
+#define LOG_CATEGORY FB
+
+#include "bga.h"
+#include "io.h"
+#include "paging.h"
+#include "debug.h"
+
+#define DISPI_INDEX         0x01CE
+#define DISPI_DATA          0x01CF
+
+#define DISPI_ID            0x0
+#define DISPI_XRES          0x1
+#define DISPI_YRES          0x2
+#define DISPI_BPP           0x3
+#define DISPI_ENABLE        0x4
+#define DISPI_VIRT_WIDTH    0x6
+#define DISPI_VIRT_HEIGHT   0x7
+#define DISPI_X_OFFSET      0x8
+#define DISPI_Y_OFFSET      0x9
+
+#define DISPI_ID0           0xB0C0
+#define DISPI_ID_VIRTUAL    0xB0C1  /* First version with virtual size and offsets */
+#define DISPI_ID_LATEST     0xB0C5
+
+#define DISPI_ENABLED       0x01
+#define DISPI_LFB_ENABLED   0x40
+#define DISPI_NOCLEARMEM    0x80
+
+/* Largest mode the Bochs and QEMU adapters accept */
+#define DISPI_MAX_XRES      2560
+#define DISPI_MAX_YRES      1600
+
+/* Mode registers, saved so a rejected mode can be undone */
+typedef struct {
+    uint16_t xres, yres, bpp, enable;
+    uint16_t virt_width, x_offset, y_offset;
+} DispiState;
+
+static uint16_t dispi_read(uint16_t index) {
+    outw(DISPI_INDEX, index);
+    return inw(DISPI_DATA);
+}
+
+static void dispi_write(uint16_t index, uint16_t value) {
+    outw(DISPI_INDEX, index);
+    outw(DISPI_DATA, value);
+}
+
+uint16_t bga_detect(void) {
+    uint16_t id = dispi_read(DISPI_ID);
+
+    if (id < DISPI_ID0 || id > DISPI_ID_LATEST) {
+        return 0;
+    }
+    return id;
+}
+
+static void dispi_save(DispiState *s) {
+    s->xres = dispi_read(DISPI_XRES);
+    s->yres = dispi_read(DISPI_YRES);
+    s->bpp = dispi_read(DISPI_BPP);
+    s->enable = dispi_read(DISPI_ENABLE);
+    s->virt_width = dispi_read(DISPI_VIRT_WIDTH);
+    s->x_offset = dispi_read(DISPI_X_OFFSET);
+    s->y_offset = dispi_read(DISPI_Y_OFFSET);
+}
+
+static void dispi_restore(const DispiState *s) {
+    dispi_write(DISPI_ENABLE, 0);
+    dispi_write(DISPI_XRES, s->xres);
+    dispi_write(DISPI_YRES, s->yres);
+    dispi_write(DISPI_BPP, s->bpp);
+    dispi_write(DISPI_ENABLE, s->enable | DISPI_NOCLEARMEM);
+    dispi_write(DISPI_VIRT_WIDTH, s->virt_width);
+    dispi_write(DISPI_X_OFFSET, s->x_offset);
+    dispi_write(DISPI_Y_OFFSET, s->y_offset);
+}
+
+static int mode_valid(uint16_t width, uint16_t height, uint8_t bpp) {
+    if (bpp != 8 && bpp != 15 && bpp != 16 && bpp != 24 && bpp != 32) {
+        return 0;
+    }
+    return width && height && (width % 8) == 0 &&
+           width <= DISPI_MAX_XRES && height <= DISPI_MAX_YRES;
+}
+
+/* Set a mode with at least min_lines scanlines of video memory behind it,
+   or leave the adapter exactly as it was */
+static int set_mode_lines(uint16_t width, uint16_t height, uint8_t bpp, uint32_t min_lines) {
+    DispiState saved;
+
+    if (!mode_valid(width, height, bpp)) {
+        WARN("DISPI cannot show %ux%ux%u", width, height, bpp);
+        return -1;
+    }
+    dispi_save(&saved);
+
+    dispi_write(DISPI_ENABLE, 0);
+    dispi_write(DISPI_XRES, width);
+    dispi_write(DISPI_YRES, height);
+    dispi_write(DISPI_BPP, bpp);
+    dispi_write(DISPI_ENABLE, DISPI_ENABLED | DISPI_LFB_ENABLED | DISPI_NOCLEARMEM);
+
+    /* Writing the virtual width makes the adapter recompute the virtual height */
+    dispi_write(DISPI_VIRT_WIDTH, width);
+    dispi_write(DISPI_X_OFFSET, 0);
+    dispi_write(DISPI_Y_OFFSET, 0);
+
+    if (dispi_read(DISPI_XRES) != width || dispi_read(DISPI_YRES) != height ||
+        dispi_read(DISPI_BPP) != bpp) {
+        WARN("DISPI rejected %ux%ux%u", width, height, bpp);
+        dispi_restore(&saved);
+        return -1;
+    }
+    if (dispi_read(DISPI_VIRT_HEIGHT) < min_lines) {
+        INFO("Not enough video memory for %u lines", min_lines);
+        dispi_restore(&saved);
+        return -1;
+    }
+    return 0;
+}
+
+int bga_set_mode(uint16_t width, uint16_t height, uint8_t bpp) {
+    return set_mode_lines(width, height, bpp, height);
+}
+
+uint16_t bga_virtual_height(void) {
+    return dispi_read(DISPI_VIRT_HEIGHT);
+}
+
+void bga_set_y_offset(uint16_t y) {
+    dispi_write(DISPI_Y_OFFSET, y);
+}
+
+int bga_enable_page_flip(Framebuffer *fb) {
+    uint16_t id = bga_detect();
+    uint32_t screen = (uint32_t)fb->pitch * fb->height;
+
+    if (id < DISPI_ID_VIRTUAL) {
+        return -1;
+    }
+    if (!fb->back_buffer) {
+        WARN("Page flipping needs a back buffer");
+        return -1;
+    }
+    /* DISPI scanlines have no padding; a padded VBE pitch is not ours to flip */
+    if (fb->pitch != (uint32_t)fb->width * fb->bytes_per_pixel) {
+        return -1;
+    }
+    /* Two pages must fit before anything is committed; on failure the
+       adapter keeps the mode fb already describes */
+    if (set_mode_lines(fb->width, fb->height, fb->bpp, (uint32_t)fb->height * 2) < 0) {
+        return -1;
+    }
+
+    paging_set_write_combining((uint32_t)(uintptr_t)fb->addr, screen * 2);
+    fb_enable_page_flip(fb, bga_set_y_offset);
+    INFO("BGA 0x%04x: flipping two %ux%u pages", id, fb->width, fb->height);
+    return 0;
+}
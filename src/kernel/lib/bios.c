@@ -1,59 +1,212 @@
 #include "bios.h"
+#include "interrupt.h"
+#include "string.h"
+#include "debug.h"
+#include "smp.h"
+
+#define RM_SEG_BASE     0x20000u    /* Linear base of the real-mode segment 0x2000 */
+#define SECTOR_SIZE     512
+#define VBE_INFO_SIZE   256
+#define VBE_OK          0x004F
+
+/* Request table in .rmdata, linked at its real-mode offset */
+extern BiosRegs bios_batch[];
+extern uint16_t bios_batch_count;
+extern void bios_thunk_run(void);
+
+/* Geometry of the last drive read through bios_read_sectors */
+static uint8_t geom_drive = 0xFF;
+static uint16_t geom_cylinders;
+static uint8_t geom_heads;
+static uint8_t geom_spt;
+
+static BiosRegs *batch_table(void) {
+    return (BiosRegs *)((uintptr_t)bios_batch + RM_SEG_BASE);
+}
+
+int bios_call_batch(BiosRegs *calls, int count) {
+    BiosRegs *table = batch_table();
+    uint32_t flags;
+
+    if (count <= 0 || count > BIOS_BATCH_MAX) {
+        return -1;
+    }
+
+    memcpy(table, calls, sizeof(BiosRegs) * count);
+    *(volatile uint16_t *)((uintptr_t)&bios_batch_count + RM_SEG_BASE) = (uint16_t)count;
+
+    /* The BIOS handlers may sti while waiting on hardware, so give the
+       IRQs their real-mode vectors back until we return */
+    flags = irq_save();
+    if (cpu_self()->id != 0) {
+        /* Real mode, the low-memory thunk and the PIC belong to the BSP */
+        irq_restore(flags);
+        WARN("BIOS call from CPU %u refused", cpu_self()->id);
+        return -1;
+    }
+    pic_set_vector_base(BIOS_IRQ_BASE, BIOS_IRQ_BASE_SLAVE);
+    bios_thunk_run();
+    pic_set_vector_base(IRQ_BASE, IRQ_BASE + 8);
+    irq_restore(flags);
+
+    memcpy(calls, table, sizeof(BiosRegs) * count);
+    return count;
+}
+
+int bios_call(BiosRegs *regs) {
+    return bios_call_batch(regs, 1);
+}
 
 void bios_putc(char c) {
-    __asm__ volatile (
-        "movb $0x0E, %%ah\n"
-        "movb %0, %%al\n"
-        "xor %%bh, %%bh\n"
-        "int $0x10\n"
-        :
-        : "r" (c)
-        : "ax", "bx"
-    );
+    BiosRegs r = { 0 };
+
+    r.vector = 0x10;
+    r.eax = 0x0E00 | (uint8_t)c;
+    bios_call(&r);
 }
 
 uint8_t bios_get_key(void) {
-    uint8_t al;
-
-    __asm__ volatile (
-        "xor %%ah, %%ah\n"
-        "int $0x16\n"
-        "movb %%al, %0\n"
-        : "=r" (al)
-        :
-        : "ax"
-    );
+    BiosRegs r = { 0 };
 
-    return al;
+    r.vector = 0x16;
+    bios_call(&r);
+    return (uint8_t)r.eax;
 }
 
 int bios_get_drive_params(uint8_t drive, uint16_t *cylinders, uint8_t *heads, uint8_t *spt) {
-    uint16_t cx = 0;
-    uint16_t dx = drive;
-    uint8_t carry;
-
-    __asm__ volatile (
-        "int $0x13\n"
-        "setc %0\n"
-        : "=q" (carry), "=c" (cx), "+d" (dx)
-        : "a" (0x0800)
-        : "bx"
-    );
-
-    if (carry) {
+    BiosRegs r = { 0 };
+
+    /* ES:DI = 0:0 guards against BIOSes that return a table pointer */
+    r.vector = 0x13;
+    r.eax = 0x0800;
+    r.edx = drive;
+    if (bios_call(&r) < 0 || (r.flags & BIOS_FLAG_CF)) {
         return 0;
     }
 
     {
-        uint8_t ch = (uint8_t)(cx >> 8);
-        uint8_t cl = (uint8_t)(cx & 0xFF);
-        uint8_t dh = (uint8_t)(dx >> 8);
+        uint8_t ch = (uint8_t)(r.ecx >> 8);
+        uint8_t cl = (uint8_t)(r.ecx & 0xFF);
+        uint8_t dh = (uint8_t)(r.edx >> 8);
 
         *spt = (uint8_t)(cl & 0x3F);
         *heads = (uint8_t)(dh + 1);
-        *cylinders = (uint16_t)((((uint16_t)(cl & 0xC0)) << 2) | ch);
+        *cylinders = (uint16_t)(((((uint16_t)(cl & 0xC0)) << 2) | ch) + 1);
     }
-    *cylinders = (uint16_t)(*cylinders + 1);
 
     return 1;
 }
+
+static int load_geometry(uint8_t drive) {
+    if (geom_drive == drive) {
+        return 0;
+    }
+    if (!bios_get_drive_params(drive, &geom_cylinders, &geom_heads, &geom_spt) ||
+        geom_spt == 0 || geom_heads == 0) {
+        WARN("No geometry for drive 0x%02x", drive);
+        return -1;
+    }
+    geom_drive = drive;
+    return 0;
+}
+
+int bios_read_sectors(uint8_t drive, uint32_t lba, uint32_t count, void *buffer) {
+    uint8_t *dst = buffer;
+    uint32_t done = 0;
+
+    if (load_geometry(drive) < 0) {
+        return 0;
+    }
+
+    while (done < count) {
+        BiosRegs calls[BIOS_BATCH_MAX];
+        uint8_t sectors[BIOS_BATCH_MAX];
+        uint32_t offset = 0;
+        uint32_t next = lba + done;
+        int n = 0;
+
+        /* One request per track run, packed back to back in the bounce buffer */
+        while (n < BIOS_BATCH_MAX && done + offset / SECTOR_SIZE < count &&
+               offset < BIOS_BOUNCE_SIZE) {
+            uint32_t sector = next % geom_spt;
+            uint32_t track = next / geom_spt;
+            uint32_t head = track % geom_heads;
+            uint32_t cylinder = track / geom_heads;
+            uint32_t run = geom_spt - sector;
+            uint32_t left = count - done - offset / SECTOR_SIZE;
+            uint32_t room = (BIOS_BOUNCE_SIZE - offset) / SECTOR_SIZE;
+
+            if (run > left) run = left;
+            if (run > room) run = room;
+
+            memset(&calls[n], 0, sizeof(calls[n]));
+            calls[n].vector = 0x13;
+            calls[n].eax = 0x0200 | run;
+            calls[n].ecx = ((cylinder & 0xFF) << 8) | ((cylinder >> 2) & 0xC0) | (sector + 1);
+            calls[n].edx = (head << 8) | drive;
+            calls[n].es = BIOS_BOUNCE_SEG;
+            calls[n].ebx = offset;
+            sectors[n] = (uint8_t)run;
+
+            offset += run * SECTOR_SIZE;
+            next += run;
+            n++;
+        }
+
+        bios_call_batch(calls, n);
+
+        /* Keep everything up to the first failed request */
+        offset = 0;
+        for (int i = 0; i < n; i++) {
+            if (calls[i].flags & BIOS_FLAG_CF) {
+                WARN("int 13h read failed at LBA %u, status 0x%02x",
+                     lba + done + offset / SECTOR_SIZE, (calls[i].eax >> 8) & 0xFF);
+                memcpy(dst + done * SECTOR_SIZE, bios_bounce_ptr(0), offset);
+                return (int)(done + offset / SECTOR_SIZE);
+            }
+            offset += sectors[i] * SECTOR_SIZE;
+        }
+        memcpy(dst + done * SECTOR_SIZE, bios_bounce_ptr(0), offset);
+        done += offset / SECTOR_SIZE;
+    }
+
+    return (int)done;
+}
+
+int bios_vbe_mode_info(const uint16_t *modes, int count, void *out) {
+    uint8_t *dst = out;
+    int accepted = 0;
+
+    for (int base = 0; base < count; base += BIOS_BATCH_MAX) {
+        BiosRegs calls[BIOS_BATCH_MAX];
+        int n = count - base;
+
+        if (n > BIOS_BATCH_MAX) {
+            n = BIOS_BATCH_MAX;
+        }
+
+        for (int i = 0; i < n; i++) {
+            memset(&calls[i], 0, sizeof(calls[i]));
+            calls[i].vector = 0x10;
+            calls[i].eax = 0x4F01;
+            calls[i].ecx = modes[base + i];
+            calls[i].es = BIOS_BOUNCE_SEG;
+            calls[i].edi = (uint32_t)i * VBE_INFO_SIZE;
+        }
+
+        bios_call_batch(calls, n);
+
+        for (int i = 0; i < n; i++) {
+            uint8_t *block = dst + (uint32_t)(base + i) * VBE_INFO_SIZE;
+
+            if ((calls[i].eax & 0xFFFF) == VBE_OK) {
+                memcpy(block, bios_bounce_ptr((uint32_t)i * VBE_INFO_SIZE), VBE_INFO_SIZE);
+                accepted++;
+            } else {
+                memset(block, 0, VBE_INFO_SIZE);
+            }
+        }
+    }
+
+    return accepted;
+}
@@ -0,0 +1,48 @@
+#include "bios_tables.h"
+#include "string.h"
+#include "io.h"
+#include <stddef.h>
+
+#define BDA_EBDA_SEGMENT    0x40E       /* Real-mode segment of the EBDA */
+#define BDA_BASE_MEM_KB     0x413
+#define BIOS_ROM_START      0xE0000u
+#define BIOS_ROM_END        0x100000u
+
+uint8_t bios_checksum(const void *data, uint32_t length) {
+    const uint8_t *p = data;
+    uint8_t sum = 0;
+
+    for (uint32_t i = 0; i < length; i++) {
+        sum += p[i];
+    }
+    return sum;
+}
+
+static const void *scan(uint32_t start, uint32_t end, const char *signature,
+                        uint32_t signature_length, BiosTableCheck check) {
+    for (uint32_t addr = start; addr + signature_length <= end; addr += 16) {
+        const void *p = (const void *)(uintptr_t)addr;
+
+        if (memcmp(p, signature, signature_length) == 0 && check(p)) {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+const void *bios_tables_find(const char *signature, uint32_t signature_length, BiosTableCheck check) {
+    uint32_t ebda = (uint32_t)phys_read16(BDA_EBDA_SEGMENT) << 4;
+    uint32_t base_kb = phys_read16(BDA_BASE_MEM_KB);
+    const void *found = NULL;
+
+    if (ebda >= 0x80000 && ebda < 0xA0000) {
+        found = scan(ebda, ebda + 1024, signature, signature_length, check);
+    }
+    if (!found && base_kb >= 512 && base_kb <= 640) {
+        found = scan((base_kb - 1) * 1024, base_kb * 1024, signature, signature_length, check);
+    }
+    if (!found) {
+        found = scan(BIOS_ROM_START, BIOS_ROM_END, signature, signature_length, check);
+    }
+    return found;
+}
@@ -0,0 +1,211 @@
+#define LOG_CATEGORY FB
+
+#include "blit.h"
+#include "cpu.h"
+#include "debug.h"
+
+typedef void (*BlitFillFn)(uint32_t *dst, uint32_t value, uint32_t count);
+typedef void (*BlitCopyFn)(uint32_t *dst, const uint32_t *src, uint32_t count);
+typedef void (*BlitBlendAlphaFn)(uint32_t *dst, const uint32_t *src, uint32_t count, uint32_t alpha);
+
+/* rep-string fallbacks work on every x86 */
+static void fill32_rep(uint32_t *dst, uint32_t value, uint32_t count) {
+    __asm__ volatile ("cld; rep stosl"
+                      : "+D"(dst), "+c"(count)
+                      : "a"(value)
+                      : "memory");
+}
+
+static void copy32_rep(uint32_t *dst, const uint32_t *src, uint32_t count) {
+    __asm__ volatile ("cld; rep movsl"
+                      : "+D"(dst), "+S"(src), "+c"(count)
+                      :
+                      : "memory");
+}
+
+/* Every byte lane of p times a / 255, rounded; two lanes per multiply */
+static inline uint32_t scale_lanes(uint32_t p, uint32_t a) {
+    uint32_t rb = ((p & 0x00FF00FF) * a) + 0x00800080;
+    uint32_t ag = (((p >> 8) & 0x00FF00FF) * a) + 0x00800080;
+
+    rb = ((rb + ((rb >> 8) & 0x00FF00FF)) >> 8) & 0x00FF00FF;
+    ag = (ag + ((ag >> 8) & 0x00FF00FF)) & 0xFF00FF00;
+    return rb | ag;
+}
+
+static inline uint32_t over(uint32_t s, uint32_t d) {
+    return s + scale_lanes(d, 255 - (s >> 24));
+}
+
+static void blend32_scalar(uint32_t *dst, const uint32_t *src, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        dst[i] = over(src[i], dst[i]);
+    }
+}
+
+static void blend32_alpha_scalar(uint32_t *dst, const uint32_t *src, uint32_t count, uint32_t alpha) {
+    for (uint32_t i = 0; i < count; i++) {
+        dst[i] = over(scale_lanes(src[i], alpha), dst[i]);
+    }
+}
+
+static void blend_fill32_scalar(uint32_t *dst, uint32_t argb, uint32_t count) {
+    uint32_t inv = 255 - (argb >> 24);
+
+    for (uint32_t i = 0; i < count; i++) {
+        dst[i] = argb + scale_lanes(dst[i], inv);
+    }
+}
+
+static BlitFillFn fill_cached = fill32_rep;
+static BlitFillFn fill_stream = fill32_rep;
+static BlitCopyFn copy_cached = copy32_rep;
+static BlitCopyFn copy_stream = copy32_rep;
+static BlitCopyFn blend = blend32_scalar;
+static BlitBlendAlphaFn blend_alpha = blend32_alpha_scalar;
+static BlitFillFn blend_fill = blend_fill32_scalar;
+
+void blit_init(void) {
+    if (cpu_has_sse2()) {
+        fill_cached = blit_fill32_sse2;
+        fill_stream = blit_fill32_sse2_nt;
+        copy_cached = blit_copy32_sse2;
+        copy_stream = blit_copy32_sse2_nt;
+        blend = blit_blend32_sse2;
+        blend_alpha = blit_blend32_alpha_sse2;
+        blend_fill = blit_blend_fill32_sse2;
+        INFO("Blit: SSE2 kernels");
+    } else {
+        fill_cached = fill32_rep;
+        fill_stream = fill32_rep;
+        copy_cached = copy32_rep;
+        copy_stream = copy32_rep;
+        blend = blend32_scalar;
+        blend_alpha = blend32_alpha_scalar;
+        blend_fill = blend_fill32_scalar;
+        INFO("Blit: rep string kernels");
+    }
+}
+
+void blit_fill32(uint32_t *dst, uint32_t value, uint32_t count) {
+    fill_cached(dst, value, count);
+}
+
+void blit_copy32(uint32_t *dst, const uint32_t *src, uint32_t count) {
+    copy_cached(dst, src, count);
+}
+
+void blit_fill32_stream(uint32_t *dst, uint32_t value, uint32_t count) {
+    fill_stream(dst, value, count);
+}
+
+void blit_copy32_stream(uint32_t *dst, const uint32_t *src, uint32_t count) {
+    copy_stream(dst, src, count);
+}
+
+void blit_blend32(uint32_t *dst, const uint32_t *src, uint32_t count) {
+    blend(dst, src, count);
+}
+
+void blit_blend32_alpha(uint32_t *dst, const uint32_t *src, uint32_t count, uint8_t alpha) {
+    if (alpha == 255) {
+        blend(dst, src, count);
+    } else if (alpha) {
+        blend_alpha(dst, src, count, alpha);
+    }
+}
+
+void blit_blend_fill32(uint32_t *dst, uint32_t argb, uint32_t count) {
+    if ((argb >> 24) == 255) {
+        fill_cached(dst, argb, count);
+    } else if (argb) {
+        blend_fill(dst, argb, count);
+    }
+}
+
+uint32_t blit_premultiply(uint32_t rgb, uint8_t alpha) {
+    return scale_lanes(rgb & 0xFFFFFF, alpha) | ((uint32_t)alpha << 24);
+}
+
+static void fill16(BlitFillFn fill, uint16_t *dst, uint16_t value, uint32_t count) {
+    if (count && ((uintptr_t)dst & 2)) {
+        *dst++ = value;
+        count--;
+    }
+    if (count >= 2) {
+        fill((uint32_t *)dst, ((uint32_t)value << 16) | value, count / 2);
+        dst += count & ~1u;
+    }
+    if (count & 1) {
+        *dst = value;
+    }
+}
+
+void blit_fill16(uint16_t *dst, uint16_t value, uint32_t count) {
+    fill16(fill_cached, dst, value, count);
+}
+
+void blit_fill16_stream(uint16_t *dst, uint16_t value, uint32_t count) {
+    fill16(fill_stream, dst, value, count);
+}
+
+/* Four packed pixels are exactly three words, so the bulk stores whole words */
+void blit_fill24(uint8_t *dst, uint32_t value, uint32_t count) {
+    uint8_t b0 = (uint8_t)value;
+    uint8_t b1 = (uint8_t)(value >> 8);
+    uint8_t b2 = (uint8_t)(value >> 16);
+
+    while (count && ((uintptr_t)dst & 3)) {
+        dst[0] = b0;
+        dst[1] = b1;
+        dst[2] = b2;
+        dst += 3;
+        count--;
+    }
+
+    {
+        uint32_t p = value & 0xFFFFFF;
+        uint32_t w0 = p | (p << 24);
+        uint32_t w1 = (p >> 8) | (p << 16);
+        uint32_t w2 = (p >> 16) | (p << 8);
+        uint32_t *d = (uint32_t *)dst;
+
+        for (; count >= 4; count -= 4) {
+            d[0] = w0;
+            d[1] = w1;
+            d[2] = w2;
+            d += 3;
+        }
+        dst = (uint8_t *)d;
+    }
+
+    while (count--) {
+        dst[0] = b0;
+        dst[1] = b1;
+        dst[2] = b2;
+        dst += 3;
+    }
+}
+
+static void copy_bytes(BlitCopyFn copy, uint8_t *dst, const uint8_t *src, uint32_t bytes) {
+    while (bytes && ((uintptr_t)dst & 3)) {
+        *dst++ = *src++;
+        bytes--;
+    }
+    if (bytes >= 4) {
+        copy((uint32_t *)dst, (const uint32_t *)src, bytes / 4);
+        dst += bytes & ~3u;
+        src += bytes & ~3u;
+    }
+    for (bytes &= 3; bytes; bytes--) {
+        *dst++ = *src++;
+    }
+}
+
+void blit_copy_bytes(void *dst, const void *src, uint32_t bytes) {
+    copy_bytes(copy_cached, dst, src, bytes);
+}
+
+void blit_copy_bytes_stream(void *dst, const void *src, uint32_t bytes) {
+    copy_bytes(copy_stream, dst, src, bytes);
+}
@@ -0,0 +1,51 @@
+#include "cpu.h"
+#include "debug.h"
+
+static uint32_t features_edx = 0;
+static uint32_t features_ecx = 0;
+static int sse2_enabled = 0;
+
+void cpu_init(void) {
+    uint32_t eax, ebx, ecx, edx;
+
+    cpuid(0, &eax, &ebx, &ecx, &edx);
+    if (eax < 1) {
+        return;
+    }
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+    features_edx = edx;
+    features_ecx = ecx;
+}
+
+uint32_t cpu_features_edx(void) {
+    return features_edx;
+}
+
+uint32_t cpu_features_ecx(void) {
+    return features_ecx;
+}
+
+int cpu_enable_sse(void) {
+    uint32_t cr0;
+
+    if (!(features_edx & CPUID_EDX_FXSR) || !(features_edx & CPUID_EDX_SSE2)) {
+        WARN("CPU lacks SSE2, using scalar paths");
+        return 0;
+    }
+
+    cr0 = read_cr0();
+    cr0 &= ~(CR0_EM | CR0_TS);
+    cr0 |= CR0_MP | CR0_NE;
+    write_cr0(cr0);
+    __asm__ volatile ("fninit");
+
+    write_cr4(read_cr4() | CR4_OSFXSR | CR4_OSXMMEXCPT);
+    sse2_enabled = 1;
+
+    INFO("SSE2 enabled");
+    return 1;
+}
+
+int cpu_has_sse2(void) {
+    return sse2_enabled;
+}
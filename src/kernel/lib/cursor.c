@@ -0,0 +1,156 @@
+#define LOG_CATEGORY FB
+
+#include "cursor.h"
+#include "blit.h"
+#include "string.h"
+#include "debug.h"
+#include <stddef.h>
+
+#define SHADOW_OFFSET   1
+#define SHADOW_ALPHA    0x60
+
+static const char *const arrow_rows[] = {
+    "X...........",
+    "XX..........",
+    "XoX.........",
+    "XooX........",
+    "XoooX.......",
+    "XooooX......",
+    "XoooooX.....",
+    "XooooooX....",
+    "XoooooooX...",
+    "XooooooooX..",
+    "XoooooooooX.",
+    "XooooooXXXXX",
+    "XoooXooX....",
+    "XooXXooX....",
+    "XoX..XooX...",
+    "XX...XooX...",
+    "X.....XooX..",
+    "......XooX..",
+    ".......XX...",
+};
+
+static const CursorSprite default_arrow = {
+    12, 19, 0, 0, arrow_rows, 0x000000, 0xFFFFFF
+};
+
+/* Expanded sprite: premultiplied ARGB with a drop shadow down and right */
+static int sprite_w = 0;
+static int sprite_h = 0;
+static int sprite_hot_x = 0;
+static int sprite_hot_y = 0;
+static uint32_t sprite_argb[CURSOR_MAX_W * CURSOR_MAX_H];
+
+/* Save-under of the clipped sprite box, in the surface's pixel format */
+static uint32_t saved_pixels[CURSOR_MAX_W * CURSOR_MAX_H];
+static int saved_x, saved_y, saved_w, saved_h;
+static int visible = 0;
+
+void cursor_init(const CursorSprite *sprite) {
+    if (!sprite) {
+        sprite = &default_arrow;
+    }
+
+    int art_w = sprite->width > CURSOR_MAX_W ? CURSOR_MAX_W : sprite->width;
+    int art_h = sprite->height > CURSOR_MAX_H ? CURSOR_MAX_H : sprite->height;
+
+    sprite_w = art_w + SHADOW_OFFSET > CURSOR_MAX_W ? CURSOR_MAX_W : art_w + SHADOW_OFFSET;
+    sprite_h = art_h + SHADOW_OFFSET > CURSOR_MAX_H ? CURSOR_MAX_H : art_h + SHADOW_OFFSET;
+    sprite_hot_x = sprite->hot_x;
+    sprite_hot_y = sprite->hot_y;
+    memset(sprite_argb, 0, sizeof(sprite_argb));
+
+    /* Shadow first, then the art on top of it */
+    for (int pass = 0; pass < 2; pass++) {
+        int off = pass ? 0 : SHADOW_OFFSET;
+
+        for (int y = 0; y < art_h && y + off < sprite_h; y++) {
+            const char *row = sprite->rows[y];
+            int end = 0;
+
+            for (int x = 0; x < art_w && x + off < sprite_w; x++) {
+                char c = end ? '.' : row[x];
+                uint32_t *p = &sprite_argb[((y + off) * CURSOR_MAX_W) + x + off];
+
+                if (c == '\0') {
+                    end = 1;
+                    c = '.';
+                }
+                if (c == '.') {
+                    continue;
+                }
+                if (!pass) {
+                    *p = blit_premultiply(0x000000, SHADOW_ALPHA);
+                } else {
+                    *p = 0xFF000000 | ((c == 'o') ? sprite->fill_color : sprite->outline_color);
+                }
+            }
+        }
+    }
+
+    visible = 0;
+}
+
+void cursor_show(Framebuffer *fb, int x, int y) {
+    int x0, y0, x1, y1;
+
+    if (!fb || visible || sprite_w == 0) {
+        return;
+    }
+
+    x -= sprite_hot_x;
+    y -= sprite_hot_y;
+    x0 = x < 0 ? 0 : x;
+    y0 = y < 0 ? 0 : y;
+    x1 = (x + sprite_w) > fb->width ? fb->width : (x + sprite_w);
+    y1 = (y + sprite_h) > fb->height ? fb->height : (y + sprite_h);
+    if (x0 >= x1 || y0 >= y1) {
+        return;
+    }
+
+    saved_x = x0;
+    saved_y = y0;
+    saved_w = x1 - x0;
+    saved_h = y1 - y0;
+
+    for (int py = y0; py < y1; py++) {
+        const uint8_t *p = fb_target_row(fb, py) + ((uint32_t)x0 * fb->bytes_per_pixel);
+        uint32_t *save = &saved_pixels[(py - y0) * CURSOR_MAX_W];
+
+        for (int px = x0; px < x1; px++, p += fb->bytes_per_pixel) {
+            save[px - x0] = fb_read_pixel(fb, p);
+        }
+    }
+
+    /* Clips to the screen and marks the box dirty itself */
+    fb_blend_image(fb, x, y, sprite_w, sprite_h, sprite_argb, CURSOR_MAX_W, 255);
+    visible = 1;
+}
+
+void cursor_hide(Framebuffer *fb) {
+    if (!fb || !visible) {
+        return;
+    }
+
+    for (int py = 0; py < saved_h; py++) {
+        uint8_t *p = fb_target_row(fb, saved_y + py) + ((uint32_t)saved_x * fb->bytes_per_pixel);
+        const uint32_t *save = &saved_pixels[py * CURSOR_MAX_W];
+
+        for (int px = 0; px < saved_w; px++, p += fb->bytes_per_pixel) {
+            fb_write_pixel(fb, p, save[px]);
+        }
+    }
+
+    visible = 0;
+    fb_mark_dirty(fb, saved_x, saved_y, saved_w, saved_h);
+}
+
+void cursor_move(Framebuffer *fb, int x, int y) {
+    cursor_hide(fb);
+    cursor_show(fb, x, y);
+}
+
+int cursor_is_visible(void) {
+    return visible;
+}
@@ -1,96 +1,317 @@
 #include "debug.h"
+#include "format.h"
+#include "interrupt.h"
+#include "io.h"
+#include "trace.h"
+#include "event.h"
+#include "spinlock.h"
 
 #define COM1_PORT 0x3F8
+#define DEBUGCON_PORT 0xE9      /* QEMU -debugcon / Bochs port_e9_hack */
 
-static LogLevel current_log_level = LOG_INFO;
+#define UART_DATA       0
+#define UART_IER        1
+#define UART_IIR        2
+#define UART_FCR        2
+#define UART_LCR        3
+#define UART_MCR        4
+#define UART_LSR        5
 
-static inline void outb(uint16_t port, uint8_t value) {
-    __asm__ volatile ("outb %0, %1" : : "a"(value), "Nd"(port));
+#define UART_IER_RX     0x01
+#define UART_IER_THRE   0x02
+#define UART_IIR_NONE   0x01
+#define UART_IIR_ID     0x0E
+#define UART_IIR_THRE   0x02
+#define UART_IIR_RX     0x04
+#define UART_IIR_LINE   0x06
+#define UART_IIR_TIMEOUT 0x0C
+#define UART_LSR_DR     0x01
+#define UART_LSR_THRE   0x20
+#define UART_MSR        6
+#define UART_FIFO_DEPTH 16
+#define UART_BAUD_BASE  115200
+
+#define LOG_LINE_MAX    160
+
+LogLevel debug_runtime_level = LOG_INFO;
+unsigned debug_category_mask = LOG_CAT_ALL;
+static unsigned sinks = 0;
+static int serial_present = 0;
+static int serial_async = 0;    /* THRE interrupt drains the ring */
+static int tx_busy = 0;         /* A THRE interrupt is outstanding */
+static Spinlock tx_lock = SPINLOCK_INIT;    /* Ring and UART, from any CPU */
+
+/* TX ring: producers never wait, bytes that do not fit are counted and dropped */
+static char tx_ring[DEBUG_TX_RING_SIZE];
+static uint32_t tx_head = 0;    /* Next byte to send */
+static uint32_t tx_tail = 0;    /* Next free slot */
+static uint32_t tx_dropped = 0;
+
+/* Fill the UART FIFO from the ring; caller holds interrupts off */
+static void serial_fill_fifo(void) {
+    int n = 0;
+
+    while (n < UART_FIFO_DEPTH && tx_head != tx_tail) {
+        outb(COM1_PORT + UART_DATA, (uint8_t)tx_ring[tx_head & (DEBUG_TX_RING_SIZE - 1)]);
+        tx_head++;
+        n++;
+    }
+    tx_busy = n > 0;
+}
+
+static void serial_receive(void) {
+    while (inb(COM1_PORT + UART_LSR) & UART_LSR_DR) {
+        Event ev = { .type = EVENT_SERIAL };
+
+        ev.serial.ch = inb(COM1_PORT + UART_DATA);
+        event_post(&ev);
+    }
 }
 
-static inline uint8_t inb(uint16_t port) {
-    uint8_t value;
-    __asm__ volatile ("inb %1, %0" : "=a"(value) : "Nd"(port));
-    return value;
+/* Service every pending UART source; reading IIR acknowledges THRE */
+static void serial_irq(InterruptFrame *frame) {
+    (void)frame;
+    for (;;) {
+        uint8_t iir = inb(COM1_PORT + UART_IIR);
+
+        if (iir & UART_IIR_NONE) {
+            break;
+        }
+        switch (iir & UART_IIR_ID) {
+            case UART_IIR_THRE:
+                spin_lock(&tx_lock);
+                serial_fill_fifo();
+                spin_unlock(&tx_lock);
+                break;
+            case UART_IIR_RX:
+            case UART_IIR_TIMEOUT:
+                serial_receive();
+                break;
+            case UART_IIR_LINE:
+                inb(COM1_PORT + UART_LSR);
+                break;
+            default:
+                inb(COM1_PORT + UART_MSR);
+                break;
+        }
+    }
+}
+
+/* Polled drain, used before interrupts exist and when flushing on a crash */
+static void serial_drain_polled(void) {
+    while (tx_head != tx_tail) {
+        while (!(inb(COM1_PORT + UART_LSR) & UART_LSR_THRE));
+        serial_fill_fifo();
+    }
+    while (!(inb(COM1_PORT + UART_LSR) & UART_LSR_THRE));
+    tx_busy = 0;
+}
+
+static void sink_write(const char *s, int len) {
+    uint32_t flags = spin_lock_irqsave(&tx_lock);
+
+    if (sinks & DEBUG_SINK_E9) {
+        for (int i = 0; i < len; i++) {
+            outb(DEBUGCON_PORT, (uint8_t)s[i]);
+        }
+    }
+
+    if ((sinks & DEBUG_SINK_SERIAL) && serial_present) {
+        for (int i = 0; i < len; i++) {
+            if (tx_tail - tx_head >= DEBUG_TX_RING_SIZE) {
+                tx_dropped += (uint32_t)(len - i);
+                break;
+            }
+            tx_ring[tx_tail & (DEBUG_TX_RING_SIZE - 1)] = s[i];
+            tx_tail++;
+        }
+
+        if (!serial_async) {
+            serial_drain_polled();
+        } else if (!tx_busy && (inb(COM1_PORT + UART_LSR) & UART_LSR_THRE)) {
+            /* Idle transmitter: prime the FIFO, the THRE interrupt does the rest */
+            serial_fill_fifo();
+        }
+    }
+
+    spin_unlock_irqrestore(&tx_lock, flags);
 }
 
 void debug_init(void) {
-    /* Initialize COM1: 9600 baud, 8N1 */
-    outb(COM1_PORT + 1, 0x00);    /* Disable interrupts */
-    outb(COM1_PORT + 3, 0x80);    /* Enable DLAB */
-    outb(COM1_PORT + 0, 0x0C);    /* Divisor low byte (9600 baud) */
-    outb(COM1_PORT + 1, 0x00);    /* Divisor high byte */
-    outb(COM1_PORT + 3, 0x03);    /* 8 bits, no parity, one stop bit */
-    outb(COM1_PORT + 2, 0xC7);    /* Enable FIFO */
-    outb(COM1_PORT + 4, 0x0B);    /* Enable interrupts, RTS/DSR set */
-    
+    uint16_t divisor = (uint16_t)(UART_BAUD_BASE / DEBUG_SERIAL_BAUD);
+
+    /* Initialize COM1: 115200 baud, 8N1, polled until debug_start_async */
+    outb(COM1_PORT + UART_IER, 0x00);               /* Disable interrupts */
+    outb(COM1_PORT + UART_LCR, 0x80);               /* Enable DLAB */
+    outb(COM1_PORT + UART_DATA, (uint8_t)(divisor & 0xFF));
+    outb(COM1_PORT + UART_IER, (uint8_t)(divisor >> 8));
+    outb(COM1_PORT + UART_LCR, 0x03);               /* 8 bits, no parity, one stop bit */
+    outb(COM1_PORT + UART_FCR, 0xC7);               /* Enable and clear FIFOs */
+    outb(COM1_PORT + UART_MCR, 0x0B);               /* OUT2 (IRQ line), RTS, DTR */
+
+    /* A missing UART floats the bus to 0xFF */
+    serial_present = inb(COM1_PORT + UART_LSR) != 0xFF;
+    sinks = DEBUG_SINK_SERIAL;
+
+    /* Emulators answer 0xE9 on reads when the debug console is attached */
+    if (inb(DEBUGCON_PORT) == DEBUGCON_PORT) {
+        sinks |= DEBUG_SINK_E9;
+    }
+
     debug_puts("Debug initialized\r\n");
 }
 
+void debug_start_async(void) {
+    uint32_t flags;
+
+    if (!serial_present) {
+        return;
+    }
+
+    irq_set_handler(IRQ_COM1, serial_irq);
+    flags = spin_lock_irqsave(&tx_lock);
+    serial_async = 1;
+    tx_busy = 0;
+    outb(COM1_PORT + UART_IER, UART_IER_THRE | UART_IER_RX);
+    irq_unmask(IRQ_COM1);
+    if (inb(COM1_PORT + UART_LSR) & UART_LSR_THRE) {
+        serial_fill_fifo();
+    }
+    spin_unlock_irqrestore(&tx_lock, flags);
+}
+
+void debug_set_sinks(unsigned mask) {
+    sinks = mask;
+}
+
+unsigned debug_get_sinks(void) {
+    return sinks;
+}
+
+void debug_flush(void) {
+    uint32_t flags = spin_lock_irqsave(&tx_lock);
+
+    if (serial_present) {
+        serial_drain_polled();
+    }
+    spin_unlock_irqrestore(&tx_lock, flags);
+}
+
+uint32_t debug_dropped(void) {
+    return tx_dropped;
+}
+
 void debug_set_level(LogLevel level) {
-    current_log_level = level;
+    debug_runtime_level = level;
 }
 
-static int is_transmit_empty(void) {
-    return inb(COM1_PORT + 5) & 0x20;
+void debug_set_category_mask(unsigned mask) {
+    debug_category_mask = mask & LOG_CAT_ALL;
+}
+
+unsigned debug_get_category_mask(void) {
+    return debug_category_mask;
 }
 
 void debug_putc(char c) {
-    while (!is_transmit_empty());
-    outb(COM1_PORT, (uint8_t)c);
+    sink_write(&c, 1);
 }
 
 void debug_puts(const char *str) {
+    int len = 0;
+
     if (!str) return;
-    
-    /* Use simple pointer access without adjustment for debugging */
-    const char *s = str;
-    
-    /* Try to detect if we need pointer adjustment */
-    uintptr_t ptr = (uintptr_t)str;
-    if (ptr < 0x10000) {
-        s = (const char *)(ptr + 0x20000);
-    }
-    
-    for (int i = 0; i < 256 && s[i] != '\0'; i++) {
-        debug_putc(s[i]);
+
+    while (len < 256 && str[len] != '\0') {
+        len++;
     }
+    sink_write(str, len);
 }
 
 void debug_puthex(uint32_t value) {
-    const char hex[] = "0123456789ABCDEF";
-    debug_puts("0x");
-    for (int i = 28; i >= 0; i -= 4) {
-        debug_putc(hex[(value >> i) & 0xF]);
+    char buf[11];
+
+    ksnprintf(buf, sizeof(buf), "0x%08X", value);
+    debug_puts(buf);
+}
+
+void debug_vprintf(const char *fmt, va_list args) {
+    char line[LOG_LINE_MAX];
+    int len = kvsnprintf(line, sizeof(line), fmt, args);
+
+    if (len >= (int)sizeof(line)) {
+        len = sizeof(line) - 1;
     }
+    sink_write(line, len);
+}
+
+void kprintf(const char *fmt, ...) {
+    va_list args;
+
+    va_start(args, fmt);
+    debug_vprintf(fmt, args);
+    va_end(args);
 }
 
 void debug_log(const char *msg) {
-    debug_puts("[DEBUG] ");
-    debug_puts(msg);
-    debug_puts("\r\n");
+    kprintf("[DEBUG] %s\r\n", msg);
 }
 
-void debug_log_level(LogLevel level, const char *msg) {
-    if (level < current_log_level) {
+void panic(const char *fmt, ...) {
+    va_list args;
+
+    interrupts_disable();
+    kprintf("[PANIC] ");
+    va_start(args, fmt);
+    debug_vprintf(fmt, args);
+    va_end(args);
+    kprintf("\r\n");
+    debug_flush();
+
+    trace_dump();
+
+    for (;;) {
+        __asm__ volatile ("cli; hlt");
+    }
+}
+
+static void debug_vlog(LogCategory cat, LogLevel level, const char *fmt, va_list args) {
+    static const char *const prefixes[] = { "[DEBUG] ", "[INFO]  ", "[WARN]  ", "[ERROR] " };
+    static const char *const categories[LOG_CAT_COUNT] = { "", "fdc: ", "fat: ", "fb: ", "ui: ", "mouse: " };
+    char line[LOG_LINE_MAX];
+    int len;
+
+    if (level < debug_runtime_level || !(debug_category_mask & (1u << cat))) {
         return;
     }
-    
-    switch (level) {
-        case LOG_DEBUG:
-            debug_puts("[DEBUG] ");
-            break;
-        case LOG_INFO:
-            debug_puts("[INFO]  ");
-            break;
-        case LOG_WARN:
-            debug_puts("[WARN]  ");
-            break;
-        case LOG_ERROR:
-            debug_puts("[ERROR] ");
-            break;
+
+    /* Build the whole line first so lines from IRQ context never interleave */
+    len = ksnprintf(line, sizeof(line), "%s%s", prefixes[level], categories[cat]);
+    len += kvsnprintf(line + len, sizeof(line) - len, fmt, args);
+    if (len > (int)sizeof(line) - 3) {
+        len = sizeof(line) - 3;
+    }
+    line[len++] = '\r';
+    line[len++] = '\n';
+
+    sink_write(line, len);
+}
+
+void debug_log_level(LogLevel level, const char *fmt, ...) {
+    va_list args;
+
+    va_start(args, fmt);
+    debug_vlog(LOG_CAT_CORE, level, fmt, args);
+    va_end(args);
+}
+
+void debug_log_cat(LogCategory cat, LogLevel level, const char *fmt, ...) {
+    va_list args;
+
+    if (cat >= LOG_CAT_COUNT) {
+        cat = LOG_CAT_CORE;
     }
-    
-    debug_puts(msg);
-    debug_puts("\r\n");
+    va_start(args, fmt);
+    debug_vlog(cat, level, fmt, args);
+    va_end(args);
 }
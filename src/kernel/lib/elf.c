@@ -0,0 +1,281 @@
+#include "elf.h"
+#include "fat12.h"
+#include "paging.h"
+#include "heap.h"
+#include "mutex.h"
+#include "thread.h"
+#include "string.h"
+#include "debug.h"
+#include <stddef.h>
+
+#define ELF_MAGIC       0x464C457Fu     /* "\x7FELF" read little-endian */
+#define ELF_CLASS_32    1
+#define ELF_DATA_LSB    1
+#define ELF_TYPE_EXEC   2
+#define ELF_MACHINE_386 3
+#define ELF_PT_LOAD     1
+#define ELF_PF_W        0x2
+
+typedef struct {
+    uint32_t magic;
+    uint8_t class;
+    uint8_t data;
+    uint8_t ident_version;
+    uint8_t ident_pad[9];
+    uint16_t type;
+    uint16_t machine;
+    uint32_t version;
+    uint32_t entry;
+    uint32_t phoff;
+    uint32_t shoff;
+    uint32_t flags;
+    uint16_t ehsize;
+    uint16_t phentsize;
+    uint16_t phnum;
+    uint16_t shentsize;
+    uint16_t shnum;
+    uint16_t shstrndx;
+} __attribute__((packed)) ElfHeader;
+
+typedef struct {
+    uint32_t type;
+    uint32_t offset;
+    uint32_t vaddr;
+    uint32_t paddr;
+    uint32_t filesz;
+    uint32_t memsz;
+    uint32_t flags;
+    uint32_t align;
+} __attribute__((packed)) ElfProgramHeader;
+
+typedef struct {
+    uint32_t vaddr;
+    uint32_t memsz;
+    uint32_t offset;        /* File bytes [offset, offset + filesz) back the start */
+    uint32_t filesz;
+    int writable;
+} Segment;
+
+/* The loaded program. program_lock serializes faults with loading and
+   unloading, and keeps two CPUs from filling the same page. */
+static Mutex program_lock;
+static int window_ready = 0;
+static int program_loaded = 0;
+static FileHandle program_file;
+static uint32_t program_entry;
+static Segment segments[ELF_MAX_SEGMENTS];
+static int segment_count = 0;
+static uint32_t pages_read = 0;     /* Filled from the file */
+static uint32_t pages_zeroed = 0;   /* BSS only, no I/O */
+
+static int read_at(uint32_t offset, void *buffer, uint32_t size) {
+    if (fat12_seek(&program_file, offset) < 0 ||
+        fat12_read(&program_file, buffer, size) != (int)size) {
+        return -1;
+    }
+    return 0;
+}
+
+static int overlaps(const Segment *s, uint32_t page) {
+    return page < s->vaddr + s->memsz && page + PAGE_SIZE > s->vaddr;
+}
+
+/* Build the page at virtual address page in frame: zeroes, then whatever
+   file bytes each segment has there. Segments may share a page. */
+static int fill_page(uint32_t page, uint8_t *frame, int *from_file, int *writable) {
+    memset(frame, 0, PAGE_SIZE);
+    *from_file = 0;
+    *writable = 0;
+
+    for (int i = 0; i < segment_count; i++) {
+        const Segment *s = &segments[i];
+        uint32_t start, end;
+
+        if (!overlaps(s, page)) {
+            continue;
+        }
+        *writable |= s->writable;
+
+        start = page > s->vaddr ? page : s->vaddr;
+        end = s->vaddr + s->filesz;
+        if (end > page + PAGE_SIZE) {
+            end = page + PAGE_SIZE;
+        }
+        if (start < end) {
+            if (read_at(s->offset + (start - s->vaddr), frame + (start - page), end - start) < 0) {
+                return -1;
+            }
+            *from_file = 1;
+        }
+    }
+    return 0;
+}
+
+static int program_fault(uint32_t addr, uint32_t error) {
+    uint32_t page = addr & ~(PAGE_SIZE - 1);
+    int covered = 0, from_file, writable;
+    uint8_t *frame;
+
+    (void)error;
+    mutex_lock(&program_lock);
+
+    if (paging_mapped(page)) {
+        mutex_unlock(&program_lock);
+        return 0;  /* Another CPU filled it while we waited */
+    }
+    for (int i = 0; program_loaded && i < segment_count; i++) {
+        covered |= overlaps(&segments[i], page);
+    }
+    if (!covered) {
+        mutex_unlock(&program_lock);
+        ERROR("Program touched 0x%08x outside its segments", addr);
+        return -1;
+    }
+
+    frame = heap_alloc_page();
+    if (!frame) {
+        mutex_unlock(&program_lock);
+        ERROR("No memory for program page 0x%08x", page);
+        return -1;
+    }
+    if (fill_page(page, frame, &from_file, &writable) < 0) {
+        heap_free_page(frame);
+        mutex_unlock(&program_lock);
+        ERROR("Cannot read program page 0x%08x", page);
+        return -1;
+    }
+
+    paging_map(page, (uint32_t)(uintptr_t)frame, writable ? PTE_WRITE : 0);
+    if (from_file) {
+        pages_read++;
+    } else {
+        pages_zeroed++;
+    }
+    mutex_unlock(&program_lock);
+    return 0;
+}
+
+static void release_frame(uint32_t phys) {
+    heap_free_page((void *)(uintptr_t)phys);
+}
+
+/* Drop the translations on all CPUs, and only then give the frames back */
+static void program_unload(void) {
+    mutex_lock(&program_lock);
+    paging_unmap_range(ELF_WINDOW_BASE, ELF_WINDOW_SIZE, release_frame);
+
+    fat12_close(&program_file);
+    segment_count = 0;
+    program_loaded = 0;
+    mutex_unlock(&program_lock);
+}
+
+static void program_main(void *arg) {
+    int (*entry)(void) = (int (*)(void))(uintptr_t)program_entry;
+    int status;
+
+    (void)arg;
+    status = entry();
+
+    INFO("Program exited with %d: %u pages read, %u zero-filled", status, pages_read, pages_zeroed);
+    program_unload();
+}
+
+/* Headers only: validate them and record the PT_LOAD segments */
+static int load_headers(void) {
+    ElfProgramHeader ph[ELF_MAX_PHDRS];
+    ElfHeader eh;
+    int entry_ok = 0;
+
+    if (read_at(0, &eh, sizeof(eh)) < 0 || eh.magic != ELF_MAGIC ||
+        eh.class != ELF_CLASS_32 || eh.data != ELF_DATA_LSB ||
+        eh.type != ELF_TYPE_EXEC || eh.machine != ELF_MACHINE_386) {
+        WARN("Not an i386 ELF executable");
+        return -1;
+    }
+    if (eh.phentsize != sizeof(ElfProgramHeader) || eh.phnum == 0 || eh.phnum > ELF_MAX_PHDRS ||
+        read_at(eh.phoff, ph, eh.phnum * sizeof(ElfProgramHeader)) < 0) {
+        WARN("Bad ELF program headers");
+        return -1;
+    }
+
+    segment_count = 0;
+    for (int i = 0; i < eh.phnum; i++) {
+        Segment *s;
+
+        if (ph[i].type != ELF_PT_LOAD || ph[i].memsz == 0) {
+            continue;
+        }
+        if (segment_count == ELF_MAX_SEGMENTS) {
+            WARN("More than %d loadable segments", ELF_MAX_SEGMENTS);
+            return -1;
+        }
+        if (ph[i].filesz > ph[i].memsz || ph[i].vaddr < ELF_WINDOW_BASE ||
+            ph[i].memsz > ELF_WINDOW_SIZE - (ph[i].vaddr - ELF_WINDOW_BASE) ||
+            ph[i].offset > program_file.file_size ||
+            ph[i].filesz > program_file.file_size - ph[i].offset) {
+            WARN("Segment at 0x%08x does not fit the program window", ph[i].vaddr);
+            return -1;
+        }
+
+        s = &segments[segment_count++];
+        s->vaddr = ph[i].vaddr;
+        s->memsz = ph[i].memsz;
+        s->offset = ph[i].offset;
+        s->filesz = ph[i].filesz;
+        s->writable = (ph[i].flags & ELF_PF_W) != 0;
+        entry_ok |= eh.entry - s->vaddr < s->memsz;
+    }
+
+    if (!entry_ok) {
+        WARN("Entry point 0x%08x is outside the segments", eh.entry);
+        return -1;
+    }
+    program_entry = eh.entry;
+    return 0;
+}
+
+int elf_init(void) {
+    mutex_init(&program_lock);
+    if (paging_reserve(ELF_WINDOW_BASE, ELF_WINDOW_SIZE, program_fault) < 0) {
+        WARN("No program window, ELF loading disabled");
+        return -1;
+    }
+    window_ready = 1;
+    return 0;
+}
+
+int elf_exec(const char *filename, int priority) {
+    if (!window_ready) {
+        return -1;
+    }
+
+    mutex_lock(&program_lock);
+    if (program_loaded) {
+        mutex_unlock(&program_lock);
+        WARN("A program is already running");
+        return -1;
+    }
+    if (fat12_open(filename, &program_file) != 0) {
+        mutex_unlock(&program_lock);
+        return -1;
+    }
+    if (load_headers() < 0) {
+        fat12_close(&program_file);
+        segment_count = 0;
+        mutex_unlock(&program_lock);
+        return -1;
+    }
+
+    pages_read = 0;
+    pages_zeroed = 0;
+    program_loaded = 1;
+    mutex_unlock(&program_lock);
+
+    INFO("Starting %s: %d segments, entry 0x%08x", filename, segment_count, program_entry);
+    if (!thread_create("program", program_main, NULL, priority)) {
+        program_unload();
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,129 @@
+#include "event.h"
+#include "interrupt.h"
+#include "timer.h"
+#include "trace.h"
+#include "thread.h"
+#include "spinlock.h"
+
+/* Single ring shared by IRQ producers and the main loop, on any CPU */
+static Event queue[EVENT_QUEUE_SIZE];
+static uint32_t queue_head = 0;   /* Next slot to read */
+static uint32_t queue_tail = 0;   /* Next slot to write */
+static uint32_t dropped = 0;
+static WaitQueue waiters;
+static Spinlock queue_lock = SPINLOCK_INIT;
+
+void event_init(void) {
+    uint32_t flags = spin_lock_irqsave(&queue_lock);
+
+    queue_head = 0;
+    queue_tail = 0;
+    dropped = 0;
+    wait_queue_init(&waiters);
+    spin_unlock_irqrestore(&queue_lock, flags);
+}
+
+static int16_t add_clamped(int16_t a, int16_t b) {
+    int32_t sum = (int32_t)a + b;
+
+    if (sum > 32767) return 32767;
+    if (sum < -32768) return -32768;
+    return (int16_t)sum;
+}
+
+/* Fold motion into the newest queued event if it is a mouse event with the
+   same buttons; button transitions always get their own event */
+static int merge_mouse(const Event *event) {
+    Event *last;
+
+    if (queue_tail == queue_head) {
+        return 0;
+    }
+    last = &queue[(queue_tail - 1) & (EVENT_QUEUE_SIZE - 1)];
+    if (last->type != EVENT_MOUSE || last->mouse.buttons != event->mouse.buttons) {
+        return 0;
+    }
+
+    last->mouse.dx = add_clamped(last->mouse.dx, event->mouse.dx);
+    last->mouse.dy = add_clamped(last->mouse.dy, event->mouse.dy);
+    last->mouse.dz = add_clamped(last->mouse.dz, event->mouse.dz);
+    last->time = timer_ms();
+    return 1;
+}
+
+int event_post(const Event *event) {
+    uint32_t flags = spin_lock_irqsave(&queue_lock);
+    Event *slot;
+
+    if (event->type == EVENT_MOUSE && merge_mouse(event)) {
+        spin_unlock_irqrestore(&queue_lock, flags);
+        return 0;
+    }
+
+    if (queue_tail - queue_head >= EVENT_QUEUE_SIZE) {
+        dropped++;
+        TRACE_MARK(TRACE_EVENT_DROP, event->type, dropped);
+        spin_unlock_irqrestore(&queue_lock, flags);
+        return -1;
+    }
+
+    slot = &queue[queue_tail & (EVENT_QUEUE_SIZE - 1)];
+    *slot = *event;
+    slot->time = timer_ms();
+    queue_tail++;
+    wait_queue_wake_all(&waiters);
+
+    spin_unlock_irqrestore(&queue_lock, flags);
+    return 0;
+}
+
+static int queue_pop(Event *event) {
+    if (queue_head == queue_tail) {
+        return 0;
+    }
+    *event = queue[queue_head & (EVENT_QUEUE_SIZE - 1)];
+    queue_head++;
+    return 1;
+}
+
+int event_poll(Event *event) {
+    uint32_t flags = spin_lock_irqsave(&queue_lock);
+    int got = queue_pop(event);
+
+    spin_unlock_irqrestore(&queue_lock, flags);
+    return got;
+}
+
+void event_wait(Event *event) {
+    int slept = 0;
+
+    for (;;) {
+        interrupts_disable();
+        spin_lock(&queue_lock);
+        if (queue_pop(event)) {
+            spin_unlock(&queue_lock);
+            interrupts_enable();
+            if (slept) {
+                TRACE_SCOPE_END(TRACE_EVENT_WAIT, event->type, 0);
+            }
+            return;
+        }
+        if (!slept) {
+            TRACE_SCOPE_BEGIN(TRACE_EVENT_WAIT, 0, 0);
+            slept = 1;
+        }
+        if (thread_active()) {
+            /* The lock is only dropped once we are queued, so a post cannot slip between */
+            wait_queue_sleep(&waiters, &queue_lock);
+            spin_unlock(&queue_lock);
+        } else {
+            /* sti only takes effect after hlt, so no wakeup can slip in between */
+            spin_unlock(&queue_lock);
+            __asm__ volatile ("sti; hlt" : : : "memory");
+        }
+    }
+}
+
+uint32_t event_dropped(void) {
+    return dropped;
+}
@@ -1,6 +1,9 @@
+#define LOG_CATEGORY FAT
+
 #include "fat12.h"
 #include "fdc.h"
 #include "debug.h"
+#include "trace.h"
 #include <stddef.h>
 
 /* Disk I/O buffer */
@@ -14,6 +17,7 @@ static uint8_t root_buffer[ROOT_BUFFER_SIZE] __attribute__((aligned(512)));
 
 static BootSector boot_sector;
 static uint8_t *fat_table;      /* FAT table in memory */
+static uint32_t fat_loaded;     /* Bytes of it read so far */
 static uint8_t *root_dir;       /* Root directory in memory */
 
 /* Note: read_sector wrapper removed - calling FDC driver directly */
@@ -106,6 +110,7 @@ void fat12_init(void) {
     }
     
     if (fat_table) {
+        fat_loaded = fat_sectors_to_read * 512;
         INFO("FAT table loaded successfully");
     }
     
@@ -276,12 +281,18 @@ static uint16_t get_next_cluster(uint16_t cluster) {
     uint32_t byte_offset = (cluster * 3) / 2;
     uint16_t value;
     
+    if (byte_offset + 1 >= fat_loaded) {
+        WARN("Cluster %u is past the loaded FAT", cluster);
+        return 0;
+    }
+
+    value = fat_table[byte_offset] | (fat_table[byte_offset + 1] << 8);
     if (cluster & 1) {
-        /* Odd cluster - high 12 bits of 3-byte group */
-        value = ((fat_table[byte_offset + 1] & 0x0F) << 8) | fat_table[byte_offset + 2];
+        /* Odd cluster - high 12 bits of the little-endian pair */
+        value >>= 4;
     } else {
-        /* Even cluster - low 12 bits of 3-byte group */
-        value = fat_table[byte_offset] | ((fat_table[byte_offset + 1] & 0xF0) << 4);
+        /* Even cluster - low 12 bits */
+        value &= 0x0FFF;
     }
     
     /* 0xFF8 or higher = end of chain */
@@ -354,31 +365,24 @@ int fat12_read(FileHandle *file, uint8_t *buffer, uint32_t size) {
     }
     
     uint32_t bytes_to_read = size;
-    uint32_t cluster_offset_bytes = (file->current_pos) % (boot_sector.sectors_per_cluster * 512);
+    uint32_t cluster_size = boot_sector.sectors_per_cluster * 512;
+    uint32_t cluster_offset_bytes = (file->current_pos) % cluster_size;
+    /* current_cluster always holds current_pos, so partial reads can resume */
     uint16_t current_cluster = file->current_cluster;
     
-    /* If we're mid-cluster, seek to the right position */
-    if (cluster_offset_bytes > 0) {
-        uint32_t clusters_to_skip = (file->current_pos) / (boot_sector.sectors_per_cluster * 512);
-        for (uint32_t i = 0; i < clusters_to_skip; i++) {
-            current_cluster = get_next_cluster(current_cluster);
-            if (current_cluster == 0) return -1;
-        }
-    }
-    
     /* Read clusters */
     uint8_t cluster_buffer[8192];  /* Max 16 sectors per cluster */
     while (bytes_to_read > 0 && current_cluster != 0) {
         /* Read cluster */
+        TRACE_SCOPE_BEGIN(TRACE_FAT_READ, current_cluster, 0);
         if (read_cluster_data(current_cluster, cluster_buffer) != 0) {
+            TRACE_SCOPE_END(TRACE_FAT_READ, current_cluster, 1);
             return bytes_read;
         }
+        TRACE_SCOPE_END(TRACE_FAT_READ, current_cluster, 0);
         
         /* Copy data from cluster */
-        uint32_t bytes_from_cluster = boot_sector.sectors_per_cluster * 512;
-        if (cluster_offset_bytes > 0) {
-            bytes_from_cluster -= cluster_offset_bytes;
-        }
+        uint32_t bytes_from_cluster = cluster_size - cluster_offset_bytes;
         
         if (bytes_from_cluster > bytes_to_read) {
             bytes_from_cluster = bytes_to_read;
@@ -391,9 +395,12 @@ int fat12_read(FileHandle *file, uint8_t *buffer, uint32_t size) {
         }
         
         bytes_to_read -= bytes_from_cluster;
-        cluster_offset_bytes = 0;  /* Only offset on first cluster */
-        
-        /* Get next cluster */
+
+        /* Move on only once this cluster is used up */
+        if (cluster_offset_bytes + bytes_from_cluster < cluster_size) {
+            break;
+        }
+        cluster_offset_bytes = 0;
         current_cluster = get_next_cluster(current_cluster);
     }
     
@@ -435,9 +442,20 @@ int fat12_seek(FileHandle *file, uint32_t offset) {
         return -1;
     }
     
-    file->current_pos = offset;
+    uint32_t cluster_size = boot_sector.sectors_per_cluster * 512;
+    uint32_t target = offset / cluster_size;
+    uint32_t index = file->current_pos / cluster_size;
     
-    /* TODO: Update current_cluster based on offset */
+    /* Walk the chain to the cluster holding the new position, from the
+       current one when moving forward, so sequential seeks stay cheap */
+    if (target < index || file->current_cluster == 0) {
+        file->current_cluster = file->start_cluster;
+        index = 0;
+    }
+    for (; index < target; index++) {
+        file->current_cluster = get_next_cluster(file->current_cluster);
+    }
+    file->current_pos = offset;
     
     return 0;
 }
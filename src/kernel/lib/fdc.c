@@ -1,11 +1,20 @@
+#define LOG_CATEGORY FDC
+
 #include "fdc.h"
 #include "io.h"
 #include "debug.h"
+#include "event.h"
+#include "trace.h"
+#include "mutex.h"
 #include <stddef.h>
 
 /* FDC state */
 static int fdc_ready = 0;
 static int fdc_motor_running = 0;
+static int fdc_notify = 0;      /* Post EVENT_DISK; off until someone listens */
+
+/* One command at a time on the controller, whichever thread issues it */
+static Mutex fdc_lock;
 
 /* Timeout constants (in microseconds) */
 #define FDC_TIMEOUT 1000000  /* 1 second */
@@ -46,6 +55,23 @@ static int fdc_wait_input_short(int timeout) {
     return -1;
 }
 
+/* Tell the event loop a transfer finished, if it asked; returns status
+   for tail calls. Every exit of an accepted request, failures included,
+   comes through here, so a listener always hears back. */
+static int fdc_complete(uint16_t trace_id, uint32_t lba, int status) {
+    Event ev = { .type = EVENT_DISK };
+
+    TRACE_SCOPE_END(trace_id, lba, (uint32_t)status);
+    if (!fdc_notify) {
+        return status;
+    }
+
+    ev.disk.lba = lba;
+    ev.disk.status = status;
+    event_post(&ev);
+    return status;
+}
+
 /* Read result from FDC */
 static uint8_t fdc_read_byte(void) {
     return inb(FDC_FIFO);
@@ -250,8 +276,33 @@ static int fdc_seek(uint8_t cylinder) {
     return 0;
 }
 
+/* PIO data phase: the controller overruns if a byte is not taken in time,
+   so the thread must not be switched out halfway through a sector */
+static int fdc_transfer(uint8_t *read_buf, const uint8_t *write_buf) {
+    int result = 0;
+
+    thread_preempt_disable();
+    for (uint32_t i = 0; i < FDC_SECTOR_SIZE; i++) {
+        int timeout = 1000000;
+        while (timeout-- > 0 && !(inb(FDC_MSR) & MSR_DATA_READY)) {
+            io_wait();
+        }
+        if (timeout < 0) {
+            result = -1;
+            break;
+        }
+        if (read_buf) {
+            read_buf[i] = inb(FDC_FIFO);
+        } else {
+            outb(FDC_FIFO, write_buf[i]);
+        }
+    }
+    thread_preempt_enable();
+    return result;
+}
+
 /* Read sector using LBA (Logical Block Address) */
-int fdc_read_sector(uint32_t lba, uint8_t *buffer) {
+static int fdc_read_locked(uint32_t lba, uint8_t *buffer) {
     if (!fdc_ready) {
         ERROR("FDC not ready");
         return -1;
@@ -260,11 +311,12 @@ int fdc_read_sector(uint32_t lba, uint8_t *buffer) {
         ERROR("Buffer is null");
         return -1;
     }
+    TRACE_SCOPE_BEGIN(TRACE_FDC_READ, lba, 0);
     
     /* Ensure motor is running */
     if (!fdc_motor_running) {
         if (fdc_motor_on() < 0) {
-            return -1;
+            return fdc_complete(TRACE_FDC_READ, lba, FDC_ERROR_NOT_READY);
         }
     }
     
@@ -276,13 +328,13 @@ int fdc_read_sector(uint32_t lba, uint8_t *buffer) {
     /* Recalibrate */
     if (fdc_recalibrate() < 0) {
         ERROR("Recalibrate failed");
-        return -1;
+        return fdc_complete(TRACE_FDC_READ, lba, FDC_ERROR_SEEK);
     }
     
     /* Seek to cylinder */
     if (fdc_seek(cylinder) < 0) {
         ERROR("Seek failed");
-        return -1;
+        return fdc_complete(TRACE_FDC_READ, lba, FDC_ERROR_SEEK);
     }
     
     /* Send READ_DATA command - write all bytes directly */
@@ -317,16 +369,9 @@ int fdc_read_sector(uint32_t lba, uint8_t *buffer) {
     for (int i = 0; i < 10000000; i++) io_wait();
     
     /* Read sector data */
-    for (uint32_t i = 0; i < FDC_SECTOR_SIZE; i++) {
-        int timeout = 1000000;
-        while (timeout-- > 0 && !(inb(FDC_MSR) & MSR_DATA_READY)) {
-            io_wait();
-        }
-        if (timeout < 0) {
-            ERROR("Read data timeout at byte");
-            return -1;
-        }
-        buffer[i] = inb(FDC_FIFO);
+    if (fdc_transfer(buffer, NULL) < 0) {
+        ERROR("Read data timeout at byte");
+        return fdc_complete(TRACE_FDC_READ, lba, FDC_ERROR_TIMEOUT);
     }
     
     /* Read result bytes (7 bytes) - just drain them */
@@ -342,19 +387,33 @@ int fdc_read_sector(uint32_t lba, uint8_t *buffer) {
     }
     
     INFO("Sector read ok");
-    return 0;
+    return fdc_complete(TRACE_FDC_READ, lba, FDC_SUCCESS);
+}
+
+void fdc_set_notify(int enabled) {
+    fdc_notify = enabled;
+}
+
+int fdc_read_sector(uint32_t lba, uint8_t *buffer) {
+    int result;
+
+    mutex_lock(&fdc_lock);
+    result = fdc_read_locked(lba, buffer);
+    mutex_unlock(&fdc_lock);
+    return result;
 }
 
 /* Write sector */
-int fdc_write_sector(uint32_t lba, const uint8_t *buffer) {
+static int fdc_write_locked(uint32_t lba, const uint8_t *buffer) {
     if (!fdc_ready || !buffer) {
         return -1;
     }
+    TRACE_SCOPE_BEGIN(TRACE_FDC_WRITE, lba, 0);
     
     /* Ensure motor is running */
     if (!fdc_motor_running) {
         if (fdc_motor_on() < 0) {
-            return -1;
+            return fdc_complete(TRACE_FDC_WRITE, lba, FDC_ERROR_NOT_READY);
         }
     }
     
@@ -366,13 +425,13 @@ int fdc_write_sector(uint32_t lba, const uint8_t *buffer) {
     /* Recalibrate */
     if (fdc_recalibrate() < 0) {
         ERROR("Write recalibrate failed");
-        return -1;
+        return fdc_complete(TRACE_FDC_WRITE, lba, FDC_ERROR_SEEK);
     }
     
     /* Seek to cylinder */
     if (fdc_seek(cylinder) < 0) {
         ERROR("Write seek failed");
-        return -1;
+        return fdc_complete(TRACE_FDC_WRITE, lba, FDC_ERROR_SEEK);
     }
     
     /* Send WRITE_DATA command - write all bytes directly */
@@ -407,16 +466,9 @@ int fdc_write_sector(uint32_t lba, const uint8_t *buffer) {
     for (int i = 0; i < 10000000; i++) io_wait();
     
     /* Write sector data */
-    for (uint32_t i = 0; i < FDC_SECTOR_SIZE; i++) {
-        int timeout = 1000000;
-        while (timeout-- > 0 && !(inb(FDC_MSR) & MSR_DATA_READY)) {
-            io_wait();
-        }
-        if (timeout < 0) {
-            ERROR("Write data timeout");
-            return -1;
-        }
-        outb(FDC_FIFO, buffer[i]);
+    if (fdc_transfer(NULL, buffer) < 0) {
+        ERROR("Write data timeout");
+        return fdc_complete(TRACE_FDC_WRITE, lba, FDC_ERROR_TIMEOUT);
     }
     
     /* Read result bytes - just drain them */
@@ -432,5 +484,14 @@ int fdc_write_sector(uint32_t lba, const uint8_t *buffer) {
     }
     
     INFO("Sector write ok");
-    return 0;
+    return fdc_complete(TRACE_FDC_WRITE, lba, FDC_SUCCESS);
+}
+
+int fdc_write_sector(uint32_t lba, const uint8_t *buffer) {
+    int result;
+
+    mutex_lock(&fdc_lock);
+    result = fdc_write_locked(lba, buffer);
+    mutex_unlock(&fdc_lock);
+    return result;
 }
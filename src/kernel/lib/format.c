@@ -0,0 +1,178 @@
+#include "format.h"
+#include <stdint.h>
+
+typedef struct {
+    char *buf;
+    size_t size;
+    size_t len;     /* Characters produced, including any that did not fit */
+} FormatOut;
+
+static void out_char(FormatOut *out, char c) {
+    if (out->len + 1 < out->size) {
+        out->buf[out->len] = c;
+    }
+    out->len++;
+}
+
+static void out_padded(FormatOut *out, const char *s, int len, int width, int left, char pad) {
+    /* Zero padding goes after the sign */
+    if (pad == '0' && len > 0 && s[0] == '-') {
+        out_char(out, '-');
+        s++;
+        len--;
+        width--;
+    }
+    if (!left) {
+        for (int i = len; i < width; i++) {
+            out_char(out, pad);
+        }
+    }
+    for (int i = 0; i < len; i++) {
+        out_char(out, s[i]);
+    }
+    if (left) {
+        for (int i = len; i < width; i++) {
+            out_char(out, ' ');
+        }
+    }
+}
+
+/* Divide in place without libgcc's 64-bit helpers: long division by 16-bit
+   chunks keeps every step within 32 bits (base is at most 16) */
+static unsigned divmod_u64(uint64_t *value, unsigned base) {
+    uint64_t v = *value;
+    uint64_t q = 0;
+    uint32_t r = 0;
+
+    if ((v >> 32) == 0) {
+        *value = (uint32_t)v / base;
+        return (uint32_t)v % base;
+    }
+    for (int shift = 48; shift >= 0; shift -= 16) {
+        uint32_t cur = (r << 16) | (uint32_t)((v >> shift) & 0xFFFF);
+
+        q = (q << 16) | (cur / base);
+        r = cur % base;
+    }
+    *value = q;
+    return r;
+}
+
+/* Digits are produced back to front; returns a pointer into tmp */
+static char *format_number(char *end, uint64_t value, unsigned base, int upper, int negative) {
+    const char *digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+    char *p = end;
+
+    *p = '\0';
+    do {
+        *--p = digits[divmod_u64(&value, base)];
+    } while (value);
+    if (negative) {
+        *--p = '-';
+    }
+    return p;
+}
+
+int kvsnprintf(char *buf, size_t size, const char *fmt, va_list args) {
+    FormatOut out = { buf, size, 0 };
+    char tmp[24];
+
+    while (*fmt) {
+        int left = 0, width = 0, longs = 0;
+        char pad = ' ';
+        const char *s;
+
+        if (*fmt != '%') {
+            out_char(&out, *fmt++);
+            continue;
+        }
+        fmt++;
+
+        for (;; fmt++) {
+            if (*fmt == '-') left = 1;
+            else if (*fmt == '0') pad = '0';
+            else break;
+        }
+        if (left) pad = ' ';
+        while (*fmt >= '0' && *fmt <= '9') {
+            width = (width * 10) + (*fmt++ - '0');
+        }
+        while (*fmt == 'l') {
+            longs++;
+            fmt++;
+        }
+
+        switch (*fmt) {
+            case 'd':
+            case 'i': {
+                int64_t v = longs >= 2 ? va_arg(args, long long) :
+                            longs == 1 ? va_arg(args, long) : va_arg(args, int);
+                uint64_t mag = v < 0 ? (uint64_t)0 - (uint64_t)v : (uint64_t)v;
+
+                s = format_number(tmp + sizeof(tmp) - 1, mag, 10, 0, v < 0);
+                break;
+            }
+            case 'u':
+            case 'x':
+            case 'X': {
+                uint64_t v = longs >= 2 ? va_arg(args, unsigned long long) :
+                             longs == 1 ? va_arg(args, unsigned long) : va_arg(args, unsigned int);
+
+                s = format_number(tmp + sizeof(tmp) - 1, v, *fmt == 'u' ? 10 : 16, *fmt == 'X', 0);
+                break;
+            }
+            case 'p':
+                out_char(&out, '0');
+                out_char(&out, 'x');
+                s = format_number(tmp + sizeof(tmp) - 1, (uintptr_t)va_arg(args, void *), 16, 0, 0);
+                width = 8;
+                pad = '0';
+                left = 0;
+                break;
+            case 'c':
+                tmp[0] = (char)va_arg(args, int);
+                tmp[1] = '\0';
+                s = tmp;
+                break;
+            case 's':
+                s = va_arg(args, const char *);
+                if (!s) s = "(null)";
+                pad = ' ';
+                break;
+            case '%':
+                out_char(&out, '%');
+                fmt++;
+                continue;
+            case '\0':
+                continue;
+            default:
+                /* Unknown conversion: print it verbatim */
+                out_char(&out, '%');
+                out_char(&out, *fmt++);
+                continue;
+        }
+        fmt++;
+
+        {
+            int len = 0;
+
+            while (s[len]) len++;
+            out_padded(&out, s, len, width, left, pad);
+        }
+    }
+
+    if (size > 0) {
+        buf[out.len < size ? out.len : size - 1] = '\0';
+    }
+    return (int)out.len;
+}
+
+int ksnprintf(char *buf, size_t size, const char *fmt, ...) {
+    va_list args;
+    int len;
+
+    va_start(args, fmt);
+    len = kvsnprintf(buf, size, fmt, args);
+    va_end(args);
+    return len;
+}
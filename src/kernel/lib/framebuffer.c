@@ -1,58 +1,182 @@
+#define LOG_CATEGORY FB
+
 #include <stddef.h>
 #include "bootinfo.h"
 #include "framebuffer.h"
-#include "font8x8.h"
+#include "blit.h"
+#include "text.h"
+#include "trace.h"
+#include "debug.h"
+
+static void fill_32(uint8_t *dst, uint32_t pixel, uint32_t count) {
+    blit_fill32((uint32_t *)dst, pixel, count);
+}
+
+static void fill_32_stream(uint8_t *dst, uint32_t pixel, uint32_t count) {
+    blit_fill32_stream((uint32_t *)dst, pixel, count);
+}
 
-void fb_init(Framebuffer *fb, const struct BootInfo *info) {
-    fb->addr = (uint32_t *)(uintptr_t)info->lfb;
+static void fill_24(uint8_t *dst, uint32_t pixel, uint32_t count) {
+    blit_fill24(dst, pixel, count);
+}
+
+static void fill_16(uint8_t *dst, uint32_t pixel, uint32_t count) {
+    blit_fill16((uint16_t *)dst, (uint16_t)pixel, count);
+}
+
+static void fill_16_stream(uint8_t *dst, uint32_t pixel, uint32_t count) {
+    blit_fill16_stream((uint16_t *)dst, (uint16_t)pixel, count);
+}
+
+static const FbPixelOps ops_32 = { fill_32, fill_32_stream };
+static const FbPixelOps ops_24 = { fill_24, fill_24 };
+static const FbPixelOps ops_16 = { fill_16, fill_16_stream };
+
+/* Channel layout from the VBE masks; zero sizes mean the BIOS left them out */
+static void fb_set_layout(Framebuffer *fb, const struct BootInfo *info) {
+    if (info->red_size == 0 || info->green_size == 0 || info->blue_size == 0) {
+        static const uint8_t rgb565[6] = { 11, 3, 5, 2, 0, 3 };
+        static const uint8_t rgb555[6] = { 10, 3, 5, 3, 0, 3 };
+        static const uint8_t rgb888[6] = { 16, 0, 8, 0, 0, 0 };
+        const uint8_t *l = (fb->bpp == 16) ? rgb565 : (fb->bpp == 15) ? rgb555 : rgb888;
+
+        fb->red_pos = l[0];
+        fb->red_loss = l[1];
+        fb->green_pos = l[2];
+        fb->green_loss = l[3];
+        fb->blue_pos = l[4];
+        fb->blue_loss = l[5];
+        return;
+    }
+
+    fb->red_pos = info->red_pos;
+    fb->red_loss = (uint8_t)(8 - info->red_size);
+    fb->green_pos = info->green_pos;
+    fb->green_loss = (uint8_t)(8 - info->green_size);
+    fb->blue_pos = info->blue_pos;
+    fb->blue_loss = (uint8_t)(8 - info->blue_size);
+}
+
+int fb_init(Framebuffer *fb, const struct BootInfo *info) {
+    fb->addr = (uint8_t *)(uintptr_t)info->lfb;
     fb->back_buffer = NULL;  /* No double buffering by default */
     fb->width = info->width;
     fb->height = info->height;
     fb->pitch = info->pitch;
     fb->bpp = info->bpp;
     fb->font = (const uint8_t *)(uintptr_t)info->font_ptr;
+    fb->dirty_count = 0;
+    fb->flip = NULL;
+    fb->page_base = fb->addr;
+    fb->front_page = 0;
+    fb->prev_dirty_count = 0;
+    fb_reset_clip(fb);
+
+    switch (info->bpp) {
+        case 32:
+            fb->ops = &ops_32;
+            break;
+        case 24:
+            fb->ops = &ops_24;
+            break;
+        case 15:
+        case 16:
+            fb->ops = &ops_16;
+            break;
+        default:
+            ERROR("No backend for %u bpp", info->bpp);
+            return -1;
+    }
+    fb->bytes_per_pixel = (uint8_t)((info->bpp + 7) / 8);
+    fb_set_layout(fb, info);
+
+    INFO("%ux%u, %u bpp, R%u:%u G%u:%u B%u:%u", fb->width, fb->height, fb->bpp,
+         8 - fb->red_loss, fb->red_pos, 8 - fb->green_loss, fb->green_pos,
+         8 - fb->blue_loss, fb->blue_pos);
+    return 0;
 }
 
-void fb_enable_double_buffer(Framebuffer *fb, uint32_t *buffer) {
-    fb->back_buffer = buffer;
+void fb_init_surface(Framebuffer *fb, const Framebuffer *format, uint16_t width, uint16_t height, void *pixels) {
+    *fb = *format;
+    fb->addr = NULL;
+    fb->back_buffer = pixels;
+    fb->width = width;
+    fb->height = height;
+    fb->pitch = (uint16_t)(width * format->bytes_per_pixel);
+    fb->dirty_count = 0;
+    fb->flip = NULL;
+    fb->page_base = NULL;
+    fb->prev_dirty_count = 0;
+    fb_reset_clip(fb);
 }
 
-void fb_swap(Framebuffer *fb) {
-    uint16_t y;
-    
-    if (!fb->back_buffer) {
-        return;  /* No double buffering enabled */
+void fb_set_clip(Framebuffer *fb, int x, int y, int w, int h) {
+    FbRect screen = { 0, 0, fb->width, fb->height };
+    FbRect r = { x, y, w, h };
+
+    rect_intersect(&fb->clip, &r, &screen);
+}
+
+void fb_reset_clip(Framebuffer *fb) {
+    fb->clip.x = 0;
+    fb->clip.y = 0;
+    fb->clip.w = fb->width;
+    fb->clip.h = fb->height;
+    fb->clip_depth = 0;
+}
+
+void fb_push_clip(Framebuffer *fb, int x, int y, int w, int h) {
+    FbRect r = { x, y, w, h };
+
+    if (fb->clip_depth < FB_CLIP_DEPTH) {
+        fb->clip_stack[fb->clip_depth] = fb->clip;
+    } else if (fb->clip_depth == FB_CLIP_DEPTH) {
+        WARN("Clip stack full");
+        fb->clip_full = fb->clip;
     }
-    
-    /* Copy back buffer to visible framebuffer */
-    for (y = 0; y < fb->height; ++y) {
-        uint32_t *dst = (uint32_t *)((uint8_t *)fb->addr + (y * fb->pitch));
-        uint32_t *src = (uint32_t *)((uint8_t *)fb->back_buffer + (y * fb->pitch));
-        uint16_t x;
-        
-        for (x = 0; x < fb->width; ++x) {
-            dst[x] = src[x];
-        }
+    fb->clip_depth++;
+    rect_intersect(&fb->clip, &fb->clip, &r);
+}
+
+void fb_pop_clip(Framebuffer *fb) {
+    if (fb->clip_depth == 0) {
+        return;
     }
+    fb->clip_depth--;
+    fb->clip = fb->clip_depth < FB_CLIP_DEPTH ? fb->clip_stack[fb->clip_depth] : fb->clip_full;
 }
 
-void fb_clear(Framebuffer *fb, uint32_t color) {
+/* Fill one span, streaming past the cache when drawing straight to the LFB */
+static void fb_fill_span(const Framebuffer *fb, uint8_t *dst, uint32_t pixel, int count) {
+    if (fb->back_buffer) {
+        fb->ops->fill(dst, pixel, (uint32_t)count);
+    } else {
+        fb->ops->fill_stream(dst, pixel, (uint32_t)count);
+    }
+}
+
+void fb_enable_double_buffer(Framebuffer *fb, void *buffer) {
     uint16_t y;
-    uint32_t *target = fb->back_buffer ? fb->back_buffer : fb->addr;
 
-    for (y = 0; y < fb->height; ++y) {
-        uint32_t *row = (uint32_t *)((uint8_t *)target + (y * fb->pitch));
-        uint16_t x;
+    fb->back_buffer = buffer;
+    fb->dirty_count = 0;
+    if (!buffer) {
+        return;
+    }
 
-        for (x = 0; x < fb->width; ++x) {
-            row[x] = color;
-        }
+    /* Start from what is on screen so partial redraws stay consistent */
+    for (y = 0; y < fb->height; ++y) {
+        blit_copy_bytes(fb->back_buffer + (y * fb->pitch), fb->addr + (y * fb->pitch),
+                        (uint32_t)fb->width * fb->bytes_per_pixel);
     }
 }
 
-void fb_draw_rect(Framebuffer *fb, int x, int y, int w, int h, uint32_t color) {
-    int yy;
-    uint32_t *target = fb->back_buffer ? fb->back_buffer : fb->addr;
+void fb_mark_dirty(Framebuffer *fb, int x, int y, int w, int h) {
+    FbRect r;
+
+    if (!fb->back_buffer) {
+        return;  /* Drawing went straight to the screen */
+    }
 
     if (x < 0) {
         w += x;
@@ -72,75 +196,245 @@ void fb_draw_rect(Framebuffer *fb, int x, int y, int w, int h, uint32_t color) {
         return;
     }
 
-    for (yy = 0; yy < h; ++yy) {
-        uint32_t *row = (uint32_t *)((uint8_t *)target + ((y + yy) * fb->pitch));
-        int xx;
+    r.x = x;
+    r.y = y;
+    r.w = w;
+    r.h = h;
+    rect_list_add(fb->dirty, &fb->dirty_count, FB_MAX_DIRTY, &r);
+}
+
+/* Stream one back buffer rectangle to a page, one row span at a time */
+static void fb_present_rect(const Framebuffer *fb, uint8_t *page, const FbRect *r) {
+    uint32_t bytes = (uint32_t)r->w * fb->bytes_per_pixel;
+
+    for (int yy = r->y; yy < r->y + r->h; ++yy) {
+        uint32_t offset = ((uint32_t)yy * fb->pitch) + ((uint32_t)r->x * fb->bytes_per_pixel);
+
+        blit_copy_bytes_stream(page + offset, fb->back_buffer + offset, bytes);
+    }
+}
+
+void fb_enable_page_flip(Framebuffer *fb, FbFlipFn flip) {
+    if (!fb->back_buffer || !flip || fb->flip) {
+        return;
+    }
+
+    fb->flip = flip;
+    fb->page_base = fb->addr;
+    fb->front_page = 0;
+
+    /* Page 1 has never been drawn: the first swap fills all of it */
+    fb->prev_dirty[0].x = 0;
+    fb->prev_dirty[0].y = 0;
+    fb->prev_dirty[0].w = fb->width;
+    fb->prev_dirty[0].h = fb->height;
+    fb->prev_dirty_count = 1;
+}
+
+void fb_swap(Framebuffer *fb) {
+    int i;
+
+    if (!fb->back_buffer || fb->dirty_count == 0) {
+        return;  /* No double buffering enabled, or nothing to show */
+    }
+    TRACE_SCOPE_BEGIN(TRACE_FB_SWAP, fb->dirty_count, fb->front_page);
+
+    if (fb->flip) {
+        uint8_t back = fb->front_page ^ 1;
+        uint8_t *page = fb->page_base + ((uint32_t)back * fb->height * fb->pitch);
+        FbRect pending[FB_MAX_DIRTY];
+        int count = 0;
+
+        /* The hidden page is two frames old: it needs this frame's damage
+           and the last one's, both streamed from the back buffer */
+        for (i = 0; i < fb->dirty_count; ++i) {
+            rect_list_add(pending, &count, FB_MAX_DIRTY, &fb->dirty[i]);
+        }
+        for (i = 0; i < fb->prev_dirty_count; ++i) {
+            rect_list_add(pending, &count, FB_MAX_DIRTY, &fb->prev_dirty[i]);
+        }
+        for (i = 0; i < count; ++i) {
+            fb_present_rect(fb, page, &pending[i]);
+        }
+        fb->flip((uint16_t)(back * fb->height));
+        fb->front_page = back;
+        fb->addr = page;
 
-        for (xx = 0; xx < w; ++xx) {
-            row[x + xx] = color;
+        /* Only this frame's own damage is stale on the page just hidden */
+        for (i = 0; i < fb->dirty_count; ++i) {
+            fb->prev_dirty[i] = fb->dirty[i];
+        }
+        fb->prev_dirty_count = fb->dirty_count;
+    } else {
+        for (i = 0; i < fb->dirty_count; ++i) {
+            fb_present_rect(fb, fb->addr, &fb->dirty[i]);
         }
     }
+
+    TRACE_SCOPE_END(TRACE_FB_SWAP, fb->dirty_count, fb->front_page);
+    fb->dirty_count = 0;
 }
 
-void fb_draw_char(Framebuffer *fb, int x, int y, char c, uint32_t color) {
-    const uint8_t *glyph;
-    int row, col;
-    unsigned char uc = (unsigned char)c;
-    uint32_t *target = fb->back_buffer ? fb->back_buffer : fb->addr;
-    
-    /* Use embedded font (ASCII 32-127) */
-    if (uc < 32 || uc > 127) {
-        uc = 32; /* Default to space for out-of-range chars */
-    }
-    
-    /* Adjust font pointer: kernel linked at 0 but loaded at 0x20000 */
-    glyph = (const uint8_t *)((uintptr_t)font8x8_basic[uc - 32] + 0x20000);
-    
-    for (row = 0; row < 8; row++) {
-        uint8_t bits = glyph[row];
-        int py = y + row;
-        
-        if (py >= 0 && py < fb->height) {
-            uint32_t *dst = (uint32_t *)((uint8_t *)target + (py * fb->pitch));
-            
-            for (col = 0; col < 8; col++) {
-                int px = x + col;
-                
-                if (px >= 0 && px < fb->width) {
-                    if (bits & (1 << col)) {
-                        dst[px] = color;
-                    }
-                }
-            }
+void fb_clear(Framebuffer *fb, uint32_t color) {
+    uint16_t y;
+    uint32_t pixel = fb_pack_color(fb, color);
+
+    if (fb->pitch == (uint32_t)fb->width * fb->bytes_per_pixel) {
+        /* No row padding: one span covers the whole surface */
+        fb_fill_span(fb, fb_target_row(fb, 0), pixel, fb->width * fb->height);
+    } else {
+        for (y = 0; y < fb->height; ++y) {
+            fb_fill_span(fb, fb_target_row(fb, y), pixel, fb->width);
         }
     }
+
+    fb_mark_dirty(fb, 0, 0, fb->width, fb->height);
 }
 
-void fb_draw_text(Framebuffer *fb, int x, int y, const char *text, uint32_t color) {
-    int i;
-    const char *actual_text;
-    
-    if (!text || !fb) {
+void fb_draw_rect(Framebuffer *fb, int x, int y, int w, int h, uint32_t color) {
+    int yy;
+    uint32_t pixel = fb_pack_color(fb, color);
+    FbRect r = { x, y, w, h };
+
+    if (!rect_intersect(&r, &r, &fb->clip)) {
         return;
     }
-    
-    /* Adjust pointer: kernel linked at 0 but loaded at 0x20000 */
-    /* Check if pointer looks like it might already be adjusted */
-    uintptr_t ptr_val = (uintptr_t)text;
-    if (ptr_val < 0x10000) {
-        /* Looks like an offset, needs adjustment */
-        actual_text = (const char *)(ptr_val + 0x20000);
+
+    for (yy = 0; yy < r.h; ++yy) {
+        uint8_t *row = fb_target_row(fb, r.y + yy);
+
+        fb_fill_span(fb, row + ((uint32_t)r.x * fb->bytes_per_pixel), pixel, r.w);
+    }
+
+    fb_mark_dirty(fb, r.x, r.y, r.w, r.h);
+}
+
+void fb_blit(Framebuffer *fb, const Framebuffer *src, int x, int y) {
+    FbRect r = { x, y, src->width, src->height };
+    const uint8_t *from;
+    uint32_t bytes;
+
+    if (!rect_intersect(&r, &r, &fb->clip)) {
+        return;
+    }
+
+    bytes = (uint32_t)r.w * fb->bytes_per_pixel;
+    from = fb_target_row(src, r.y - y) + ((uint32_t)(r.x - x) * fb->bytes_per_pixel);
+    for (int yy = 0; yy < r.h; yy++, from += src->pitch) {
+        uint8_t *to = fb_target_row(fb, r.y + yy) + ((uint32_t)r.x * fb->bytes_per_pixel);
+
+        if (fb->back_buffer) {
+            blit_copy_bytes(to, from, bytes);
+        } else {
+            blit_copy_bytes_stream(to, from, bytes);
+        }
+    }
+
+    fb_mark_dirty(fb, r.x, r.y, r.w, r.h);
+}
+
+#define BLEND_CHUNK 64     /* Pixels unpacked per pass on non-ARGB surfaces */
+
+/* 32-bit xRGB with alpha's byte free: blend kernels run on the pixels in place */
+static int fb_is_argb(const Framebuffer *fb) {
+    return fb->bytes_per_pixel == 4 && fb->red_pos == 16 && fb->green_pos == 8 && fb->blue_pos == 0;
+}
+
+static uint32_t unpack_channel(uint32_t pixel, uint8_t pos, uint8_t loss) {
+    uint32_t v = ((pixel >> pos) & (0xFFu >> loss)) << loss;
+
+    return loss ? v | (v >> (8 - loss)) : v;
+}
+
+static uint32_t fb_unpack_color(const Framebuffer *fb, uint32_t pixel) {
+    return (unpack_channel(pixel, fb->red_pos, fb->red_loss) << 16) |
+           (unpack_channel(pixel, fb->green_pos, fb->green_loss) << 8) |
+           unpack_channel(pixel, fb->blue_pos, fb->blue_loss);
+}
+
+/* src NULL blends the premultiplied argb, otherwise src scaled by alpha */
+static void blend_argb(uint32_t *dst, const uint32_t *src, uint32_t argb, uint32_t count, uint8_t alpha) {
+    if (src) {
+        blit_blend32_alpha(dst, src, count, alpha);
     } else {
-        /* Already adjusted or in a different region */
-        actual_text = text;
+        blit_blend_fill32(dst, argb, count);
     }
-    
-    /* Safety check - bail if pointer looks invalid */
-    if ((uintptr_t)actual_text < 0x20000 || (uintptr_t)actual_text > 0x100000) {
+}
+
+/* Other layouts go through a 0xRRGGBB scratch row, so they share the kernels */
+static void fb_blend_span(const Framebuffer *fb, uint8_t *dst, const uint32_t *src, uint32_t argb, int count, uint8_t alpha) {
+    uint32_t tmp[BLEND_CHUNK];
+
+    if (fb_is_argb(fb)) {
+        blend_argb((uint32_t *)dst, src, argb, (uint32_t)count, alpha);
         return;
     }
-    
-    for (i = 0; i < 64 && actual_text[i] != '\0'; i++) {
-        fb_draw_char(fb, x + (i * 8), y, actual_text[i], color);
+
+    while (count > 0) {
+        int n = count > BLEND_CHUNK ? BLEND_CHUNK : count;
+        uint8_t *p = dst;
+
+        for (int i = 0; i < n; i++, p += fb->bytes_per_pixel) {
+            tmp[i] = fb_unpack_color(fb, fb_read_pixel(fb, p));
+        }
+        blend_argb(tmp, src, argb, (uint32_t)n, alpha);
+        for (int i = 0; i < n; i++, dst += fb->bytes_per_pixel) {
+            fb_write_pixel(fb, dst, fb_pack_color(fb, tmp[i]));
+        }
+
+        if (src) {
+            src += n;
+        }
+        count -= n;
     }
 }
+
+void fb_blend_rect(Framebuffer *fb, int x, int y, int w, int h, uint32_t color, uint8_t alpha) {
+    uint32_t argb = blit_premultiply(color, alpha);
+    FbRect r = { x, y, w, h };
+
+    if (alpha == 255) {
+        fb_draw_rect(fb, x, y, w, h, color);
+        return;
+    }
+    if (alpha == 0 || !rect_intersect(&r, &r, &fb->clip)) {
+        return;
+    }
+
+    for (int yy = 0; yy < r.h; yy++) {
+        uint8_t *row = fb_target_row(fb, r.y + yy);
+
+        fb_blend_span(fb, row + ((uint32_t)r.x * fb->bytes_per_pixel), NULL, argb, r.w, 255);
+    }
+
+    fb_mark_dirty(fb, r.x, r.y, r.w, r.h);
+}
+
+void fb_blend_image(Framebuffer *fb, int x, int y, int w, int h, const uint32_t *argb, int stride, uint8_t alpha) {
+    FbRect r = { x, y, w, h };
+
+    if (alpha == 0 || !rect_intersect(&r, &r, &fb->clip)) {
+        return;
+    }
+
+    argb += ((r.y - y) * stride) + (r.x - x);
+    for (int yy = 0; yy < r.h; yy++, argb += stride) {
+        uint8_t *row = fb_target_row(fb, r.y + yy);
+
+        fb_blend_span(fb, row + ((uint32_t)r.x * fb->bytes_per_pixel), argb, 0, r.w, alpha);
+    }
+
+    fb_mark_dirty(fb, r.x, r.y, r.w, r.h);
+}
+
+void fb_draw_char(Framebuffer *fb, int x, int y, char c, uint32_t color) {
+    char text[2];
+
+    text[0] = c;
+    text[1] = '\0';
+    text_draw(fb, text_font(FONT_8X8), x, y, text, color);
+}
+
+void fb_draw_text(Framebuffer *fb, int x, int y, const char *text, uint32_t color) {
+    text_draw(fb, text_font(FONT_8X8), x, y, text, color);
+}
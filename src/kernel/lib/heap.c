@@ -0,0 +1,69 @@
+#include "heap.h"
+#include "debug.h"
+#include "spinlock.h"
+#include <stddef.h>
+
+static uint32_t heap_base = 0;
+static uint32_t heap_next = 0;
+static uint32_t heap_limit = 0;
+static Spinlock heap_lock = SPINLOCK_INIT;
+static void *free_pages = NULL;     /* Linked through each page's first word */
+
+void heap_init(uint32_t start, uint32_t end) {
+    heap_base = start;
+    heap_next = start;
+    heap_limit = end;
+}
+
+void *heap_alloc(uint32_t size, uint32_t align) {
+    uint32_t flags;
+    uint32_t addr;
+
+    if (align == 0) {
+        align = 4;
+    }
+
+    /* Threads on other CPUs, or preempted ones, race for heap_next */
+    flags = spin_lock_irqsave(&heap_lock);
+    addr = (heap_next + align - 1) & ~(align - 1);
+    if (addr < heap_next || addr > heap_limit || size > heap_limit - addr) {
+        spin_unlock_irqrestore(&heap_lock, flags);
+        ERROR("Heap exhausted");
+        return NULL;
+    }
+
+    heap_next = addr + size;
+    spin_unlock_irqrestore(&heap_lock, flags);
+    return (void *)(uintptr_t)addr;
+}
+
+uint32_t heap_used(void) {
+    return heap_next - heap_base;
+}
+
+void *heap_alloc_page(void) {
+    uint32_t flags = spin_lock_irqsave(&heap_lock);
+    void *page = free_pages;
+
+    if (page) {
+        free_pages = *(void **)page;
+    }
+    spin_unlock_irqrestore(&heap_lock, flags);
+
+    if (!page) {
+        page = heap_alloc(HEAP_PAGE_SIZE, HEAP_PAGE_SIZE);
+    }
+    return page;
+}
+
+void heap_free_page(void *page) {
+    uint32_t flags;
+
+    if (!page) {
+        return;
+    }
+    flags = spin_lock_irqsave(&heap_lock);
+    *(void **)page = free_pages;
+    free_pages = page;
+    spin_unlock_irqrestore(&heap_lock, flags);
+}
@@ -0,0 +1,324 @@
+#define LOG_CATEGORY FB
+
+#include "image.h"
+#include "fat12.h"
+#include "heap.h"
+#include "string.h"
+#include "debug.h"
+#include <stddef.h>
+
+#define BMP_FILE_HEADER     14
+#define BMP_INFO_MIN        40
+#define BMP_BI_RGB          0
+#define BMP_BI_BITFIELDS    3
+#define BMP_INFO_MASKS      52      /* Info headers this size or larger hold the masks */
+
+typedef struct {
+    FileHandle file;
+    uint8_t buf[IMAGE_WINDOW];
+    uint32_t pos;           /* Next unread byte in buf */
+    uint32_t len;           /* Valid bytes in buf */
+} ImageStream;
+
+typedef struct {
+    char name[13];          /* 8.3 name as given */
+    Framebuffer surface;    /* Also records the pixel format it was decoded to */
+} ImageCacheEntry;
+
+static ImageCacheEntry cache[IMAGE_CACHE_SIZE];
+static int cache_count = 0;
+
+/* Pixels of a decode that failed part way; the heap cannot take them back,
+   so the next decode that fits reuses them */
+static void *spare_pixels = NULL;
+static uint32_t spare_size = 0;
+
+/* Keep any unread tail and top the window up; returns the bytes available */
+static uint32_t stream_fill(ImageStream *s) {
+    uint32_t left = s->len - s->pos;
+    int n;
+
+    if (s->pos > 0) {
+        memmove(s->buf, s->buf + s->pos, left);
+        s->pos = 0;
+        s->len = left;
+    }
+    n = fat12_read(&s->file, s->buf + left, IMAGE_WINDOW - left);
+    if (n > 0) {
+        s->len += (uint32_t)n;
+    }
+    return s->len;
+}
+
+/* At least need contiguous bytes at buf + pos, or -1 at end of file */
+static int stream_need(ImageStream *s, uint32_t need) {
+    if (s->len - s->pos < need && stream_fill(s) < need) {
+        return -1;
+    }
+    return 0;
+}
+
+static int stream_read(ImageStream *s, void *dst, uint32_t size) {
+    uint8_t *out = dst;
+
+    while (size > 0) {
+        uint32_t n;
+
+        if (s->pos == s->len && stream_need(s, 1) < 0) {
+            return -1;
+        }
+        n = s->len - s->pos;
+        if (n > size) {
+            n = size;
+        }
+        memcpy(out, s->buf + s->pos, n);
+        s->pos += n;
+        out += n;
+        size -= n;
+    }
+    return 0;
+}
+
+static int stream_skip(ImageStream *s, uint32_t size) {
+    while (size > 0) {
+        uint32_t n;
+
+        if (s->pos == s->len && stream_need(s, 1) < 0) {
+            return -1;
+        }
+        n = s->len - s->pos;
+        if (n > size) {
+            n = size;
+        }
+        s->pos += n;
+        size -= n;
+    }
+    return 0;
+}
+
+static uint16_t le16(const uint8_t *p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t le32(const uint8_t *p) {
+    return p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/* Convert one file row into a surface row, a run of whole pixels at a time */
+static int decode_row(ImageStream *s, const Framebuffer *fb, uint8_t *dst, int width,
+                      int bmp_bytes, const uint32_t *palette) {
+    int x = 0;
+
+    while (x < width) {
+        const uint8_t *p;
+        int run;
+
+        if (stream_need(s, (uint32_t)bmp_bytes) < 0) {
+            return -1;
+        }
+        p = s->buf + s->pos;
+        run = (int)((s->len - s->pos) / (uint32_t)bmp_bytes);
+        if (run > width - x) {
+            run = width - x;
+        }
+
+        for (int i = 0; i < run; i++, p += bmp_bytes, dst += fb->bytes_per_pixel) {
+            uint32_t rgb = (bmp_bytes == 1) ? palette[*p] :
+                           ((uint32_t)p[2] << 16) | ((uint32_t)p[1] << 8) | p[0];
+
+            fb_write_pixel(fb, dst, fb_pack_color(fb, rgb));
+        }
+        s->pos += (uint32_t)(run * bmp_bytes);
+        x += run;
+    }
+    return 0;
+}
+
+static int decode_bmp(ImageStream *s, const Framebuffer *format, Framebuffer *out) {
+    static uint32_t palette[256];
+    uint8_t hdr[BMP_FILE_HEADER + BMP_INFO_MIN];
+    uint32_t pixel_offset, info_size, compression, colors, consumed, size;
+    int32_t width, height;
+    int bpp, bmp_bytes, top_down, stride;
+    void *pixels;
+
+    if (stream_read(s, hdr, sizeof(hdr)) < 0 || hdr[0] != 'B' || hdr[1] != 'M') {
+        WARN("Not a BMP file");
+        return -1;
+    }
+
+    pixel_offset = le32(hdr + 10);
+    info_size = le32(hdr + 14);
+    width = (int32_t)le32(hdr + 18);
+    height = (int32_t)le32(hdr + 22);
+    bpp = le16(hdr + 28);
+    compression = le32(hdr + 30);
+    colors = le32(hdr + 46);
+
+    top_down = height < 0;
+    if (top_down) {
+        height = -height;
+    }
+    if (info_size < BMP_INFO_MIN || width <= 0 || height <= 0 ||
+        width > IMAGE_MAX_DIM || height > IMAGE_MAX_DIM) {
+        WARN("Unsupported BMP header");
+        return -1;
+    }
+    if ((bpp != 8 && bpp != 24 && bpp != 32) ||
+        !(compression == BMP_BI_RGB || (compression == BMP_BI_BITFIELDS && bpp == 32 &&
+          (info_size == BMP_INFO_MIN || info_size >= BMP_INFO_MASKS)))) {
+        WARN("Unsupported BMP format: %d bpp, compression %u", bpp, compression);
+        return -1;
+    }
+
+    /* Rows are padded to 4 bytes; every one must be in the file before
+       any memory is spent on the surface */
+    stride = ((width * bpp) + 31) / 32 * 4;
+    if (pixel_offset > s->file.file_size ||
+        (uint32_t)stride * (uint32_t)height > s->file.file_size - pixel_offset) {
+        WARN("BMP shorter than its %dx%d pixels", width, height);
+        return -1;
+    }
+
+    consumed = sizeof(hdr);
+    if (compression == BMP_BI_BITFIELDS) {
+        uint8_t masks[12];
+
+        /* Red, green, blue: inside a V2+ info header, else right after it.
+           Only the usual BGRA order is accepted. */
+        if (stream_read(s, masks, sizeof(masks)) < 0) {
+            return -1;
+        }
+        consumed += sizeof(masks);
+        if (le32(masks) != 0x00FF0000u || le32(masks + 4) != 0x0000FF00u ||
+            le32(masks + 8) != 0x000000FFu) {
+            WARN("Unsupported BMP channel masks");
+            return -1;
+        }
+    }
+    if (BMP_FILE_HEADER + info_size > consumed) {
+        if (stream_skip(s, BMP_FILE_HEADER + info_size - consumed) < 0) {
+            return -1;
+        }
+        consumed = BMP_FILE_HEADER + info_size;
+    }
+
+    if (bpp == 8) {
+        if (colors == 0 || colors > 256) {
+            colors = 256;
+        }
+        memset(palette, 0, sizeof(palette));
+        for (uint32_t i = 0; i < colors; i++) {
+            uint8_t q[4];
+
+            if (stream_read(s, q, 4) < 0) {
+                return -1;
+            }
+            palette[i] = ((uint32_t)q[2] << 16) | ((uint32_t)q[1] << 8) | q[0];
+        }
+        consumed += colors * 4;
+    }
+
+    if (pixel_offset < consumed || stream_skip(s, pixel_offset - consumed) < 0) {
+        WARN("Bad BMP pixel offset");
+        return -1;
+    }
+
+    size = (uint32_t)width * (uint32_t)height * format->bytes_per_pixel;
+    if (spare_pixels && spare_size >= size) {
+        pixels = spare_pixels;
+        spare_pixels = NULL;
+        spare_size = 0;
+    } else {
+        pixels = heap_alloc(size, 16);
+    }
+    if (!pixels) {
+        ERROR("No memory for a %dx%d image", width, height);
+        return -1;
+    }
+    fb_init_surface(out, format, (uint16_t)width, (uint16_t)height, pixels);
+
+    /* Stored bottom-up unless height was negative */
+    bmp_bytes = bpp / 8;
+    for (int row = 0; row < height; row++) {
+        int y = top_down ? row : height - 1 - row;
+
+        if (decode_row(s, out, fb_target_row(out, y), width, bmp_bytes, palette) < 0 ||
+            stream_skip(s, (uint32_t)(stride - (width * bmp_bytes))) < 0) {
+            WARN("BMP truncated at row %d", row);
+            if (size > spare_size) {
+                spare_pixels = pixels;
+                spare_size = size;
+            }
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int image_load_bmp(const char *filename, const Framebuffer *format, Framebuffer *out) {
+    static ImageStream stream;
+    int result;
+
+    if (fat12_open(filename, &stream.file) != 0) {
+        return -1;
+    }
+    stream.pos = 0;
+    stream.len = 0;
+
+    result = decode_bmp(&stream, format, out);
+    fat12_close(&stream.file);
+
+    if (result == 0) {
+        INFO("Decoded %s: %dx%d", filename, out->width, out->height);
+    }
+    return result;
+}
+
+static int name_equal(const char *a, const char *b) {
+    for (; *a && *b; a++, b++) {
+        char ca = (*a >= 'a' && *a <= 'z') ? (char)(*a - 'a' + 'A') : *a;
+        char cb = (*b >= 'a' && *b <= 'z') ? (char)(*b - 'a' + 'A') : *b;
+
+        if (ca != cb) {
+            return 0;
+        }
+    }
+    return *a == *b;
+}
+
+/* Same pixel layout, not just the same size: 15 and 16 bpp share two bytes */
+static int same_format(const Framebuffer *a, const Framebuffer *b) {
+    return a->ops == b->ops && a->bpp == b->bpp && a->bytes_per_pixel == b->bytes_per_pixel &&
+           a->red_pos == b->red_pos && a->red_loss == b->red_loss &&
+           a->green_pos == b->green_pos && a->green_loss == b->green_loss &&
+           a->blue_pos == b->blue_pos && a->blue_loss == b->blue_loss;
+}
+
+const Framebuffer *image_get(const char *filename, const Framebuffer *format) {
+    ImageCacheEntry *e;
+
+    if (!filename || strlen(filename) >= sizeof(cache[0].name)) {
+        return NULL;
+    }
+
+    for (int i = 0; i < cache_count; i++) {
+        if (same_format(&cache[i].surface, format) && name_equal(cache[i].name, filename)) {
+            return &cache[i].surface;
+        }
+    }
+
+    /* Surfaces come from the bump heap and are never freed, so no eviction */
+    if (cache_count == IMAGE_CACHE_SIZE) {
+        WARN("Image cache full, %s not loaded", filename);
+        return NULL;
+    }
+
+    e = &cache[cache_count];
+    if (image_load_bmp(filename, format, &e->surface) < 0) {
+        return NULL;
+    }
+    memcpy(e->name, filename, strlen(filename) + 1);
+    cache_count++;
+    return &e->surface;
+}
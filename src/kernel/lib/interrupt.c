@@ -0,0 +1,249 @@
+#include "interrupt.h"
+#include "io.h"
+#include "debug.h"
+#include "thread.h"
+#include "apic.h"
+#include "paging.h"
+#include "cpu.h"
+#include "spinlock.h"
+#include <stddef.h>
+
+#define PIC1_CMD        0x20
+#define PIC1_DATA       0x21
+#define PIC2_CMD        0xA0
+#define PIC2_DATA       0xA1
+
+#define PIC_ICW1_INIT   0x11    /* Edge triggered, cascade, ICW4 follows */
+#define PIC_ICW4_8086   0x01
+#define PIC_READ_ISR    0x0B
+#define PIC_EOI         0x20
+
+#define CODE_SEL        0x08
+#define IDT_GATE_INT32  0x8E    /* Present, ring 0, 32-bit interrupt gate */
+#define ISR_STUB_SIZE   16      /* Must match isr.S */
+#define EXCEPTION_PAGE_FAULT 14
+
+typedef struct {
+    uint16_t offset_low;
+    uint16_t selector;
+    uint8_t zero;
+    uint8_t type_attr;
+    uint16_t offset_high;
+} __attribute__((packed)) IdtEntry;
+
+typedef struct {
+    uint16_t limit;
+    uint32_t base;
+} __attribute__((packed)) IdtDescriptor;
+
+extern uint8_t isr_stub_table[];
+
+static IdtEntry idt[INTERRUPT_VECTORS] __attribute__((aligned(8)));
+static IrqHandler irq_handlers[IRQ_COUNT];
+static IrqHandler local_handlers[LOCAL_VECTOR_COUNT];
+static uint16_t irq_mask_bits = 0xFFFF;
+static Spinlock pic_lock = SPINLOCK_INIT;  /* Mask updates may come from any CPU */
+
+static const char *const exception_names[32] = {
+    "Divide error", "Debug", "NMI", "Breakpoint", "Overflow", "Bound range",
+    "Invalid opcode", "Device not available", "Double fault", "Coprocessor overrun",
+    "Invalid TSS", "Segment not present", "Stack fault", "General protection",
+    "Page fault", "Reserved", "x87 FPU error", "Alignment check", "Machine check",
+    "SIMD exception"
+};
+
+static void idt_set_gate(int vector, uint32_t handler) {
+    idt[vector].offset_low = (uint16_t)(handler & 0xFFFF);
+    idt[vector].selector = CODE_SEL;
+    idt[vector].zero = 0;
+    idt[vector].type_attr = IDT_GATE_INT32;
+    idt[vector].offset_high = (uint16_t)(handler >> 16);
+}
+
+static void pic_write_mask(void) {
+    outb(PIC1_DATA, (uint8_t)(irq_mask_bits & 0xFF));
+    outb(PIC2_DATA, (uint8_t)(irq_mask_bits >> 8));
+}
+
+void pic_set_vector_base(uint8_t master, uint8_t slave) {
+    outb(PIC1_CMD, PIC_ICW1_INIT);
+    io_wait();
+    outb(PIC2_CMD, PIC_ICW1_INIT);
+    io_wait();
+    outb(PIC1_DATA, master);
+    io_wait();
+    outb(PIC2_DATA, slave);
+    io_wait();
+    outb(PIC1_DATA, 1u << IRQ_CASCADE);
+    io_wait();
+    outb(PIC2_DATA, IRQ_CASCADE);
+    io_wait();
+    outb(PIC1_DATA, PIC_ICW4_8086);
+    io_wait();
+    outb(PIC2_DATA, PIC_ICW4_8086);
+    io_wait();
+
+    /* Initialization clears the mask registers */
+    pic_write_mask();
+}
+
+/* Move the PIC vectors off the CPU exceptions (BIOS leaves them at 0x08) */
+static void pic_remap(void) {
+    irq_mask_bits = 0xFFFF & ~(1u << IRQ_CASCADE);
+    pic_set_vector_base(IRQ_BASE, IRQ_BASE + 8);
+}
+
+static uint16_t pic_read_isr(void) {
+    outb(PIC1_CMD, PIC_READ_ISR);
+    outb(PIC2_CMD, PIC_READ_ISR);
+    return (uint16_t)((inb(PIC2_CMD) << 8) | inb(PIC1_CMD));
+}
+
+void interrupt_init(void) {
+    IdtDescriptor desc;
+
+    for (int i = 0; i < INTERRUPT_VECTORS; i++) {
+        idt_set_gate(i, (uint32_t)(uintptr_t)(isr_stub_table + (i * ISR_STUB_SIZE)));
+    }
+
+    pic_remap();
+
+    desc.limit = sizeof(idt) - 1;
+    desc.base = (uint32_t)(uintptr_t)idt;
+    __asm__ volatile ("lidt %0" : : "m"(desc));
+
+    INFO("IDT loaded, PIC remapped");
+}
+
+void interrupt_init_ap(void) {
+    IdtDescriptor desc;
+
+    desc.limit = sizeof(idt) - 1;
+    desc.base = (uint32_t)(uintptr_t)idt;
+    __asm__ volatile ("lidt %0" : : "m"(desc));
+}
+
+void irq_set_handler(int irq, IrqHandler handler) {
+    uint32_t flags;
+
+    if (irq < 0 || irq >= IRQ_COUNT) {
+        return;
+    }
+    flags = irq_save();
+    irq_handlers[irq] = handler;
+    irq_restore(flags);
+}
+
+void local_irq_set_handler(int vector, IrqHandler handler) {
+    if (vector < LOCAL_VECTOR_BASE || vector >= LOCAL_VECTOR_BASE + LOCAL_VECTOR_COUNT) {
+        return;
+    }
+    local_handlers[vector - LOCAL_VECTOR_BASE] = handler;
+}
+
+void irq_mask(int irq) {
+    uint32_t flags;
+
+    if (irq < 0 || irq >= IRQ_COUNT) {
+        return;
+    }
+    flags = spin_lock_irqsave(&pic_lock);
+    irq_mask_bits |= (uint16_t)(1u << irq);
+    pic_write_mask();
+    spin_unlock_irqrestore(&pic_lock, flags);
+}
+
+void irq_unmask(int irq) {
+    uint32_t flags;
+
+    if (irq < 0 || irq >= IRQ_COUNT) {
+        return;
+    }
+    flags = spin_lock_irqsave(&pic_lock);
+    irq_mask_bits &= (uint16_t)~(1u << irq);
+    pic_write_mask();
+    spin_unlock_irqrestore(&pic_lock, flags);
+}
+
+static void exception_fatal(const InterruptFrame *frame, uint32_t cr2) {
+    const char *name = NULL;
+
+    if (frame->vector < 32) {
+        name = exception_names[frame->vector];
+    }
+
+    panic("CPU exception %u (%s) at EIP %08x, error %08x, CR2 %08x",
+          frame->vector, name ? name : "unknown", frame->eip, frame->error_code, cr2);
+}
+
+/* Missing pages in a demand-paged window are filled in by its handler,
+   which may sleep on the disk. That is only safe in thread context, so
+   faults taken with interrupts off stay fatal, as does anything outside
+   a window; both are decided before interrupts come back on. */
+static int page_fault(const InterruptFrame *frame, uint32_t addr) {
+    int result;
+
+    if (!(frame->eflags & EFLAGS_IF) || !paging_fault_claimed(addr, frame->error_code)) {
+        return -1;
+    }
+    interrupts_enable();
+    result = paging_fault(addr, frame->error_code);
+    interrupts_disable();
+    return result;
+}
+
+/* Called from isr_common with interrupts disabled */
+void interrupt_dispatch(InterruptFrame *frame) {
+    int irq;
+
+    if (frame->vector < IRQ_BASE) {
+        /* Read CR2 first: another fault while handling this one replaces it */
+        uint32_t cr2 = read_cr2();
+
+        if (frame->vector == EXCEPTION_PAGE_FAULT && page_fault(frame, cr2) == 0) {
+            return;
+        }
+        exception_fatal(frame, cr2);
+        return;
+    }
+
+    if (frame->vector >= LOCAL_VECTOR_BASE) {
+        IrqHandler handler;
+
+        /* Spurious APIC interrupts must not be acknowledged */
+        if (frame->vector == APIC_SPURIOUS_VECTOR ||
+            frame->vector >= LOCAL_VECTOR_BASE + LOCAL_VECTOR_COUNT) {
+            return;
+        }
+        handler = local_handlers[frame->vector - LOCAL_VECTOR_BASE];
+        if (handler) {
+            handler(frame);
+        }
+        apic_eoi();
+        thread_preempt();
+        return;
+    }
+
+    irq = (int)(frame->vector - IRQ_BASE);
+
+    /* IRQ 7/15 fire spuriously when a request vanishes; those get no EOI */
+    if ((irq == 7 || irq == 15) && !(pic_read_isr() & (1u << irq))) {
+        if (irq == 15) {
+            outb(PIC1_CMD, PIC_EOI);  /* The master did see the cascade */
+        }
+        return;
+    }
+
+    if (irq_handlers[irq]) {
+        irq_handlers[irq](frame);
+    }
+
+    if (irq >= 8) {
+        outb(PIC2_CMD, PIC_EOI);
+    }
+    outb(PIC1_CMD, PIC_EOI);
+
+    /* Switch away only after the EOI, or the PIC would hold off this IRQ
+       line until the preempted thread ran again */
+    thread_preempt();
+}
@@ -0,0 +1,32 @@
+#include "keyboard.h"
+#include "interrupt.h"
+#include "event.h"
+#include "io.h"
+
+#define PS2_STATUS 0x64
+#define PS2_DATA 0x60
+
+#define PS2_STATUS_OUT 0x01
+#define PS2_STATUS_AUX 0x20
+
+/* Draining keyboard bytes also keeps the controller free for mouse data */
+static void keyboard_irq(InterruptFrame *frame) {
+    uint8_t status = inb(PS2_STATUS);
+
+    (void)frame;
+    if (!(status & PS2_STATUS_OUT) || (status & PS2_STATUS_AUX)) {
+        return;
+    }
+
+    {
+        Event ev = { .type = EVENT_KEY };
+
+        ev.key.scancode = inb(PS2_DATA);
+        event_post(&ev);
+    }
+}
+
+void keyboard_init(void) {
+    irq_set_handler(IRQ_KEYBOARD, keyboard_irq);
+    irq_unmask(IRQ_KEYBOARD);
+}
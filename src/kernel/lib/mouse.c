@@ -1,5 +1,12 @@
+#define LOG_CATEGORY MOUSE
+
 #include "io.h"
 #include "mouse.h"
+#include "interrupt.h"
+#include "event.h"
+#include "timer.h"
+#include "debug.h"
+#include "trace.h"
 
 #define PS2_STATUS 0x64
 #define PS2_DATA 0x60
@@ -8,16 +15,76 @@
 #define PS2_STATUS_IN 0x02
 #define PS2_STATUS_AUX 0x20
 
-static void ps2_wait_input(void) {
-    while (inb(PS2_STATUS) & PS2_STATUS_IN) {
+#define PS2_TIMEOUT 100000      /* io_wait iterations, roughly 100 ms */
+#define PS2_BYTE_TIME 2000      /* Longer than one byte takes on the wire */
+#define PS2_DRAIN_MAX 16
+
+/* Mouse commands (sent through the 0xD4 aux prefix) */
+#define MOUSE_CMD_SET_RESOLUTION    0xE8
+#define MOUSE_CMD_GET_ID            0xF2
+#define MOUSE_CMD_SET_RATE          0xF3
+#define MOUSE_CMD_ENABLE            0xF4
+#define MOUSE_CMD_DISABLE           0xF5
+#define MOUSE_CMD_DEFAULTS          0xF6
+#define MOUSE_ACK                   0xFA
+
+#define MOUSE_ID_WHEEL              0x03
+
+/* Packet byte 0 */
+#define PKT_BUTTONS     0x07
+#define PKT_ALWAYS_ONE  0x08
+#define PKT_X_SIGN      0x10
+#define PKT_Y_SIGN      0x20
+#define PKT_X_OVERFLOW  0x40
+#define PKT_Y_OVERFLOW  0x80
+
+/* Bytes of one packet arrive about 1 ms apart; a gap of half a packet
+   period means a packet ended early and we lost sync */
+#define PACKET_GAP_MIN_MS   2
+
+static uint8_t packet_size = 3;
+static uint8_t current_rate = 100;
+static uint8_t current_resolution = 2;
+static uint32_t packet_gap_ms = 1000 / 100 / 2;
+
+static void set_rate(uint8_t hz) {
+    current_rate = hz;
+    packet_gap_ms = 1000u / hz / 2;
+    if (packet_gap_ms < PACKET_GAP_MIN_MS) {
+        packet_gap_ms = PACKET_GAP_MIN_MS;
+    }
+}
+
+/* Bit 3 alone matches an eighth of all bytes. Overflow never happens at
+   these rates, so a byte claiming it is taken for a delta, not a header. */
+static int header_valid(uint8_t b) {
+    return (b & PKT_ALWAYS_ONE) && !(b & (PKT_X_OVERFLOW | PKT_Y_OVERFLOW));
+}
+
+/* A delta byte's top bit matches the header's sign bit unless the mouse
+   moved more than 127 counts in one sample */
+static int delta_agrees(uint8_t delta, uint8_t header, uint8_t sign_bit) {
+    return ((delta & 0x80) != 0) == ((header & sign_bit) != 0);
+}
+
+static int ps2_wait_input(void) {
+    for (int i = 0; i < PS2_TIMEOUT; i++) {
+        if (!(inb(PS2_STATUS) & PS2_STATUS_IN)) {
+            return 0;
+        }
         io_wait();
     }
+    return -1;
 }
 
-static void ps2_wait_output(void) {
-    while (!(inb(PS2_STATUS) & PS2_STATUS_OUT)) {
+static int ps2_wait_output(void) {
+    for (int i = 0; i < PS2_TIMEOUT; i++) {
+        if (inb(PS2_STATUS) & PS2_STATUS_OUT) {
+            return 0;
+        }
         io_wait();
     }
+    return -1;
 }
 
 static void ps2_write(uint8_t value) {
@@ -35,57 +102,207 @@ static uint8_t ps2_read(void) {
     return inb(PS2_DATA);
 }
 
-static void mouse_write(uint8_t value) {
+/* Read a byte from the aux device, skipping any keyboard bytes in the way */
+static int mouse_read(uint8_t *value) {
+    for (int tries = 0; tries < 16; tries++) {
+        uint8_t status;
+
+        if (ps2_wait_output() < 0) {
+            return -1;
+        }
+        status = inb(PS2_STATUS);
+        *value = inb(PS2_DATA);
+        if (status & PS2_STATUS_AUX) {
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static int mouse_write(uint8_t value) {
+    uint8_t ack;
+
     ps2_write_cmd(0xD4);
     ps2_write(value);
-    ps2_read();
+    if (mouse_read(&ack) < 0 || ack != MOUSE_ACK) {
+        return -1;
+    }
+    return 0;
 }
 
-void mouse_init(void) {
-    ps2_write_cmd(0xA8);
-    ps2_write_cmd(0x20);
+/* Throw away aux bytes left in the 8042 output buffer: the rest of a packet
+   sent before MOUSE_CMD_DISABLE took effect, and the ACK queued behind it.
+   A keyboard byte ends the drain, so its own handler still gets it. */
+static void mouse_drain(void) {
+    for (int count = 0; count < PS2_DRAIN_MAX; count++) {
+        int i;
 
-    {
-        uint8_t status = ps2_read();
-        status |= 0x02;
-        ps2_write_cmd(0x60);
-        ps2_write(status);
+        for (i = 0; i < PS2_BYTE_TIME && !(inb(PS2_STATUS) & PS2_STATUS_OUT); i++) {
+            io_wait();
+        }
+        if (i == PS2_BYTE_TIME || !(inb(PS2_STATUS) & PS2_STATUS_AUX)) {
+            return;
+        }
+        (void)inb(PS2_DATA);
     }
+}
 
-    mouse_write(0xF6);
-    mouse_write(0xF4);
+static int mouse_write_arg(uint8_t cmd, uint8_t arg) {
+    if (mouse_write(cmd) < 0) {
+        return -1;
+    }
+    return mouse_write(arg);
 }
 
-int mouse_poll(MouseState *state) {
-    static uint8_t packet[3];
-    static uint8_t index = 0;
-    uint8_t status = inb(PS2_STATUS);
+static int rate_supported(uint8_t hz) {
+    static const uint8_t rates[] = { 10, 20, 40, 60, 80, 100, 200 };
+
+    for (unsigned i = 0; i < sizeof(rates); i++) {
+        if (rates[i] == hz) {
+            return 1;
+        }
+    }
+    return 0;
+}
 
-    if (!(status & PS2_STATUS_OUT)) {
+/* The IntelliMouse knock: rates 200, 100, 80 switch a wheel mouse to ID 3 */
+static int mouse_detect_wheel(void) {
+    uint8_t id = 0;
+
+    if (mouse_write_arg(MOUSE_CMD_SET_RATE, 200) < 0 ||
+        mouse_write_arg(MOUSE_CMD_SET_RATE, 100) < 0 ||
+        mouse_write_arg(MOUSE_CMD_SET_RATE, 80) < 0) {
         return 0;
     }
-    if (!(status & PS2_STATUS_AUX)) {
+    if (mouse_write(MOUSE_CMD_GET_ID) < 0 || mouse_read(&id) < 0) {
         return 0;
     }
+    return id == MOUSE_ID_WHEEL;
+}
 
-    packet[index++] = inb(PS2_DATA);
-    if (index < 3) {
-        return 0;
+/* IRQ12: assemble packets byte by byte and post one EVENT_MOUSE per packet;
+   the event queue merges consecutive motion into a single pending event */
+static void mouse_irq(InterruptFrame *frame) {
+    static uint8_t packet[4];
+    static uint8_t index = 0;
+    static uint32_t last_byte_ms = 0;
+    uint8_t status = inb(PS2_STATUS);
+    uint8_t data;
+    uint32_t now;
+
+    (void)frame;
+    if (!(status & PS2_STATUS_OUT) || !(status & PS2_STATUS_AUX)) {
+        return;
+    }
+    data = inb(PS2_DATA);
+
+    now = timer_ms();
+    if (index > 0 && now - last_byte_ms > packet_gap_ms) {
+        index = 0;  /* Stale partial packet */
+    }
+    last_byte_ms = now;
+
+    /* A delta that contradicts its sign bit means the header was really a
+       delta byte: start over, trying this byte as the header */
+    if ((index == 1 && !delta_agrees(data, packet[0], PKT_X_SIGN)) ||
+        (index == 2 && !delta_agrees(data, packet[0], PKT_Y_SIGN))) {
+        index = 0;
+    }
+
+    /* Drop single bytes until one can be a header */
+    if (index == 0 && !header_valid(data)) {
+        return;
+    }
+
+    packet[index++] = data;
+    if (index < packet_size) {
+        return;
     }
     index = 0;
 
-    if (!(packet[0] & 0x08)) {
-        return 0;
+    {
+        Event ev = { .type = EVENT_MOUSE };
+
+        /* Deltas are 9-bit two's complement with the sign in byte 0 */
+        ev.mouse.dx = (int16_t)(packet[1] - ((packet[0] << 4) & 0x100));
+        ev.mouse.dy = (int16_t)-(packet[2] - ((packet[0] << 3) & 0x100));
+        if (packet_size == 4) {
+            /* Low nibble is the signed wheel count */
+            ev.mouse.dz = (int16_t)((int8_t)(packet[3] << 4) >> 4);
+        }
+        ev.mouse.buttons = packet[0] & PKT_BUTTONS;
+        TRACE_MARK(TRACE_MOUSE_PACKET, (uint16_t)ev.mouse.dx, (uint16_t)ev.mouse.dy);
+        event_post(&ev);
+    }
+}
+
+int mouse_configure(uint8_t sample_rate, uint8_t resolution) {
+    int result = 0;
+
+    if (!rate_supported(sample_rate) || resolution > MOUSE_RES_8_PER_MM) {
+        WARN("Unsupported mouse rate or resolution");
+        return -1;
     }
 
+    /* Keep the IRQ handler from eating the ACKs while we talk to the device */
+    irq_mask(IRQ_MOUSE);
+    mouse_write(MOUSE_CMD_DISABLE);
+    mouse_drain();
+    if (mouse_write_arg(MOUSE_CMD_SET_RATE, sample_rate) < 0 ||
+        mouse_write_arg(MOUSE_CMD_SET_RESOLUTION, resolution) < 0) {
+        WARN("Mouse rejected configuration");
+        result = -1;
+    } else {
+        set_rate(sample_rate);
+        current_resolution = resolution;
+    }
+    mouse_write(MOUSE_CMD_ENABLE);
+    irq_unmask(IRQ_MOUSE);
+
+    return result;
+}
+
+void mouse_init(void) {
+    ps2_write_cmd(0xA8);
+    ps2_write_cmd(0x20);
+
     {
-        int dx = (int8_t)packet[1];
-        int dy = (int8_t)packet[2];
+        uint8_t status = ps2_read();
+        status |= 0x02;
+        ps2_write_cmd(0x60);
+        ps2_write(status);
+    }
 
-        state->x += dx;
-        state->y -= dy;
-        state->buttons = packet[0] & 0x07;
+    mouse_write(MOUSE_CMD_DEFAULTS);
+
+    if (mouse_detect_wheel()) {
+        packet_size = 4;
+        INFO("IntelliMouse wheel detected");
+    }
+
+    /* The knock above changed the rate, so always program ours afterwards */
+    if (mouse_write_arg(MOUSE_CMD_SET_RATE, MOUSE_DEFAULT_RATE) < 0 ||
+        mouse_write_arg(MOUSE_CMD_SET_RESOLUTION, MOUSE_DEFAULT_RESOLUTION) < 0) {
+        WARN("Mouse kept its default rate");
+    } else {
+        set_rate(MOUSE_DEFAULT_RATE);
+        current_resolution = MOUSE_DEFAULT_RESOLUTION;
     }
+    mouse_write(MOUSE_CMD_ENABLE);
+
+    /* Only hook the IRQ now, or the handler would swallow the ACKs above */
+    irq_set_handler(IRQ_MOUSE, mouse_irq);
+    irq_unmask(IRQ_MOUSE);
+}
+
+int mouse_has_wheel(void) {
+    return packet_size == 4;
+}
+
+uint8_t mouse_sample_rate(void) {
+    return current_rate;
+}
 
-    return 1;
+uint8_t mouse_resolution(void) {
+    return current_resolution;
 }
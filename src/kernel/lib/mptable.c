@@ -0,0 +1,89 @@
+#include "mptable.h"
+#include "bios_tables.h"
+#include "string.h"
+#include "debug.h"
+#include <stddef.h>
+
+#define MP_ENTRY_PROCESSOR  0
+#define MP_CPU_ENABLED      0x01
+
+typedef struct {
+    char signature[4];          /* "_MP_" */
+    uint32_t config_table;
+    uint8_t length;             /* In 16-byte units */
+    uint8_t spec_revision;
+    uint8_t checksum;
+    uint8_t features[5];        /* features[0] != 0: a default configuration, no table */
+} __attribute__((packed)) MpFloating;
+
+typedef struct {
+    char signature[4];          /* "PCMP" */
+    uint16_t base_length;
+    uint8_t spec_revision;
+    uint8_t checksum;
+    char oem_id[8];
+    char product_id[12];
+    uint32_t oem_table;
+    uint16_t oem_table_size;
+    uint16_t entry_count;
+    uint32_t lapic_address;
+    uint16_t ext_length;
+    uint8_t ext_checksum;
+    uint8_t reserved;
+} __attribute__((packed)) MpConfig;
+
+typedef struct {
+    uint8_t type;
+    uint8_t apic_id;
+    uint8_t apic_version;
+    uint8_t flags;
+    uint32_t signature;
+    uint32_t features;
+    uint32_t reserved[2];
+} __attribute__((packed)) MpProcessor;
+
+static int floating_valid(const void *table) {
+    const MpFloating *mp = table;
+
+    return mp->length && bios_checksum(mp, mp->length * 16u) == 0;
+}
+
+int mptable_cpus(uint8_t *apic_ids, int max) {
+    const MpFloating *mp = bios_tables_find("_MP_", 4, floating_valid);
+    const MpConfig *config;
+    const uint8_t *p, *end;
+    int count = 0;
+
+    if (!mp) {
+        return 0;
+    }
+    if (mp->features[0] != 0 || !mp->config_table) {
+        WARN("MP default configuration %u not supported", mp->features[0]);
+        return 0;
+    }
+
+    config = (const MpConfig *)(uintptr_t)mp->config_table;
+    if (memcmp(config->signature, "PCMP", 4) != 0 || bios_checksum(config, config->base_length) != 0) {
+        WARN("MP configuration table is invalid");
+        return 0;
+    }
+
+    /* Processor entries are 20 bytes, every other base entry type is 8 */
+    p = (const uint8_t *)(config + 1);
+    end = (const uint8_t *)config + config->base_length;
+    for (uint16_t i = 0; i < config->entry_count && p < end; i++) {
+        if (p[0] == MP_ENTRY_PROCESSOR) {
+            const MpProcessor *cpu = (const MpProcessor *)p;
+
+            if ((cpu->flags & MP_CPU_ENABLED) && count < max) {
+                apic_ids[count++] = cpu->apic_id;
+            }
+            p += sizeof(MpProcessor);
+        } else {
+            p += 8;
+        }
+    }
+
+    INFO("MP table lists %d processors", count);
+    return count;
+}
@@ -0,0 +1,46 @@
+#include "mutex.h"
+#include "debug.h"
+#include <stddef.h>
+
+void mutex_init(Mutex *m) {
+    m->lock.locked = 0;
+    m->owner = NULL;
+    wait_queue_init(&m->waiters);
+}
+
+void mutex_lock(Mutex *m) {
+    uint32_t flags = spin_lock_irqsave(&m->lock);
+    Thread *self = thread_current();
+
+    if (m->owner == self) {
+        panic("Mutex taken twice by %s", self->name);
+    }
+    while (m->owner) {
+        wait_queue_sleep(&m->waiters, &m->lock);
+    }
+    m->owner = self;
+    spin_unlock_irqrestore(&m->lock, flags);
+}
+
+int mutex_trylock(Mutex *m) {
+    uint32_t flags = spin_lock_irqsave(&m->lock);
+    int taken = 0;
+
+    if (!m->owner) {
+        m->owner = thread_current();
+        taken = 1;
+    }
+    spin_unlock_irqrestore(&m->lock, flags);
+    return taken;
+}
+
+void mutex_unlock(Mutex *m) {
+    uint32_t flags = spin_lock_irqsave(&m->lock);
+
+    m->owner = NULL;
+    wait_queue_wake_one(&m->waiters);
+    spin_unlock_irqrestore(&m->lock, flags);
+
+    /* A higher-priority waiter should get the lock now, not at the next tick */
+    thread_preempt();
+}
@@ -0,0 +1,368 @@
+#include "paging.h"
+#include "cpu.h"
+#include "heap.h"
+#include "smp.h"
+#include "string.h"
+#include "debug.h"
+#include <stddef.h>
+
+#define MSR_MTRRCAP         0xFE
+#define MSR_MTRR_PHYSBASE0  0x200
+#define MSR_MTRR_PHYSMASK0  0x201
+#define MSR_MTRR_DEF_TYPE   0x2FF
+#define MSR_PAT             0x277
+
+#define MTRRCAP_VCNT_MASK   0xFF
+#define MTRRCAP_WC          (1u << 10)
+#define MTRR_DEF_ENABLE     (1u << 11)
+#define MTRR_PHYSMASK_VALID (1u << 11)
+
+#define MEM_TYPE_WC         0x01
+
+/* PAT slot 1 (selected by PWT alone) is reprogrammed from WT to WC */
+#define PAT_WC_INDEX_FLAGS  PDE_PWT
+
+/* One page directory of 4 MB pages covers the whole 32-bit space */
+static uint32_t page_directory[1024] __attribute__((aligned(4096)));
+
+static int paging_on = 0;
+
+typedef struct {
+    uint32_t base;
+    uint32_t size;
+    PageFaultHandler handler;
+} PagingWindow;
+
+static PagingWindow windows[PAGING_MAX_WINDOWS];
+static int window_count = 0;
+
+/* What the BSP changed, for paging_init_ap to replay */
+static uint64_t pat_value = 0;
+static int wc_mtrr_slot = -1;
+static uint64_t wc_mtrr_base, wc_mtrr_mask;
+
+static uint32_t phys_addr_bits(void) {
+    uint32_t eax, ebx, ecx, edx;
+
+    cpuid(0x80000000, &eax, &ebx, &ecx, &edx);
+    if (eax < 0x80000008) {
+        return 36;
+    }
+    cpuid(0x80000008, &eax, &ebx, &ecx, &edx);
+    return eax & 0xFF;
+}
+
+/* Cache-disable sequence required around PAT/MTRR updates (SDM 11.11.8) */
+static uint32_t cache_disable(void) {
+    uint32_t cr0 = read_cr0();
+
+    write_cr0((cr0 | CR0_CD) & ~CR0_NW);
+    wbinvd();
+    if (paging_on) {
+        write_cr3(read_cr3());
+    }
+    return cr0;
+}
+
+static void cache_enable(uint32_t cr0) {
+    wbinvd();
+    if (paging_on) {
+        write_cr3(read_cr3());
+    }
+    write_cr0(cr0);
+}
+
+static void pat_init(void) {
+    uint64_t pat;
+    uint32_t cr0;
+
+    if (!(cpu_features_edx() & CPUID_EDX_PAT)) {
+        return;
+    }
+
+    pat = rdmsr(MSR_PAT);
+    pat &= ~((uint64_t)0xFF << 8);
+    pat |= (uint64_t)MEM_TYPE_WC << 8;
+
+    cr0 = cache_disable();
+    wrmsr(MSR_PAT, pat);
+    cache_enable(cr0);
+    pat_value = pat;
+
+    INFO("PAT slot 1 set to write-combining");
+}
+
+static void mtrr_write(int slot, uint64_t base, uint64_t mask) {
+    uint64_t def_type;
+    uint32_t cr0;
+
+    cr0 = cache_disable();
+    def_type = rdmsr(MSR_MTRR_DEF_TYPE);
+    wrmsr(MSR_MTRR_DEF_TYPE, def_type & ~(uint64_t)MTRR_DEF_ENABLE);
+    wrmsr(MSR_MTRR_PHYSBASE0 + (slot * 2), base);
+    wrmsr(MSR_MTRR_PHYSMASK0 + (slot * 2), mask);
+    wrmsr(MSR_MTRR_DEF_TYPE, def_type);
+    cache_enable(cr0);
+}
+
+static int mtrr_set_write_combining(uint32_t base, uint32_t size) {
+    uint64_t cap, mask;
+    uint32_t vcnt, region;
+    int slot = -1;
+
+    if (!(cpu_features_edx() & CPUID_EDX_MTRR)) {
+        return -1;
+    }
+
+    cap = rdmsr(MSR_MTRRCAP);
+    if (!(cap & MTRRCAP_WC)) {
+        return -1;
+    }
+
+    /* Variable ranges must be a power of two in size and aligned to it */
+    region = 0x1000;
+    while (region < size && region != 0x80000000u) {
+        region <<= 1;
+    }
+    if (base & (region - 1)) {
+        WARN("LFB not aligned for a single MTRR range");
+        return -1;
+    }
+
+    vcnt = (uint32_t)(cap & MTRRCAP_VCNT_MASK);
+    for (uint32_t i = 0; i < vcnt; i++) {
+        if (!(rdmsr(MSR_MTRR_PHYSMASK0 + (i * 2)) & MTRR_PHYSMASK_VALID)) {
+            slot = (int)i;
+            break;
+        }
+    }
+    if (slot < 0) {
+        WARN("No free variable MTRR");
+        return -1;
+    }
+
+    mask = (((uint64_t)1 << phys_addr_bits()) - 1) & ~(uint64_t)(region - 1);
+
+    wc_mtrr_slot = slot;
+    wc_mtrr_base = (uint64_t)base | MEM_TYPE_WC;
+    wc_mtrr_mask = mask | MTRR_PHYSMASK_VALID;
+    mtrr_write(slot, wc_mtrr_base, wc_mtrr_mask);
+
+    INFO("Variable MTRR set to write-combining");
+    return 0;
+}
+
+int paging_init(void) {
+    if (!(cpu_features_edx() & CPUID_EDX_PSE)) {
+        WARN("CPU lacks PSE, paging disabled");
+        return -1;
+    }
+
+    pat_init();
+
+    /* Identity map everything write-back; MTRRs still keep MMIO uncached */
+    for (uint32_t i = 0; i < 1024; i++) {
+        page_directory[i] = (i * PAGE_SIZE_4M) | PDE_PRESENT | PDE_WRITE | PDE_LARGE;
+    }
+
+    write_cr3((uint32_t)(uintptr_t)page_directory);
+    write_cr4(read_cr4() | CR4_PSE);
+    /* WP: read-only PTEs apply to ring 0 too, the kernel included */
+    write_cr0(read_cr0() | CR0_PG | CR0_WP);
+    paging_on = 1;
+
+    INFO("Paging enabled with 4 MB pages");
+    return 0;
+}
+
+int paging_enabled(void) {
+    return paging_on;
+}
+
+int paging_set_write_combining(uint32_t phys, uint32_t size) {
+    uint32_t first, last;
+
+    if (size == 0) {
+        return -1;
+    }
+
+    /* PAT only applies through page tables; without it fall back to MTRRs */
+    if (!paging_on || !(cpu_features_edx() & CPUID_EDX_PAT)) {
+        if (smp_cpu_count() > 1) {
+            WARN("MTRRs are only replayed at AP start-up, not changing them now");
+            return -1;
+        }
+        return mtrr_set_write_combining(phys, size);
+    }
+
+    first = phys / PAGE_SIZE_4M;
+    last = (phys + size - 1) / PAGE_SIZE_4M;
+    for (uint32_t i = first; i <= last && i < 1024; i++) {
+        page_directory[i] = (page_directory[i] & ~(PDE_PWT | PDE_PCD | PDE_LARGE_PAT)) | PAT_WC_INDEX_FLAGS;
+    }
+    smp_flush_tlb();
+
+    INFO("Range mapped write-combining");
+    return 0;
+}
+
+int paging_set_uncached(uint32_t phys, uint32_t size) {
+    uint32_t first, last;
+
+    if (!paging_on || size == 0) {
+        return -1;
+    }
+
+    first = phys / PAGE_SIZE_4M;
+    last = (phys + size - 1) / PAGE_SIZE_4M;
+    for (uint32_t i = first; i <= last && i < 1024; i++) {
+        page_directory[i] = (page_directory[i] & ~PDE_LARGE_PAT) | PDE_PWT | PDE_PCD;
+    }
+    smp_flush_tlb();
+    return 0;
+}
+
+/* The 4 KB entry for virt, or NULL outside the reserved windows */
+static uint32_t *page_entry(uint32_t virt) {
+    uint32_t pde = page_directory[virt / PAGE_SIZE_4M];
+    uint32_t *table;
+
+    if (!(pde & PDE_PRESENT) || (pde & PDE_LARGE)) {
+        return NULL;
+    }
+    table = (uint32_t *)(uintptr_t)(pde & ~(PAGE_SIZE - 1));
+    return &table[(virt / PAGE_SIZE) & 1023];
+}
+
+int paging_reserve(uint32_t virt, uint32_t size, PageFaultHandler handler) {
+    uint32_t first = virt / PAGE_SIZE_4M;
+    uint32_t count = size / PAGE_SIZE_4M;
+
+    if (!paging_on || window_count == PAGING_MAX_WINDOWS || !handler ||
+        (virt | size) & (PAGE_SIZE_4M - 1) || count == 0 || first + count > 1024) {
+        return -1;
+    }
+
+    for (uint32_t i = first; i < first + count; i++) {
+        uint32_t *table = heap_alloc_page();
+
+        if (!table) {
+            ERROR("No memory for page tables");
+            return -1;
+        }
+        memset(table, 0, PAGE_SIZE);
+        page_directory[i] = (uint32_t)(uintptr_t)table | PDE_PRESENT | PDE_WRITE;
+    }
+    /* Other CPUs may hold the old 4 MB translations */
+    smp_flush_tlb();
+
+    windows[window_count].base = virt;
+    windows[window_count].size = size;
+    windows[window_count].handler = handler;
+    window_count++;
+
+    INFO("Demand-paged window at 0x%08x, %u KB", virt, size / 1024);
+    return 0;
+}
+
+int paging_map(uint32_t virt, uint32_t phys, uint32_t flags) {
+    uint32_t *pte = page_entry(virt);
+
+    if (!pte) {
+        return -1;
+    }
+    *pte = (phys & ~(PAGE_SIZE - 1)) | (flags & PTE_WRITE) | PTE_PRESENT;
+    return 0;
+}
+
+uint32_t paging_unmap(uint32_t virt) {
+    uint32_t *pte = page_entry(virt);
+    uint32_t old;
+
+    if (!pte || !(*pte & PTE_PRESENT)) {
+        return 0;
+    }
+    old = *pte;
+    *pte = 0;
+    smp_flush_tlb();
+    return old & ~(PAGE_SIZE - 1);
+}
+
+void paging_unmap_range(uint32_t virt, uint32_t size, PageReleaseFn release) {
+    uint32_t end = virt + size;
+    int any = 0;
+
+    /* Clear PRESENT but keep the frame address until every CPU has let go */
+    for (uint32_t page = virt & ~(PAGE_SIZE - 1); page < end; page += PAGE_SIZE) {
+        uint32_t *pte = page_entry(page);
+
+        if (pte && (*pte & PTE_PRESENT)) {
+            *pte &= ~PTE_PRESENT;
+            any = 1;
+        }
+    }
+    if (!any) {
+        return;
+    }
+    smp_flush_tlb();
+
+    for (uint32_t page = virt & ~(PAGE_SIZE - 1); page < end; page += PAGE_SIZE) {
+        uint32_t *pte = page_entry(page);
+
+        if (pte && *pte) {
+            if (release) {
+                release(*pte & ~(PAGE_SIZE - 1));
+            }
+            *pte = 0;
+        }
+    }
+}
+
+int paging_mapped(uint32_t virt) {
+    uint32_t *pte = page_entry(virt);
+
+    return pte && (*pte & PTE_PRESENT);
+}
+
+static const PagingWindow *fault_window(uint32_t addr, uint32_t error) {
+    if (error & PF_PRESENT) {
+        return NULL;
+    }
+    for (int i = 0; i < window_count; i++) {
+        if (addr - windows[i].base < windows[i].size) {
+            return &windows[i];
+        }
+    }
+    return NULL;
+}
+
+int paging_fault_claimed(uint32_t addr, uint32_t error) {
+    return fault_window(addr, error) != NULL;
+}
+
+int paging_fault(uint32_t addr, uint32_t error) {
+    const PagingWindow *w = fault_window(addr, error);
+
+    return w ? w->handler(addr, error) : -1;
+}
+
+void paging_init_ap(void) {
+    uint32_t cr0;
+
+    if (!paging_on) {
+        return;
+    }
+
+    if (pat_value) {
+        cr0 = cache_disable();
+        wrmsr(MSR_PAT, pat_value);
+        cache_enable(cr0);
+    }
+    if (wc_mtrr_slot >= 0) {
+        mtrr_write(wc_mtrr_slot, wc_mtrr_base, wc_mtrr_mask);
+    }
+
+    write_cr3((uint32_t)(uintptr_t)page_directory);
+    write_cr4(read_cr4() | CR4_PSE);
+    write_cr0(read_cr0() | CR0_PG | CR0_WP);
+}
@@ -0,0 +1,126 @@
+#include "parallel.h"
+#include "thread.h"
+#include "mutex.h"
+#include "spinlock.h"
+#include "smp.h"
+#include "debug.h"
+#include <stddef.h>
+
+/* The current job. Callers take job_mutex, so there is one job at a time;
+   job_lock guards the fields and both wait queues. */
+static Mutex job_mutex;
+static Spinlock job_lock = SPINLOCK_INIT;
+static WaitQueue work_ready;        /* Workers waiting for the next job */
+static WaitQueue work_done;         /* The caller waiting for job_busy to drop */
+
+static ParallelFn job_fn;
+static void *job_arg;
+static int job_count;
+static int job_next;                /* Next unclaimed item */
+static uint32_t job_seq = 0;        /* Bumped per job, so workers see each once */
+static int job_busy = 0;            /* Workers inside run_items */
+
+static int workers = 0;
+
+/* Claim items until none are left. Fields are only rewritten while
+   job_busy is zero, so they stay consistent with the claimed index. */
+static void run_items(void) {
+    for (;;) {
+        int i = __atomic_fetch_add(&job_next, 1, __ATOMIC_ACQ_REL);
+
+        if (i >= job_count) {
+            return;
+        }
+        job_fn(job_arg, i);
+    }
+}
+
+static void worker_main(void *arg) {
+    uint32_t seen = 0;
+
+    (void)arg;
+    for (;;) {
+        uint32_t flags = spin_lock_irqsave(&job_lock);
+
+        while (job_seq == seen) {
+            wait_queue_sleep(&work_ready, &job_lock);
+        }
+        seen = job_seq;
+        job_busy++;
+        spin_unlock_irqrestore(&job_lock, flags);
+
+        run_items();
+
+        flags = spin_lock_irqsave(&job_lock);
+        if (--job_busy == 0) {
+            wait_queue_wake_all(&work_done);
+        }
+        spin_unlock_irqrestore(&job_lock, flags);
+    }
+}
+
+int parallel_init(void) {
+    int wanted = smp_cpu_count() - 1;
+
+    mutex_init(&job_mutex);
+    wait_queue_init(&work_ready);
+    wait_queue_init(&work_done);
+
+    /* Workers start on this CPU; the first wakeup spreads them, since an
+       idle CPU steals whatever the busy one has queued */
+    for (int i = 0; i < wanted; i++) {
+        if (!thread_create("worker", worker_main, NULL, THREAD_PRIO_NORMAL)) {
+            WARN("Only %d of %d worker threads started", workers, wanted);
+            break;
+        }
+        workers++;
+    }
+    if (workers) {
+        INFO("%d parallel workers", workers);
+    }
+    return workers;
+}
+
+int parallel_workers(void) {
+    return workers;
+}
+
+void parallel_for(int count, ParallelFn fn, void *arg) {
+    uint32_t flags;
+
+    if (count <= 0) {
+        return;
+    }
+    if (!workers || count == 1) {
+        for (int i = 0; i < count; i++) {
+            fn(arg, i);
+        }
+        return;
+    }
+
+    mutex_lock(&job_mutex);
+
+    flags = spin_lock_irqsave(&job_lock);
+    /* A worker that woke late for the last job may still be finding it empty */
+    while (job_busy) {
+        wait_queue_sleep(&work_done, &job_lock);
+    }
+    job_fn = fn;
+    job_arg = arg;
+    job_count = count;
+    job_next = 0;
+    job_seq++;
+    wait_queue_wake_all(&work_ready);
+    spin_unlock_irqrestore(&job_lock, flags);
+
+    run_items();
+
+    /* Every item is claimed; wait for the ones still running elsewhere */
+    flags = spin_lock_irqsave(&job_lock);
+    while (job_busy) {
+        wait_queue_sleep(&work_done, &job_lock);
+    }
+    spin_unlock_irqrestore(&job_lock, flags);
+
+    mutex_unlock(&job_mutex);
+}
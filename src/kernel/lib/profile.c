@@ -0,0 +1,76 @@
+#include "profile.h"
+#include "heap.h"
+#include "string.h"
+#include "interrupt.h"
+#include "debug.h"
+#include <stddef.h>
+
+#define PROFILE_FLUSH_LINES 64      /* Keep dumps inside the serial TX ring */
+
+ProfileBucket *profile_table = NULL;
+uint32_t profile_samples = 0;
+uint32_t profile_dropped = 0;
+
+static ProfileBucket *profile_buffer = NULL;
+
+int profile_init(void) {
+    profile_buffer = heap_alloc(sizeof(ProfileBucket) * PROFILE_BUCKETS, 64);
+    if (!profile_buffer) {
+        return -1;
+    }
+    profile_reset();
+    profile_start();
+
+    INFO("Profiler sampling EIP on every timer tick");
+    return 0;
+}
+
+void profile_start(void) {
+    profile_table = profile_buffer;
+}
+
+void profile_stop(void) {
+    profile_table = NULL;
+}
+
+void profile_reset(void) {
+    uint32_t flags;
+
+    if (!profile_buffer) {
+        return;
+    }
+    flags = irq_save();
+    memset(profile_buffer, 0, sizeof(ProfileBucket) * PROFILE_BUCKETS);
+    profile_samples = 0;
+    profile_dropped = 0;
+    irq_restore(flags);
+}
+
+void profile_dump(void) {
+    int lines = 0;
+
+    if (!profile_buffer) {
+        return;
+    }
+
+    /* Freeze the histogram while it is written out */
+    profile_stop();
+
+    kprintf("PROFILE BEGIN %u %u\r\n", profile_samples, profile_dropped);
+    for (uint32_t i = 0; i < PROFILE_BUCKETS; i++) {
+        const ProfileBucket *b = &profile_buffer[i];
+
+        if (b->count == 0) {
+            continue;
+        }
+        kprintf("PROFILE S %08x %u\r\n", b->eip, b->count);
+        if (++lines % PROFILE_FLUSH_LINES == 0) {
+            debug_flush();
+        }
+    }
+    kprintf("PROFILE END\r\n");
+    debug_flush();
+
+    profile_reset();
+    profile_start();
+}
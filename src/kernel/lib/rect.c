@@ -0,0 +1,107 @@
+#include "rect.h"
+
+void rect_list_add(FbRect *list, int *count, int max, const FbRect *r) {
+    FbRect cur = *r;
+    int i;
+
+    if (rect_empty(&cur)) {
+        return;
+    }
+
+    i = 0;
+    while (i < *count) {
+        FbRect u;
+
+        rect_union(&u, &list[i], &cur);
+        if (rect_area(&u) <= rect_area(&list[i]) + rect_area(&cur)) {
+            cur = u;
+            list[i] = list[--(*count)];
+            i = 0;
+        } else {
+            i++;
+        }
+    }
+
+    if (*count == max) {
+        int best = 0;
+        int best_growth = 0;
+
+        for (i = 0; i < *count; i++) {
+            FbRect u;
+            int growth;
+
+            rect_union(&u, &list[i], &cur);
+            growth = rect_area(&u) - rect_area(&list[i]);
+            if (i == 0 || growth < best_growth) {
+                best = i;
+                best_growth = growth;
+            }
+        }
+        rect_union(&list[best], &list[best], &cur);
+        return;
+    }
+
+    list[(*count)++] = cur;
+}
+
+int rect_subtract(FbRect out[4], const FbRect *a, const FbRect *b) {
+    FbRect overlap;
+    int n = 0;
+
+    if (!rect_intersect(&overlap, a, b)) {
+        out[0] = *a;
+        return rect_empty(a) ? 0 : 1;
+    }
+
+    /* Full-width bands above and below, then the sides of the overlap's rows */
+    if (overlap.y > a->y) {
+        out[n].x = a->x;
+        out[n].y = a->y;
+        out[n].w = a->w;
+        out[n].h = overlap.y - a->y;
+        n++;
+    }
+    if (overlap.y + overlap.h < a->y + a->h) {
+        out[n].x = a->x;
+        out[n].y = overlap.y + overlap.h;
+        out[n].w = a->w;
+        out[n].h = (a->y + a->h) - (overlap.y + overlap.h);
+        n++;
+    }
+    if (overlap.x > a->x) {
+        out[n].x = a->x;
+        out[n].y = overlap.y;
+        out[n].w = overlap.x - a->x;
+        out[n].h = overlap.h;
+        n++;
+    }
+    if (overlap.x + overlap.w < a->x + a->w) {
+        out[n].x = overlap.x + overlap.w;
+        out[n].y = overlap.y;
+        out[n].w = (a->x + a->w) - (overlap.x + overlap.w);
+        out[n].h = overlap.h;
+        n++;
+    }
+    return n;
+}
+
+int rect_region_subtract(FbRect *list, int *count, int max, const FbRect *b) {
+    /* Walk backwards: entries past i are done, so one can fill the hole at i */
+    for (int i = *count - 1; i >= 0; i--) {
+        FbRect pieces[4], overlap;
+        int n;
+
+        if (!rect_intersect(&overlap, &list[i], b)) {
+            continue;
+        }
+        n = rect_subtract(pieces, &list[i], b);
+        list[i] = list[--(*count)];
+        for (int p = 0; p < n; p++) {
+            if (*count == max) {
+                return -1;
+            }
+            list[(*count)++] = pieces[p];
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,193 @@
+#include "smp.h"
+#include "apic.h"
+#include "acpi.h"
+#include "mptable.h"
+#include "interrupt.h"
+#include "paging.h"
+#include "heap.h"
+#include "mutex.h"
+#include "cpu.h"
+#include "string.h"
+#include "debug.h"
+#include <stddef.h>
+
+/* Null, code32, data32, code16, data16 as entry.S set them up; the
+   per-CPU segments follow */
+#define GDT_BASE_ENTRIES    5
+#define CPU_SELECTOR(id)    ((uint16_t)((GDT_BASE_ENTRIES + (id)) * 8))
+#define MAX_LISTED          32      /* Table entries considered, enabled or not */
+
+typedef struct {
+    uint16_t limit;
+    uint32_t base;
+} __attribute__((packed)) GdtDescriptor;
+
+extern uint8_t ap_trampoline_start[];
+extern uint8_t ap_trampoline_gdt[];
+extern uint8_t ap_trampoline_end[];
+
+static uint64_t gdt[GDT_BASE_ENTRIES + SMP_MAX_CPUS] __attribute__((aligned(8)));
+static Cpu cpus[SMP_MAX_CPUS];
+static int cpu_count = 1;
+
+/* Handed to the AP being started; APs come up one at a time */
+volatile uint32_t ap_boot_stack = 0;
+static Cpu *volatile ap_booting = NULL;
+
+/* One shootdown at a time; each target decrements tlb_pending when done */
+static Mutex tlb_mutex;
+static volatile int tlb_pending = 0;
+
+/* Byte-granular 32-bit read/write data segment */
+static uint64_t data_segment(uint32_t base, uint32_t limit) {
+    return (uint64_t)(limit & 0xFFFF) |
+           ((uint64_t)(base & 0xFFFFFF) << 16) |
+           ((uint64_t)0x92 << 40) |
+           ((uint64_t)((limit >> 16) & 0xF) << 48) |
+           ((uint64_t)0x4 << 52) |
+           ((uint64_t)(base >> 24) << 56);
+}
+
+static void load_cpu_segment(const Cpu *cpu) {
+    uint16_t sel = CPU_SELECTOR(cpu->id);
+
+    __asm__ volatile ("mov %0, %%gs" : : "r"(sel) : "memory");
+}
+
+void smp_early_init(void) {
+    GdtDescriptor desc;
+
+    __asm__ volatile ("sgdt %0" : "=m"(desc));
+    memcpy(gdt, (const void *)(uintptr_t)desc.base, GDT_BASE_ENTRIES * sizeof(uint64_t));
+
+    for (uint32_t i = 0; i < SMP_MAX_CPUS; i++) {
+        cpus[i].self = &cpus[i];
+        cpus[i].id = i;
+        gdt[GDT_BASE_ENTRIES + i] = data_segment((uint32_t)(uintptr_t)&cpus[i], sizeof(Cpu) - 1);
+    }
+
+    desc.limit = sizeof(gdt) - 1;
+    desc.base = (uint32_t)(uintptr_t)gdt;
+    __asm__ volatile ("lgdt %0" : : "m"(desc));
+
+    load_cpu_segment(&cpus[0]);
+    cpus[0].online = 1;
+}
+
+/* C entry of every AP, from ap_trampoline.S with paging off */
+void ap_main(void) {
+    Cpu *cpu = ap_booting;
+
+    load_cpu_segment(cpu);
+    cpu_enable_sse();
+    paging_init_ap();
+    interrupt_init_ap();
+    apic_init_ap();
+    thread_init_ap();
+}
+
+static void tlb_flush_irq(InterruptFrame *frame) {
+    (void)frame;
+    write_cr3(read_cr3());
+    __atomic_sub_fetch(&tlb_pending, 1, __ATOMIC_RELEASE);
+}
+
+static int find_cpus(uint8_t *apic_ids) {
+    int count = acpi_madt_cpus(apic_ids, MAX_LISTED);
+
+    if (count == 0) {
+        count = mptable_cpus(apic_ids, MAX_LISTED);
+    }
+    return count;
+}
+
+int smp_init(void) {
+    uint8_t apic_ids[MAX_LISTED];
+    uint32_t size = (uint32_t)(ap_trampoline_end - ap_trampoline_start);
+    uint8_t *trampoline = (uint8_t *)(uintptr_t)SMP_TRAMPOLINE;
+    int listed;
+
+    if (apic_init() < 0) {
+        INFO("No local APIC, running on one CPU");
+        return cpu_count;
+    }
+    cpus[0].apic_id = apic_id();
+
+    listed = find_cpus(apic_ids);
+    if (listed <= 1) {
+        INFO("Single processor system");
+        return cpu_count;
+    }
+
+    local_irq_set_handler(APIC_TLB_VECTOR, tlb_flush_irq);
+    memcpy(trampoline, ap_trampoline_start, size);
+    __asm__ volatile ("sgdt %0" : "=m"(*(GdtDescriptor *)(trampoline + (ap_trampoline_gdt - ap_trampoline_start))));
+
+    for (int i = 0; i < listed && cpu_count < SMP_MAX_CPUS; i++) {
+        Cpu *cpu = &cpus[cpu_count];
+        uint8_t *stack;
+
+        if (apic_ids[i] == cpus[0].apic_id) {
+            continue;
+        }
+        stack = heap_alloc(SMP_AP_STACK_SIZE, 16);
+        if (!stack) {
+            break;
+        }
+
+        cpu->apic_id = apic_ids[i];
+        ap_booting = cpu;
+        ap_boot_stack = (uint32_t)(uintptr_t)(stack + SMP_AP_STACK_SIZE);
+        if (apic_start_ap(cpu->apic_id, (uint8_t)(SMP_TRAMPOLINE >> 12), &cpu->online) < 0) {
+            /* It might still wake up late on the shared boot slot; stop here */
+            WARN("CPU with APIC id %u did not start", cpu->apic_id);
+            break;
+        }
+        cpu_count++;
+    }
+
+    if (listed > SMP_MAX_CPUS) {
+        WARN("Only %d of %d processors used", SMP_MAX_CPUS, listed);
+    }
+    INFO("%d CPUs online", cpu_count);
+    return cpu_count;
+}
+
+void smp_flush_tlb(void) {
+    Cpu *self;
+
+    if (!paging_enabled()) {
+        return;
+    }
+    if (cpu_count == 1) {
+        write_cr3(read_cr3());
+        return;
+    }
+
+    mutex_lock(&tlb_mutex);
+    thread_preempt_disable();
+    self = cpu_self();
+    write_cr3(read_cr3());
+
+    for (uint32_t i = 0; i < SMP_MAX_CPUS; i++) {
+        if (&cpus[i] != self && cpus[i].online) {
+            __atomic_add_fetch(&tlb_pending, 1, __ATOMIC_RELAXED);
+            apic_send_ipi(cpus[i].apic_id, APIC_TLB_VECTOR);
+        }
+    }
+    /* Interrupts stay on, so a CPU waiting on us still gets its IPIs */
+    while (__atomic_load_n(&tlb_pending, __ATOMIC_ACQUIRE)) {
+        __asm__ volatile ("pause");
+    }
+
+    thread_preempt_enable();
+    mutex_unlock(&tlb_mutex);
+}
+
+int smp_cpu_count(void) {
+    return cpu_count;
+}
+
+Cpu *smp_cpu(uint32_t index) {
+    return &cpus[index < SMP_MAX_CPUS ? index : 0];
+}
@@ -0,0 +1,64 @@
+#include "string.h"
+#include <stdint.h>
+
+void *memcpy(void *dst, const void *src, size_t n) {
+    void *d = dst;
+
+    __asm__ volatile ("cld; rep movsb"
+                      : "+D"(d), "+S"(src), "+c"(n)
+                      :
+                      : "memory");
+    return dst;
+}
+
+void *memmove(void *dst, const void *src, size_t n) {
+    uint8_t *d = dst;
+    const uint8_t *s = src;
+
+    if (d == s || n == 0) {
+        return dst;
+    }
+    if (d < s || d >= s + n) {
+        return memcpy(dst, src, n);
+    }
+
+    /* Overlapping with dst above src: copy backwards */
+    d += n - 1;
+    s += n - 1;
+    __asm__ volatile ("std; rep movsb; cld"
+                      : "+D"(d), "+S"(s), "+c"(n)
+                      :
+                      : "memory");
+    return dst;
+}
+
+void *memset(void *dst, int value, size_t n) {
+    void *d = dst;
+
+    __asm__ volatile ("cld; rep stosb"
+                      : "+D"(d), "+c"(n)
+                      : "a"(value)
+                      : "memory");
+    return dst;
+}
+
+int memcmp(const void *a, const void *b, size_t n) {
+    const uint8_t *pa = a;
+    const uint8_t *pb = b;
+
+    for (size_t i = 0; i < n; i++) {
+        if (pa[i] != pb[i]) {
+            return pa[i] - pb[i];
+        }
+    }
+    return 0;
+}
+
+size_t strlen(const char *s) {
+    size_t n = 0;
+
+    while (s[n]) {
+        n++;
+    }
+    return n;
+}
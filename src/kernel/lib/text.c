@@ -0,0 +1,224 @@
+#define LOG_CATEGORY FB
+
+#include "text.h"
+#include "bootinfo.h"
+#include "font8x8.h"
+#include "string.h"
+#include "debug.h"
+#include <stddef.h>
+
+/* Runs of set bits in one 8-pixel row mask */
+typedef struct {
+    uint8_t count;
+    uint8_t start[4];
+    uint8_t len[4];
+} RowSpans;
+
+static RowSpans span_table[256];
+static Font font_8x8;
+static Font font_8x16;
+static int have_bios_font = 0;
+
+static void build_span_table(void) {
+    for (int mask = 0; mask < 256; mask++) {
+        RowSpans *sp = &span_table[mask];
+        int col = 0;
+
+        sp->count = 0;
+        while (col < 8) {
+            int start;
+
+            while (col < 8 && !(mask & (0x80 >> col))) {
+                col++;
+            }
+            if (col == 8) {
+                break;
+            }
+            start = col;
+            while (col < 8 && (mask & (0x80 >> col))) {
+                col++;
+            }
+            sp->start[sp->count] = (uint8_t)start;
+            sp->len[sp->count] = (uint8_t)(col - start);
+            sp->count++;
+        }
+    }
+}
+
+static uint8_t reverse_bits(uint8_t b) {
+    b = (uint8_t)(((b & 0xF0) >> 4) | ((b & 0x0F) << 4));
+    b = (uint8_t)(((b & 0xCC) >> 2) | ((b & 0x33) << 2));
+    b = (uint8_t)(((b & 0xAA) >> 1) | ((b & 0x55) << 1));
+    return b;
+}
+
+static void expand_font_8x8(void) {
+    font_8x8.width = 8;
+    font_8x8.height = 8;
+
+    /* font8x8_basic stores bit 0 as the leftmost pixel */
+    for (int c = 0; c < 256; c++) {
+        int src = (c < 32 || c > 127) ? 0 : c - 32;
+
+        for (int row = 0; row < 8; row++) {
+            font_8x8.masks[c][row] = reverse_bits(font8x8_basic[src][row]);
+        }
+    }
+}
+
+static void expand_font_8x16(const uint8_t *bios_font) {
+    font_8x16.width = 8;
+    font_8x16.height = 16;
+
+    for (int c = 0; c < 256; c++) {
+        for (int row = 0; row < 16; row++) {
+            font_8x16.masks[c][row] = bios_font[(c * 16) + row];
+        }
+    }
+}
+
+void text_init(const struct BootInfo *info) {
+    build_span_table();
+    expand_font_8x8();
+
+    if (info && info->font_ptr) {
+        expand_font_8x16((const uint8_t *)(uintptr_t)info->font_ptr);
+        have_bios_font = 1;
+    }
+}
+
+const Font *text_font(FontId id) {
+    if (id == FONT_8X16 && have_bios_font) {
+        return &font_8x16;
+    }
+    return &font_8x8;
+}
+
+int text_width(const Font *font, const char *text) {
+    if (!font || !text) {
+        return 0;
+    }
+    return (int)strlen(text) * font->width;
+}
+
+void text_measure(const Font *font, const char *text, int *width, int *height) {
+    if (width) {
+        *width = text_width(font, text);
+    }
+    if (height) {
+        *height = font ? font->height : 0;
+    }
+}
+
+/* Clipped glyph rows in screen space; shared by the per-format kernels */
+typedef struct {
+    const Font *font;
+    const char *text;
+    int x, x0, x1;
+    int first, last;
+    int row_first, row_last;
+    uint8_t *line;      /* Row y0 of the target */
+    uint32_t pitch;
+    uint32_t pixel;
+} GlyphRun;
+
+static inline __attribute__((always_inline)) void put_run(uint8_t *p, uint32_t pixel, int n, int bytes) {
+    for (int k = 0; k < n; k++) {
+        if (bytes == 4) {
+            ((uint32_t *)p)[k] = pixel;
+        } else if (bytes == 2) {
+            ((uint16_t *)p)[k] = (uint16_t)pixel;
+        } else {
+            p[(k * 3) + 0] = (uint8_t)pixel;
+            p[(k * 3) + 1] = (uint8_t)(pixel >> 8);
+            p[(k * 3) + 2] = (uint8_t)(pixel >> 16);
+        }
+    }
+}
+
+/* Instantiated once per pixel size so the inner store is a plain move */
+static inline __attribute__((always_inline)) void draw_glyphs(const GlyphRun *g, int bytes) {
+    const Font *font = g->font;
+
+    for (int i = g->first; i <= g->last; i++) {
+        int gx = g->x + (i * font->width);
+        const uint8_t *masks = font->masks[(uint8_t)g->text[i]];
+        uint8_t *line = g->line;
+        uint8_t col_mask = 0xFF;
+
+        if (gx < g->x0) {
+            col_mask &= (uint8_t)(0xFF >> (g->x0 - gx));
+        }
+        if (gx + 8 > g->x1) {
+            col_mask &= (uint8_t)(0xFF << (gx + 8 - g->x1));
+        }
+
+        for (int row = g->row_first; row < g->row_last; row++, line += g->pitch) {
+            const RowSpans *sp = &span_table[masks[row] & col_mask];
+
+            for (int k = 0; k < sp->count; k++) {
+                put_run(line + ((gx + sp->start[k]) * bytes), g->pixel, sp->len[k], bytes);
+            }
+        }
+    }
+}
+
+static void draw_glyphs_32(const GlyphRun *g) {
+    draw_glyphs(g, 4);
+}
+
+static void draw_glyphs_24(const GlyphRun *g) {
+    draw_glyphs(g, 3);
+}
+
+static void draw_glyphs_16(const GlyphRun *g) {
+    draw_glyphs(g, 2);
+}
+
+void text_draw(Framebuffer *fb, const Font *font, int x, int y, const char *text, uint32_t color) {
+    GlyphRun g;
+    int len, y0, y1;
+
+    if (!fb || !font || !text) {
+        return;
+    }
+
+    /* Clip the string's box once; glyphs then only need a column mask */
+    len = (int)strlen(text);
+    {
+        FbRect box = { x, y, len * font->width, font->height };
+
+        if (!rect_intersect(&box, &box, &fb->clip)) {
+            return;
+        }
+        g.x0 = box.x;
+        y0 = box.y;
+        g.x1 = box.x + box.w;
+        y1 = box.y + box.h;
+    }
+
+    g.font = font;
+    g.text = text;
+    g.x = x;
+    g.first = (g.x0 - x) / font->width;
+    g.last = (g.x1 - x - 1) / font->width;
+    g.row_first = y0 - y;
+    g.row_last = y1 - y;
+    g.line = fb_target_row(fb, y0);
+    g.pitch = fb->pitch;
+    g.pixel = fb_pack_color(fb, color);
+
+    switch (fb->bytes_per_pixel) {
+        case 2:
+            draw_glyphs_16(&g);
+            break;
+        case 3:
+            draw_glyphs_24(&g);
+            break;
+        default:
+            draw_glyphs_32(&g);
+            break;
+    }
+
+    fb_mark_dirty(fb, g.x0, y0, g.x1 - g.x0, y1 - y0);
+}
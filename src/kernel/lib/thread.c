@@ -0,0 +1,513 @@
+#include "thread.h"
+#include "smp.h"
+#include "apic.h"
+#include "interrupt.h"
+#include "heap.h"
+#include "timer.h"
+#include "cpu.h"
+#include "debug.h"
+#include "trace.h"
+#include <stddef.h>
+
+/* thread_switch.S: save callee-saved registers on the old stack, store its
+   esp through save_esp and resume whatever next_esp was saved by */
+extern void thread_switch(uint32_t *save_esp, uint32_t next_esp);
+extern void thread_start(void);
+
+/* The boot context never allocates a stack; it keeps the one entry.S set up */
+static Thread boot_thread = { .name = "main", .state = THREAD_RUNNING, .priority = THREAD_PRIO_NORMAL };
+
+/* One lock covers every run queue, wait queue and the sleep list. It is
+   held across thread_switch and released by whichever thread resumes, so
+   no CPU can pick up a thread whose registers are still being saved. */
+static Spinlock sched_lock = SPINLOCK_INIT;
+
+static Thread *sleepers = NULL;     /* Sorted by wake_ms */
+static Thread *dead = NULL;         /* Exited; struct and stack get reused (stack may be NULL) */
+static volatile uint32_t ready_total = 0;
+
+static int active = 0;
+static int save_fpu = 0;            /* CR4.OSFXSR set: fxsave covers x87 and SSE */
+static uint32_t next_id = 1;
+
+static uint32_t new_id(void) {
+    return __atomic_fetch_add(&next_id, 1, __ATOMIC_RELAXED);
+}
+
+static void enqueue(Cpu *cpu, Thread *t) {
+    int p = t->priority;
+
+    t->next = NULL;
+    if (cpu->ready_tail[p]) {
+        cpu->ready_tail[p]->next = t;
+    } else {
+        cpu->ready_head[p] = t;
+    }
+    cpu->ready_tail[p] = t;
+    cpu->ready_count++;
+    ready_total++;
+}
+
+static Thread *dequeue(Cpu *cpu) {
+    for (int p = THREAD_PRIORITIES - 1; p >= 0; p--) {
+        Thread *t = cpu->ready_head[p];
+
+        if (t) {
+            cpu->ready_head[p] = t->next;
+            if (!cpu->ready_head[p]) {
+                cpu->ready_tail[p] = NULL;
+            }
+            t->next = NULL;
+            cpu->ready_count--;
+            ready_total--;
+            return t;
+        }
+    }
+    return NULL;
+}
+
+/* Work stealing: an idle CPU takes the next thread of the busiest queue */
+static Thread *steal(Cpu *self) {
+    Cpu *victim = NULL;
+
+    for (uint32_t i = 0; i < SMP_MAX_CPUS; i++) {
+        Cpu *c = smp_cpu(i);
+
+        if (c != self && c->online && c->ready_count &&
+            (!victim || c->ready_count > victim->ready_count)) {
+            victim = c;
+        }
+    }
+    if (!victim) {
+        return NULL;
+    }
+    self->steals++;
+    return dequeue(victim);
+}
+
+static void kick(Cpu *cpu) {
+    cpu->need_resched = 1;
+    if (cpu != cpu_self()) {
+        apic_send_ipi(cpu->apic_id, APIC_RESCHEDULE_VECTOR);
+    }
+}
+
+/* Scheduler lock held. The thread goes back to the CPU whose cache it
+   last warmed; if that CPU is busy with equal or better work, an idle CPU
+   is nudged so it can steal it instead of waiting for its next tick. */
+static void make_ready(Thread *t) {
+    Cpu *target = smp_cpu(t->cpu);
+
+    if (!target->online) {
+        target = cpu_self();
+    }
+    t->state = THREAD_READY;
+    enqueue(target, t);
+
+    if (target->current == target->idle || t->priority > target->current->priority) {
+        kick(target);
+        return;
+    }
+    for (uint32_t i = 0; i < SMP_MAX_CPUS; i++) {
+        Cpu *c = smp_cpu(i);
+
+        if (c->online && c->current == c->idle && !c->ready_count) {
+            kick(c);
+            break;
+        }
+    }
+}
+
+/* Scheduler lock held, interrupts off. The current thread has already been
+   queued somewhere unless it is still RUNNING, in which case it goes to
+   the back of its priority so equals take turns. May return on another
+   CPU than it was called on. */
+static void schedule(void) {
+    Cpu *self = cpu_self();
+    Thread *prev = self->current;
+    Thread *next;
+
+    self->need_resched = 0;
+    if (prev->state == THREAD_RUNNING && prev != self->idle) {
+        prev->state = THREAD_READY;
+        enqueue(self, prev);
+    }
+
+    next = dequeue(self);
+    if (!next) {
+        next = steal(self);
+    }
+    if (!next) {
+        next = self->idle;
+    }
+    self->slice_left = THREAD_SLICE_MS;
+    next->state = THREAD_RUNNING;
+    next->cpu = self->id;
+    if (next == prev) {
+        return;
+    }
+
+    TRACE_MARK(TRACE_THREAD_SWITCH, prev->id, next->id);
+    self->current = next;
+    self->switches++;
+    if (save_fpu) {
+        __asm__ volatile ("fxsave %0" : "=m"(prev->fpu));
+        __asm__ volatile ("fxrstor %0" : : "m"(next->fpu));
+    }
+    thread_switch(&prev->esp, next->esp);
+}
+
+/* First C frame of every created thread, entered from thread_start still
+   holding the lock the switching CPU took */
+void thread_run(void) {
+    Thread *self = cpu_self()->current;
+
+    spin_unlock(&sched_lock);
+    interrupts_enable();
+    self->entry(self->arg);
+    thread_exit();
+}
+
+static void idle_loop(void *arg) {
+    (void)arg;
+    for (;;) {
+        /* Whatever IRQ ends the hlt reschedules on its way out */
+        __asm__ volatile ("sti; hlt" : : : "memory");
+    }
+}
+
+static Thread *thread_alloc(void) {
+    uint32_t flags = spin_lock_irqsave(&sched_lock);
+    Thread *t = dead;
+
+    if (t) {
+        dead = t->next;
+    }
+    spin_unlock_irqrestore(&sched_lock, flags);
+
+    if (!t) {
+        t = heap_alloc(sizeof(Thread), 16);
+        if (!t) {
+            return NULL;
+        }
+        t->stack = NULL;
+    }
+    if (!t->stack) {
+        t->stack = heap_alloc(THREAD_STACK_SIZE, 16);
+        if (!t->stack) {
+            /* The heap cannot take the struct back; park it for a retry */
+            flags = spin_lock_irqsave(&sched_lock);
+            t->next = dead;
+            dead = t;
+            spin_unlock_irqrestore(&sched_lock, flags);
+            return NULL;
+        }
+    }
+    return t;
+}
+
+static Thread *thread_setup(const char *name, ThreadFn entry, void *arg, int priority) {
+    Thread *t = thread_alloc();
+    uint32_t *sp;
+
+    if (!t) {
+        ERROR("No memory for thread %s", name);
+        return NULL;
+    }
+
+    t->id = new_id();
+    t->name = name;
+    t->priority = priority;
+    t->entry = entry;
+    t->arg = arg;
+    t->next = NULL;
+
+    /* Frame for thread_switch to pop: edi, esi, ebx, ebp, then return address */
+    sp = (uint32_t *)(t->stack + THREAD_STACK_SIZE);
+    *--sp = 0;                              /* Fake return address for thread_run */
+    *--sp = (uint32_t)thread_start;
+    *--sp = 0;
+    *--sp = 0;
+    *--sp = 0;
+    *--sp = 0;
+    t->esp = (uint32_t)sp;
+
+    /* Start from the creator's FPU image so MXCSR and the x87 control word are sane */
+    if (save_fpu) {
+        __asm__ volatile ("fxsave %0" : "=m"(t->fpu));
+    }
+    return t;
+}
+
+void thread_init(void) {
+    Cpu *self = cpu_self();
+    Thread *idle;
+
+    save_fpu = (read_cr4() & CR4_OSFXSR) != 0;
+
+    boot_thread.id = new_id();
+    boot_thread.cpu = self->id;
+    idle = thread_setup("idle", idle_loop, NULL, 0);
+    if (!idle) {
+        panic("Cannot create the idle thread");
+    }
+    idle->state = THREAD_READY;
+    idle->cpu = self->id;
+
+    self->current = &boot_thread;
+    self->idle = idle;
+    self->slice_left = THREAD_SLICE_MS;
+    active = 1;
+
+    INFO("Scheduler running, %u ms slices%s", THREAD_SLICE_MS, save_fpu ? ", FXSR state per thread" : "");
+}
+
+void thread_init_ap(void) {
+    Cpu *self = cpu_self();
+    Thread *idle = heap_alloc(sizeof(Thread), 16);
+    uint32_t flags;
+
+    if (!idle) {
+        panic("No memory for CPU %u's idle thread", self->id);
+    }
+    idle->id = new_id();
+    idle->name = "idle";
+    idle->state = THREAD_RUNNING;
+    idle->priority = 0;
+    idle->stack = NULL;
+    idle->cpu = self->id;
+
+    flags = spin_lock_irqsave(&sched_lock);
+    self->current = idle;
+    self->idle = idle;
+    self->slice_left = THREAD_SLICE_MS;
+    self->online = 1;
+    spin_unlock_irqrestore(&sched_lock, flags);
+
+    idle_loop(NULL);
+    for (;;);
+}
+
+int thread_active(void) {
+    return active;
+}
+
+Thread *thread_create(const char *name, ThreadFn entry, void *arg, int priority) {
+    Thread *t;
+    uint32_t flags;
+
+    if (priority < 0) {
+        priority = 0;
+    } else if (priority >= THREAD_PRIORITIES) {
+        priority = THREAD_PRIORITIES - 1;
+    }
+
+    t = thread_setup(name, entry, arg, priority);
+    if (!t) {
+        return NULL;
+    }
+
+    flags = spin_lock_irqsave(&sched_lock);
+    t->cpu = cpu_self()->id;
+    make_ready(t);
+    spin_unlock_irqrestore(&sched_lock, flags);
+    thread_preempt();
+
+    DEBUG("Thread %u (%s) created at priority %d", t->id, name, priority);
+    return t;
+}
+
+Thread *thread_current(void) {
+    uint32_t flags = irq_save();
+    Thread *t = cpu_self()->current;
+
+    irq_restore(flags);
+    return t;
+}
+
+void thread_yield(void) {
+    uint32_t flags;
+
+    if (!active) {
+        return;
+    }
+    flags = spin_lock_irqsave(&sched_lock);
+    schedule();
+    spin_unlock_irqrestore(&sched_lock, flags);
+}
+
+void thread_sleep(uint32_t ms) {
+    uint32_t flags;
+    Thread *self;
+    Thread **link;
+
+    if (!active) {
+        timer_sleep(ms);
+        return;
+    }
+
+    flags = spin_lock_irqsave(&sched_lock);
+    self = cpu_self()->current;
+    self->wake_ms = timer_ms() + (ms ? ms : 1);
+    self->state = THREAD_SLEEPING;
+
+    link = &sleepers;
+    while (*link && (int32_t)((*link)->wake_ms - self->wake_ms) <= 0) {
+        link = &(*link)->next;
+    }
+    self->next = *link;
+    *link = self;
+
+    schedule();
+    spin_unlock_irqrestore(&sched_lock, flags);
+}
+
+void thread_exit(void) {
+    Thread *self;
+
+    interrupts_disable();
+    spin_lock(&sched_lock);
+    self = cpu_self()->current;
+    if (self == &boot_thread) {
+        panic("The boot thread cannot exit");
+    }
+
+    /* The lock stays held until another thread runs, so the stack is free
+       to reuse by the time anyone can take it off the dead list */
+    self->state = THREAD_DEAD;
+    self->next = dead;
+    dead = self;
+    schedule();
+    for (;;) {
+        __asm__ volatile ("hlt");
+    }
+}
+
+void thread_tick(uint32_t now) {
+    Cpu *self;
+
+    if (!active) {
+        return;
+    }
+    self = cpu_self();
+    if (!self->online) {
+        return;     /* An AP's timer can fire before thread_init_ap */
+    }
+    spin_lock(&sched_lock);
+
+    /* Sleepers are timed by the PIT, which only interrupts the BSP */
+    if (self->id == 0) {
+        while (sleepers && (int32_t)(now - sleepers->wake_ms) >= 0) {
+            Thread *t = sleepers;
+
+            sleepers = t->next;
+            make_ready(t);
+        }
+    }
+
+    if (self->current == self->idle) {
+        /* Idle CPUs poll for work to steal once per tick */
+        if (ready_total) {
+            self->need_resched = 1;
+        }
+    } else if (--self->slice_left == 0) {
+        /* Only worth a switch if an equal or higher priority is waiting here */
+        for (int p = self->current->priority; p < THREAD_PRIORITIES; p++) {
+            if (self->ready_head[p]) {
+                self->need_resched = 1;
+                break;
+            }
+        }
+        self->slice_left = THREAD_SLICE_MS;
+    }
+    spin_unlock(&sched_lock);
+}
+
+void thread_preempt(void) {
+    uint32_t flags;
+    Cpu *self;
+
+    if (!active) {
+        return;
+    }
+    flags = irq_save();
+    self = cpu_self();
+    if (self->need_resched && !self->preempt_count && self->online) {
+        spin_lock(&sched_lock);
+        schedule();
+        spin_unlock(&sched_lock);
+    }
+    irq_restore(flags);
+}
+
+void thread_preempt_disable(void) {
+    uint32_t flags = irq_save();
+
+    cpu_self()->preempt_count++;
+    irq_restore(flags);
+}
+
+void thread_preempt_enable(void) {
+    uint32_t flags = irq_save();
+    int now = --cpu_self()->preempt_count == 0;
+
+    irq_restore(flags);
+    if (now) {
+        thread_preempt();
+    }
+}
+
+void wait_queue_init(WaitQueue *q) {
+    q->head = NULL;
+    q->tail = NULL;
+}
+
+void wait_queue_sleep(WaitQueue *q, Spinlock *lock) {
+    Thread *self;
+
+    spin_lock(&sched_lock);
+    self = cpu_self()->current;
+    self->state = THREAD_BLOCKED;
+    self->next = NULL;
+    if (q->tail) {
+        q->tail->next = self;
+    } else {
+        q->head = self;
+    }
+    q->tail = self;
+
+    /* A waker needs the scheduler lock to move us, so this cannot race */
+    spin_unlock(lock);
+    schedule();
+    spin_unlock(&sched_lock);
+    spin_lock(lock);
+}
+
+void wait_queue_wake_one(WaitQueue *q) {
+    uint32_t flags = spin_lock_irqsave(&sched_lock);
+    Thread *t = q->head;
+
+    if (t) {
+        q->head = t->next;
+        if (!q->head) {
+            q->tail = NULL;
+        }
+        make_ready(t);
+    }
+    spin_unlock_irqrestore(&sched_lock, flags);
+}
+
+void wait_queue_wake_all(WaitQueue *q) {
+    uint32_t flags = spin_lock_irqsave(&sched_lock);
+    Thread *t = q->head;
+
+    q->head = NULL;
+    q->tail = NULL;
+    while (t) {
+        Thread *next = t->next;
+
+        make_ready(t);
+        t = next;
+    }
+    spin_unlock_irqrestore(&sched_lock, flags);
+}
@@ -1,21 +1,171 @@
 #include "time.h"
+#include "io.h"
+#include "timer.h"
+#include "debug.h"
 
-struct BiosTimeBcd {
-    uint8_t hours;
-    uint8_t minutes;
-    uint8_t seconds;
-};
+#define CMOS_INDEX      0x70
+#define CMOS_DATA       0x71
+#define CMOS_NMI_OFF    0x80    /* Index bit 7: NMIs stay masked while it is set */
 
-extern void bios_get_time_bcd_raw(void);
-extern struct BiosTimeBcd bios_time_bcd;
+#define RTC_SECONDS     0x00
+#define RTC_MINUTES     0x02
+#define RTC_HOURS       0x04
+#define RTC_DAY         0x07
+#define RTC_MONTH       0x08
+#define RTC_YEAR        0x09
+#define RTC_STATUS_A    0x0A
+#define RTC_STATUS_B    0x0B
+#define RTC_CENTURY     0x32    /* Present on PC-compatible CMOS (ACPI FADT default) */
+
+#define RTC_A_UIP       0x80    /* Update in progress: registers are unstable */
+#define RTC_B_24H       0x02
+#define RTC_B_BINARY    0x04
+#define RTC_HOUR_PM     0x80
+
+#define RTC_UIP_SPINS   100000
+#define RTC_RESYNC_MS   (60u * 60u * 1000u)  /* Re-read hourly to cancel PIT drift */
+
+#define SECONDS_PER_DAY 86400u
+
+/* Wall clock at base_ms; everything later is derived from the PIT */
+static WallTime base_time;
+static uint32_t base_seconds;   /* Seconds since midnight at base_ms */
+static uint32_t base_ms;
+static int clock_valid = 0;
+
+/* NMIs are masked only across the access; nothing else in the kernel
+   masks them, so the index is rewritten with bit 7 clear afterwards */
+static uint8_t cmos_read(uint8_t reg) {
+    uint8_t value;
+
+    outb(CMOS_INDEX, CMOS_NMI_OFF | reg);
+    value = inb(CMOS_DATA);
+    outb(CMOS_INDEX, reg);
+    return value;
+}
 
 static uint8_t bcd_to_bin(uint8_t value) {
     return (uint8_t)(((value >> 4) * 10) + (value & 0x0F));
 }
 
+static int rtc_wait_ready(void) {
+    for (int i = 0; i < RTC_UIP_SPINS; i++) {
+        if (!(cmos_read(RTC_STATUS_A) & RTC_A_UIP)) {
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static void rtc_read_raw(uint8_t regs[7]) {
+    regs[0] = cmos_read(RTC_SECONDS);
+    regs[1] = cmos_read(RTC_MINUTES);
+    regs[2] = cmos_read(RTC_HOURS);
+    regs[3] = cmos_read(RTC_DAY);
+    regs[4] = cmos_read(RTC_MONTH);
+    regs[5] = cmos_read(RTC_YEAR);
+    regs[6] = cmos_read(RTC_CENTURY);
+}
+
+int rtc_read(WallTime *out) {
+    uint8_t regs[7], again[7];
+    uint8_t status_b;
+    int same;
+
+    /* An update can start between the UIP check and the reads, so read
+       until two passes agree */
+    do {
+        if (rtc_wait_ready() < 0) {
+            WARN("RTC stuck in update");
+            return -1;
+        }
+        rtc_read_raw(regs);
+        if (rtc_wait_ready() < 0) {
+            return -1;
+        }
+        rtc_read_raw(again);
+
+        same = 1;
+        for (int i = 0; i < 7; i++) {
+            if (regs[i] != again[i]) {
+                same = 0;
+            }
+        }
+    } while (!same);
+
+    status_b = cmos_read(RTC_STATUS_B);
+
+    {
+        uint8_t pm = regs[2] & RTC_HOUR_PM;
+
+        regs[2] &= (uint8_t)~RTC_HOUR_PM;
+        if (!(status_b & RTC_B_BINARY)) {
+            for (int i = 0; i < 7; i++) {
+                regs[i] = bcd_to_bin(regs[i]);
+            }
+        }
+        /* 12-hour mode: 12 AM is 0, 12 PM is 12 */
+        if (!(status_b & RTC_B_24H)) {
+            regs[2] = (uint8_t)((regs[2] % 12) + (pm ? 12 : 0));
+        }
+    }
+
+    out->seconds = regs[0];
+    out->minutes = regs[1];
+    out->hours = regs[2];
+    out->day = regs[3];
+    out->month = regs[4];
+    out->year = (uint16_t)(((regs[6] >= 19 && regs[6] <= 21) ? regs[6] : 20) * 100 + regs[5]);
+    return 0;
+}
+
+static void clock_sync(void) {
+    WallTime now;
+
+    if (rtc_read(&now) < 0) {
+        return;
+    }
+    base_time = now;
+    base_seconds = (now.hours * 3600u) + (now.minutes * 60u) + now.seconds;
+    base_ms = timer_ms();
+    clock_valid = 1;
+}
+
+void time_init(void) {
+    clock_sync();
+    if (clock_valid) {
+        INFO("RTC %04u-%02u-%02u %02u:%02u:%02u", base_time.year, base_time.month,
+             base_time.day, base_time.hours, base_time.minutes, base_time.seconds);
+    }
+}
+
+void time_get(WallTime *out) {
+    uint32_t elapsed_ms = timer_ms() - base_ms;
+    uint32_t secs;
+
+    /* Crossing midnight or running long: fetch the date again from the RTC */
+    if (clock_valid && (elapsed_ms >= RTC_RESYNC_MS ||
+                        base_seconds + (elapsed_ms / 1000) >= SECONDS_PER_DAY)) {
+        clock_sync();
+        elapsed_ms = timer_ms() - base_ms;
+    }
+
+    *out = base_time;
+    secs = (base_seconds + (elapsed_ms / 1000)) % SECONDS_PER_DAY;
+    out->hours = (uint8_t)(secs / 3600);
+    out->minutes = (uint8_t)((secs / 60) % 60);
+    out->seconds = (uint8_t)(secs % 60);
+}
+
 void time_get_hms(uint8_t *hours, uint8_t *minutes, uint8_t *seconds) {
-    bios_get_time_bcd_raw();
-    *hours = bcd_to_bin(bios_time_bcd.hours);
-    *minutes = bcd_to_bin(bios_time_bcd.minutes);
-    *seconds = bcd_to_bin(bios_time_bcd.seconds);
+    WallTime now;
+
+    time_get(&now);
+    *hours = now.hours;
+    *minutes = now.minutes;
+    *seconds = now.seconds;
+}
+
+uint32_t time_ms_to_next_second(void) {
+    return 1000 - ((timer_ms() - base_ms) % 1000);
 }
@@ -0,0 +1,137 @@
+#include "timer.h"
+#include "interrupt.h"
+#include "event.h"
+#include "io.h"
+#include "debug.h"
+#include "profile.h"
+#include "thread.h"
+#include "spinlock.h"
+#include <stddef.h>
+
+#define PIT_CHANNEL0    0x40
+#define PIT_COMMAND     0x43
+#define PIT_BASE_HZ     1193182
+#define PIT_MODE_RATE   0x34    /* Channel 0, lobyte/hibyte, mode 2 */
+
+typedef struct {
+    uint32_t id;
+    uint32_t deadline;
+    uint32_t period;
+    int active;
+} TimerSlot;
+
+static volatile uint32_t ticks = 0;
+static TimerSlot slots[TIMER_SLOTS];
+static int slots_active = 0;
+static Spinlock slot_lock = SPINLOCK_INIT;
+
+static void timer_irq(InterruptFrame *frame) {
+    uint32_t now;
+
+    profile_sample(frame->eip);
+    now = ++ticks;
+    thread_tick(now);
+    if (!slots_active) {
+        return;
+    }
+
+    spin_lock(&slot_lock);
+    for (int i = 0; i < TIMER_SLOTS; i++) {
+        TimerSlot *t = &slots[i];
+
+        if (!t->active || (int32_t)(now - t->deadline) < 0) {
+            continue;
+        }
+
+        {
+            Event ev = { .type = EVENT_TIMER };
+
+            ev.timer.id = t->id;
+            event_post(&ev);
+        }
+
+        if (t->period) {
+            t->deadline += t->period;
+        } else {
+            t->active = 0;
+            slots_active--;
+        }
+    }
+    spin_unlock(&slot_lock);
+}
+
+void timer_init(void) {
+    uint16_t divisor = (uint16_t)(PIT_BASE_HZ / TIMER_HZ);
+
+    outb(PIT_COMMAND, PIT_MODE_RATE);
+    outb(PIT_CHANNEL0, (uint8_t)(divisor & 0xFF));
+    outb(PIT_CHANNEL0, (uint8_t)(divisor >> 8));
+
+    irq_set_handler(IRQ_TIMER, timer_irq);
+    irq_unmask(IRQ_TIMER);
+
+    INFO("PIT running at 1000 Hz");
+}
+
+uint32_t timer_ms(void) {
+    return ticks;
+}
+
+int timer_arm(uint32_t id, uint32_t delay_ms, uint32_t period_ms) {
+    uint32_t flags = spin_lock_irqsave(&slot_lock);
+    TimerSlot *free_slot = NULL;
+
+    for (int i = 0; i < TIMER_SLOTS; i++) {
+        if (slots[i].active && slots[i].id == id) {
+            free_slot = &slots[i];
+            slots_active--;
+            break;
+        }
+    }
+    for (int i = 0; i < TIMER_SLOTS && !free_slot; i++) {
+        if (!slots[i].active) {
+            free_slot = &slots[i];
+        }
+    }
+
+    if (!free_slot) {
+        spin_unlock_irqrestore(&slot_lock, flags);
+        WARN("No free timer slot");
+        return -1;
+    }
+
+    /* A zero delay fires on the next tick */
+    free_slot->id = id;
+    free_slot->deadline = ticks + (delay_ms ? delay_ms : 1);
+    free_slot->period = period_ms;
+    free_slot->active = 1;
+    slots_active++;
+
+    spin_unlock_irqrestore(&slot_lock, flags);
+    return 0;
+}
+
+void timer_cancel(uint32_t id) {
+    uint32_t flags = spin_lock_irqsave(&slot_lock);
+
+    for (int i = 0; i < TIMER_SLOTS; i++) {
+        if (slots[i].active && slots[i].id == id) {
+            slots[i].active = 0;
+            slots_active--;
+        }
+    }
+    spin_unlock_irqrestore(&slot_lock, flags);
+}
+
+void timer_sleep(uint32_t ms) {
+    uint32_t start = ticks;
+
+    if (thread_active()) {
+        thread_sleep(ms);
+        return;
+    }
+
+    while (ticks - start < ms) {
+        __asm__ volatile ("hlt");
+    }
+}
@@ -0,0 +1,103 @@
+#include "trace.h"
+#include "cpu.h"
+#include "heap.h"
+#include "timer.h"
+#include "debug.h"
+#include <stddef.h>
+
+#define TRACE_CALIBRATE_MS  50
+#define TRACE_FLUSH_LINES   64      /* Keep dumps inside the serial TX ring */
+
+static const char *const trace_event_names[TRACE_EVENT_COUNT] = {
+    "fdc_read",
+    "fdc_write",
+    "fat_read_cluster",
+    "frame",
+    "ui_render",
+    "fb_swap",
+    "event_wait",
+    "mouse_packet",
+    "event_drop",
+    "thread_switch",
+};
+
+TraceRecord *trace_ring = NULL;
+volatile uint32_t trace_next = 0;
+
+static TraceRecord *trace_buffer = NULL;
+static uint32_t tsc_khz = 0;
+
+/* TSC ticks per millisecond, measured across whole PIT ticks */
+static uint32_t calibrate_tsc(void) {
+    uint32_t start = timer_ms();
+    uint64_t t0, t1;
+
+    while (timer_ms() == start) {
+        __asm__ volatile ("hlt");
+    }
+    start = timer_ms();
+    t0 = rdtsc();
+    while (timer_ms() - start < TRACE_CALIBRATE_MS) {
+        __asm__ volatile ("hlt");
+    }
+    t1 = rdtsc();
+
+    return (uint32_t)(t1 - t0) / TRACE_CALIBRATE_MS;
+}
+
+int trace_init(void) {
+    if (!(cpu_features_edx() & CPUID_EDX_TSC)) {
+        WARN("No TSC, tracing disabled");
+        return -1;
+    }
+
+    trace_buffer = heap_alloc(sizeof(TraceRecord) * TRACE_RECORDS, 64);
+    if (!trace_buffer) {
+        return -1;
+    }
+
+    tsc_khz = calibrate_tsc();
+    trace_next = 0;
+    trace_ring = trace_buffer;
+
+    INFO("Tracing %u records, TSC %u kHz", TRACE_RECORDS, tsc_khz);
+    return 0;
+}
+
+void trace_set_enabled(int enabled) {
+    trace_ring = (enabled && trace_buffer) ? trace_buffer : NULL;
+}
+
+void trace_dump(void) {
+    TraceRecord *saved = trace_ring;
+    uint32_t total, first;
+
+    if (!trace_buffer) {
+        return;
+    }
+
+    /* Stop recording so the dump does not chase its own tail */
+    trace_ring = NULL;
+    total = trace_next;
+    first = total > TRACE_RECORDS ? total - TRACE_RECORDS : 0;
+
+    kprintf("TRACE BEGIN %u %u %u\r\n", tsc_khz, total - first, first);
+    for (int i = 0; i < TRACE_EVENT_COUNT; i++) {
+        kprintf("TRACE NAME %d %s\r\n", i, trace_event_names[i]);
+    }
+    debug_flush();
+
+    for (uint32_t n = first; n < total; n++) {
+        const TraceRecord *r = &trace_buffer[n & (TRACE_RECORDS - 1)];
+
+        kprintf("TRACE R %llx %u %c %x %x\r\n",
+                (unsigned long long)r->tsc, r->id, r->phase, r->arg0, r->arg1);
+        if (((n - first) % TRACE_FLUSH_LINES) == TRACE_FLUSH_LINES - 1) {
+            debug_flush();
+        }
+    }
+
+    kprintf("TRACE END\r\n");
+    debug_flush();
+    trace_ring = saved;
+}
@@ -1,51 +1,189 @@
+#define LOG_CATEGORY UI
+
 #include "ui_widget.h"
 #include "framebuffer.h"
 #include "debug.h"
+#include "text.h"
+#include "heap.h"
+#include "string.h"
+#include "trace.h"
+#include "parallel.h"
 #include <stddef.h>
 
-/* Simple memory allocator for widgets - fixed pool */
-#define MAX_WIDGETS 32
-static Widget widget_pool[MAX_WIDGETS];
+#define UI_DEFAULT_CHILDREN 8
+#define UI_MAX_REGION 32        /* Disjoint rectangles left uncovered in a damage area */
+#define UI_TILE_AREAS 8         /* Damage pieces per tile before it is repainted whole */
+
+struct UIGridNode {
+    Widget *widget;
+    UIGridNode *next;
+};
+
+/* A widget overlapping a damage area, clipped to it and to its ancestors */
+typedef struct {
+    Widget *widget;
+    FbRect clip;
+} RenderEntry;
+
+/* Damage inside one tile as disjoint pieces, and its bin: the slice of
+   tile_entries listing the render_list entries that touch the damage, in
+   paint order */
+struct UITile {
+    FbRect bounds;
+    FbRect area[UI_TILE_AREAS];
+    int area_count;         /* 0 while the tile has no damage */
+    int first;              /* -1 if the bins ran out of entries */
+    int count;
+};
+
+typedef struct {
+    UIContext *ctx;
+    Framebuffer *fb;
+} RenderJob;
+
+/* Widget and grid-node pools - carved from the heap once and shared by
+   every context; freed widgets and nodes go back on free lists */
+static Widget *widget_pool = NULL;
 static int widget_pool_used = 0;
+static Widget *widget_free = NULL;
+static UIGridNode *node_pool = NULL;
+static UIGridNode *node_free = NULL;
+static RenderEntry *render_list = NULL;
+static int *tile_entries = NULL;
 
 static Widget* alloc_widget(void) {
-    if (widget_pool_used >= MAX_WIDGETS) {
+    Widget **children = NULL;
+    int capacity = 0;
+    Widget *w;
+
+    if (widget_free) {
+        /* Keep the released child array; the heap cannot take it back */
+        w = widget_free;
+        widget_free = w->next;
+        children = w->children;
+        capacity = w->child_capacity;
+    } else if (widget_pool && widget_pool_used < UI_MAX_WIDGETS) {
+        w = &widget_pool[widget_pool_used++];
+    } else {
         return NULL;
     }
-    Widget *w = &widget_pool[widget_pool_used++];
+    memset(w, 0, sizeof(*w));
+    w->children = children;
+    w->child_capacity = capacity;
     w->type = WIDGET_BUTTON;
-    w->x = 0;
-    w->y = 0;
-    w->width = 0;
-    w->height = 0;
     w->bg_color = 0x4F5F7A;
     w->fg_color = 0xF1F4F8;
     w->hover_color = 0x60739A;
     w->text = NULL;
     w->visible = 1;
-    w->hovered = 0;
-    w->on_click = NULL;
-    w->user_data = NULL;
-    w->next = NULL;
+    w->dirty = 1;
     return w;
 }
 
-void ui_context_init(UIContext *ctx) {
-    ctx->root = NULL;
-    ctx->widget_count = 0;
-    widget_pool_used = 0;
+/* Queue a widget for the next ui_render of its context */
+static void mark_dirty(Widget *w) {
+    UIContext *ctx = w->ctx;
+
+    w->dirty = 1;
+    if (ctx && !w->queued) {
+        w->queued = 1;
+        w->next = ctx->dirty_list;
+        ctx->dirty_list = w;
+    }
+}
+
+static void grid_nodes_reset(void) {
+    node_free = NULL;
+    for (int i = UI_GRID_NODES - 1; i >= 0; i--) {
+        node_pool[i].next = node_free;
+        node_free = &node_pool[i];
+    }
+}
+
+void ui_context_init(UIContext *ctx, int width, int height) {
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->width = width;
+    ctx->height = height;
+    ctx->bg_color = 0x1C2433;
+
+    /* The pools are shared, so several contexts (one per window) can coexist */
+    if (!widget_pool) {
+        widget_pool = heap_alloc(sizeof(Widget) * UI_MAX_WIDGETS, 16);
+        node_pool = heap_alloc(sizeof(UIGridNode) * UI_GRID_NODES, 16);
+        render_list = heap_alloc(sizeof(RenderEntry) * UI_MAX_WIDGETS, 16);
+        tile_entries = heap_alloc(sizeof(int) * UI_TILE_ENTRIES, 16);
+        if (!widget_pool || !node_pool || !render_list || !tile_entries) {
+            ERROR("No memory for widget pools");
+            widget_pool = NULL;
+            return;
+        }
+        widget_pool_used = 0;
+        widget_free = NULL;
+        grid_nodes_reset();
+    }
+
+    ctx->grid_cols = (width + UI_GRID_CELL - 1) / UI_GRID_CELL;
+    ctx->grid_rows = (height + UI_GRID_CELL - 1) / UI_GRID_CELL;
+    ctx->grid = heap_alloc(sizeof(UIGridNode *) * ctx->grid_cols * ctx->grid_rows, 4);
+    if (!ctx->grid) {
+        ERROR("No memory for hit-test grid");
+        return;
+    }
+    memset(ctx->grid, 0, sizeof(UIGridNode *) * ctx->grid_cols * ctx->grid_rows);
+
+    ctx->tile_cols = (width + UI_TILE - 1) / UI_TILE;
+    ctx->tile_rows = (height + UI_TILE - 1) / UI_TILE;
+    ctx->tiles = heap_alloc(sizeof(UITile) * ctx->tile_cols * ctx->tile_rows, 16);
+    ctx->active_tiles = heap_alloc(sizeof(int) * ctx->tile_cols * ctx->tile_rows, 4);
+    if (!ctx->tiles || !ctx->active_tiles) {
+        ERROR("No memory for render tiles");
+        return;
+    }
+    for (int ty = 0; ty < ctx->tile_rows; ty++) {
+        for (int tx = 0; tx < ctx->tile_cols; tx++) {
+            UITile *tile = &ctx->tiles[(ty * ctx->tile_cols) + tx];
+            FbRect cell = { tx * UI_TILE, ty * UI_TILE, UI_TILE, UI_TILE };
+            FbRect screen = { 0, 0, width, height };
+
+            rect_intersect(&tile->bounds, &cell, &screen);
+            tile->area_count = 0;
+        }
+    }
+
+    ctx->root = ui_create_container(0, 0, width, height);
+    if (ctx->root) {
+        ctx->root->ctx = ctx;
+        ctx->root->dirty = 0;
+    }
+}
+
+static void grid_remove(UIContext *ctx, Widget *w);
+
+static void release_subtree(UIContext *ctx, Widget *w) {
+    for (int i = 0; i < w->child_count; i++) {
+        release_subtree(ctx, w->children[i]);
+    }
+    grid_remove(ctx, w);
+    w->ctx = NULL;
+    w->next = widget_free;
+    widget_free = w;
 }
 
 void ui_context_free(UIContext *ctx) {
+    if (ctx->root) {
+        release_subtree(ctx, ctx->root);
+    }
     ctx->root = NULL;
     ctx->widget_count = 0;
-    widget_pool_used = 0;
+    ctx->damage_count = 0;
+    ctx->hovered = NULL;
+    ctx->dirty_list = NULL;
 }
 
 Widget* ui_create_button(const char *text, int x, int y, int width, int height) {
     Widget *w = alloc_widget();
     if (!w) return NULL;
-    
+
     w->type = WIDGET_BUTTON;
     w->text = text;
     w->x = x;
@@ -56,30 +194,29 @@ Widget* ui_create_button(const char *text, int x, int y, int width, int height)
     w->fg_color = 0xF1F4F8;
     w->hover_color = 0x60739A;
     w->visible = 1;
-    
+
     return w;
 }
 
 Widget* ui_create_label(const char *text, int x, int y, uint32_t color) {
     Widget *w = alloc_widget();
     if (!w) return NULL;
-    
+
     w->type = WIDGET_LABEL;
     w->text = text;
     w->x = x;
     w->y = y;
-    w->width = 0;  /* Auto-size based on text */
-    w->height = 8;
+    text_measure(text_font(FONT_8X8), text, &w->width, &w->height);
     w->fg_color = color;
     w->visible = 1;
-    
+
     return w;
 }
 
 Widget* ui_create_panel(int x, int y, int width, int height, uint32_t color) {
     Widget *w = alloc_widget();
     if (!w) return NULL;
-    
+
     w->type = WIDGET_PANEL;
     w->x = x;
     w->y = y;
@@ -87,16 +224,154 @@ Widget* ui_create_panel(int x, int y, int width, int height, uint32_t color) {
     w->height = height;
     w->bg_color = color;
     w->visible = 1;
-    
+
     return w;
 }
 
+Widget* ui_create_container(int x, int y, int width, int height) {
+    Widget *w = alloc_widget();
+    if (!w) return NULL;
+
+    w->type = WIDGET_CONTAINER;
+    w->x = x;
+    w->y = y;
+    w->width = width;
+    w->height = height;
+    w->visible = 1;
+
+    return w;
+}
+
+/* Grid index: each widget sits in every cell its screen bounds touch */
+static void grid_remove(UIContext *ctx, Widget *w) {
+    if (!w->indexed) {
+        return;
+    }
+
+    for (int cy = w->cell_y0; cy <= w->cell_y1; cy++) {
+        for (int cx = w->cell_x0; cx <= w->cell_x1; cx++) {
+            UIGridNode **link = &ctx->grid[(cy * ctx->grid_cols) + cx];
+
+            while (*link) {
+                if ((*link)->widget == w) {
+                    UIGridNode *node = *link;
+
+                    *link = node->next;
+                    node->next = node_free;
+                    node_free = node;
+                    break;
+                }
+                link = &(*link)->next;
+            }
+        }
+    }
+    w->indexed = 0;
+}
+
+static void grid_insert(UIContext *ctx, Widget *w) {
+    int x0, y0, x1, y1;
+
+    /* Containers paint nothing, so they never take hits themselves */
+    if (w->type == WIDGET_CONTAINER || w->width <= 0 || w->height <= 0 || !ctx->grid) {
+        return;
+    }
+
+    x0 = w->abs_x < 0 ? 0 : w->abs_x;
+    y0 = w->abs_y < 0 ? 0 : w->abs_y;
+    x1 = w->abs_x + w->width - 1;
+    y1 = w->abs_y + w->height - 1;
+    if (x1 >= ctx->width) x1 = ctx->width - 1;
+    if (y1 >= ctx->height) y1 = ctx->height - 1;
+    if (x0 > x1 || y0 > y1) {
+        return;  /* Entirely off screen */
+    }
+
+    w->cell_x0 = x0 / UI_GRID_CELL;
+    w->cell_y0 = y0 / UI_GRID_CELL;
+    w->cell_x1 = x1 / UI_GRID_CELL;
+    w->cell_y1 = y1 / UI_GRID_CELL;
+
+    for (int cy = w->cell_y0; cy <= w->cell_y1; cy++) {
+        for (int cx = w->cell_x0; cx <= w->cell_x1; cx++) {
+            UIGridNode **head = &ctx->grid[(cy * ctx->grid_cols) + cx];
+            UIGridNode *node = node_free;
+
+            if (!node) {
+                WARN("Hit-test grid full");
+                w->cell_y1 = cy;
+                w->cell_x1 = cx;
+                w->indexed = 1;
+                return;
+            }
+            node_free = node->next;
+            node->widget = w;
+            node->next = *head;
+            *head = node;
+        }
+    }
+    w->indexed = 1;
+}
+
+/* Recompute screen position and grid cells for a widget and its subtree */
+static void place_subtree(UIContext *ctx, Widget *w) {
+    Widget *p = w->parent;
+
+    if (w->ctx != ctx) {
+        w->ctx = ctx;
+        ctx->widget_count++;
+    }
+    w->abs_x = (p ? p->abs_x : 0) + w->x;
+    w->abs_y = (p ? p->abs_y : 0) + w->y;
+    mark_dirty(w);
+
+    grid_remove(ctx, w);
+    grid_insert(ctx, w);
+
+    for (int i = 0; i < w->child_count; i++) {
+        place_subtree(ctx, w->children[i]);
+    }
+}
+
+static int number_subtree(Widget *w, int order) {
+    w->order = order++;
+    for (int i = 0; i < w->child_count; i++) {
+        order = number_subtree(w->children[i], order);
+    }
+    return order;
+}
+
+void ui_add_child(Widget *parent, Widget *child) {
+    if (!parent || !child || child->parent) return;
+
+    if (parent->child_count == parent->child_capacity) {
+        int capacity = parent->child_capacity ? parent->child_capacity * 2 : UI_DEFAULT_CHILDREN;
+        Widget **children = heap_alloc(sizeof(Widget *) * capacity, 4);
+
+        if (!children) {
+            ERROR("No memory for widget children");
+            return;
+        }
+        if (parent->children) {
+            memcpy(children, parent->children, sizeof(Widget *) * parent->child_count);
+        }
+        parent->children = children;
+        parent->child_capacity = capacity;
+    }
+
+    /* Appending puts the child on top of its siblings */
+    parent->children[parent->child_count++] = child;
+    child->parent = parent;
+
+    if (parent->ctx) {
+        place_subtree(parent->ctx, child);
+        parent->ctx->order_dirty = 1;
+    }
+}
+
 void ui_add_widget(UIContext *ctx, Widget *widget) {
-    if (!widget) return;
-    
-    widget->next = ctx->root;
-    ctx->root = widget;
-    ctx->widget_count++;
+    if (!ctx || !ctx->root || !widget) return;
+
+    ui_add_child(ctx->root, widget);
 }
 
 void ui_set_callback(Widget *widget, WidgetCallback callback, void *user_data) {
@@ -110,99 +385,566 @@ void ui_set_colors(Widget *widget, uint32_t bg, uint32_t fg, uint32_t hover) {
     widget->bg_color = bg;
     widget->fg_color = fg;
     widget->hover_color = hover;
+    mark_dirty(widget);
+}
+
+void ui_set_visible(Widget *widget, int visible) {
+    if (!widget) return;
+    visible = visible ? 1 : 0;
+    if (widget->visible != visible) {
+        widget->visible = visible;
+        mark_dirty(widget);
+    }
+}
+
+void ui_set_text(Widget *widget, const char *text) {
+    if (!widget) return;
+    widget->text = text;
+    if (widget->type == WIDGET_LABEL) {
+        text_measure(text_font(FONT_8X8), text, &widget->width, &widget->height);
+        if (widget->ctx) {
+            grid_remove(widget->ctx, widget);
+            grid_insert(widget->ctx, widget);
+        }
+    }
+    mark_dirty(widget);
+}
+
+void ui_set_position(Widget *widget, int x, int y) {
+    if (!widget) return;
+    widget->x = x;
+    widget->y = y;
+    if (widget->ctx) {
+        place_subtree(widget->ctx, widget);
+    }
+}
+
+void ui_set_background(UIContext *ctx, uint32_t color) {
+    if (!ctx) return;
+    ctx->bg_color = color;
+}
+
+void ui_invalidate_widget(Widget *widget) {
+    if (!widget) return;
+    mark_dirty(widget);
+}
+
+void ui_invalidate(UIContext *ctx, int x, int y, int width, int height) {
+    FbRect r = { x, y, width, height };
+
+    if (!ctx) return;
+    rect_list_add(ctx->damage, &ctx->damage_count, UI_MAX_DAMAGE, &r);
+}
+
+static void widget_bounds(const Widget *widget, FbRect *r) {
+    r->x = widget->abs_x;
+    r->y = widget->abs_y;
+    r->w = widget->width;
+    r->h = widget->height;
 }
 
 static int point_in_widget(const Widget *widget, int x, int y) {
-    return (x >= widget->x && x < widget->x + widget->width &&
-            y >= widget->y && y < widget->y + widget->height);
+    return (x >= widget->abs_x && x < widget->abs_x + widget->width &&
+            y >= widget->abs_y && y < widget->abs_y + widget->height);
 }
 
-void ui_render_widget(Widget *widget, Framebuffer *fb) {
-    if (!widget || !widget->visible || !fb) return;
-    
+/* Shown if it and every ancestor are visible */
+static int widget_shown(const Widget *widget) {
+    for (; widget; widget = widget->parent) {
+        if (!widget->visible) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Children are clipped to their ancestors, so hits must be inside all of them */
+static int widget_hittable(const Widget *widget, int x, int y) {
+    for (; widget; widget = widget->parent) {
+        if (!widget->visible || !point_in_widget(widget, x, y)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Solid colour covering the widget's whole bounds, if it has one */
+static int widget_fill(const Widget *widget, uint32_t *color) {
+    switch (widget->type) {
+        case WIDGET_BUTTON:
+            *color = widget->hovered ? widget->hover_color : widget->bg_color;
+            return 1;
+        case WIDGET_PANEL:
+            *color = widget->bg_color;
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+/* Whatever the widget draws on top of its fill (text) */
+static int widget_has_overlay(const Widget *widget) {
+    return (widget->type == WIDGET_BUTTON || widget->type == WIDGET_LABEL) && widget->text;
+}
+
+static void render_overlay(Widget *widget, Framebuffer *fb) {
     switch (widget->type) {
         case WIDGET_BUTTON: {
-            uint32_t color = widget->hovered ? widget->hover_color : widget->bg_color;
-            fb_draw_rect(fb, widget->x, widget->y, widget->width, widget->height, color);
-            
-            if (widget->text) {
-                int text_x = widget->x + 8;
-                int text_y = widget->y + ((widget->height - 8) / 2);
-                fb_draw_text(fb, text_x, text_y, widget->text, widget->fg_color);
-            }
+            int text_x = widget->abs_x + 8;
+            int text_y = widget->abs_y + ((widget->height - 8) / 2);
+
+            fb_draw_text(fb, text_x, text_y, widget->text, widget->fg_color);
             break;
         }
-        
+
         case WIDGET_LABEL:
-            if (widget->text) {
-                fb_draw_text(fb, widget->x, widget->y, widget->text, widget->fg_color);
-            }
+            fb_draw_text(fb, widget->abs_x, widget->abs_y, widget->text, widget->fg_color);
             break;
-        
-        case WIDGET_PANEL:
-            fb_draw_rect(fb, widget->x, widget->y, widget->width, widget->height, widget->bg_color);
+
+        default:
             break;
     }
 }
 
+void ui_render_widget(Widget *widget, Framebuffer *fb) {
+    uint32_t color;
+
+    if (!widget || !widget->visible || !fb) return;
+
+    if (widget_fill(widget, &color)) {
+        fb_draw_rect(fb, widget->abs_x, widget->abs_y, widget->width, widget->height, color);
+    }
+    if (widget_has_overlay(widget)) {
+        render_overlay(widget, fb);
+    }
+}
+
+/* Paint a subtree bottom to top, each child clipped to its parent */
+static void render_subtree(Widget *widget, Framebuffer *fb, const FbRect *clip) {
+    FbRect bounds, area;
+
+    if (!widget->visible) {
+        return;
+    }
+    widget_bounds(widget, &bounds);
+    if (!rect_intersect(&area, &bounds, clip)) {
+        return;
+    }
+
+    fb_set_clip(fb, area.x, area.y, area.w, area.h);
+    ui_render_widget(widget, fb);
+
+    for (int i = 0; i < widget->child_count; i++) {
+        render_subtree(widget->children[i], fb, &area);
+    }
+}
+
+/* Shown widgets overlapping clip, appended to render_list in paint order */
+static int collect_subtree(Widget *widget, const FbRect *clip, int n) {
+    FbRect bounds, area;
+
+    if (!widget->visible) {
+        return n;
+    }
+    widget_bounds(widget, &bounds);
+    if (!rect_intersect(&area, &bounds, clip)) {
+        return n;
+    }
+
+    render_list[n].widget = widget;
+    render_list[n].clip = area;
+    n++;
+    for (int i = 0; i < widget->child_count; i++) {
+        n = collect_subtree(widget->children[i], &area, n);
+    }
+    return n;
+}
+
+/* Region minus r; -1 (region untouched) if the pieces do not fit */
+static int region_subtract(FbRect *region, int *count, const FbRect *r) {
+    FbRect tmp[UI_MAX_REGION];
+    int n = *count;
+
+    memcpy(tmp, region, sizeof(FbRect) * n);
+    if (rect_region_subtract(tmp, &n, UI_MAX_REGION, r) < 0) {
+        return -1;
+    }
+    memcpy(region, tmp, sizeof(FbRect) * n);
+    *count = n;
+    return 0;
+}
+
+static void fill_region(Framebuffer *fb, const FbRect *region, int count, const FbRect *clip, uint32_t color) {
+    for (int i = 0; i < count; i++) {
+        FbRect part;
+
+        if (rect_intersect(&part, &region[i], clip)) {
+            fb_draw_rect(fb, part.x, part.y, part.w, part.h, color);
+        }
+    }
+}
+
+/* Add the part of r inside the tile to its damage, keeping the pieces
+   disjoint; past UI_TILE_AREAS pieces the whole tile is repainted */
+static void tile_add_damage(UITile *tile, const FbRect *r) {
+    FbRect piece[UI_TILE_AREAS];
+    int n = 1;
+
+    if (!rect_intersect(&piece[0], r, &tile->bounds)) {
+        return;
+    }
+    if (tile->area_count == 1 && rect_area(&tile->area[0]) == rect_area(&tile->bounds)) {
+        return;  /* Already whole */
+    }
+
+    for (int i = 0; i < tile->area_count && n > 0; i++) {
+        if (rect_region_subtract(piece, &n, UI_TILE_AREAS, &tile->area[i]) < 0) {
+            n = UI_TILE_AREAS + 1;
+            break;
+        }
+    }
+    if (tile->area_count + n > UI_TILE_AREAS) {
+        tile->area[0] = tile->bounds;
+        tile->area_count = 1;
+        return;
+    }
+    memcpy(&tile->area[tile->area_count], piece, sizeof(FbRect) * n);
+    tile->area_count += n;
+}
+
+static int tile_touches(const UITile *tile, const FbRect *r) {
+    for (int i = 0; i < tile->area_count; i++) {
+        FbRect part;
+
+        if (rect_intersect(&part, &tile->area[i], r)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Two passes over the paint-ordered render list: count each damaged
+   tile's widgets, hand out slices of tile_entries, then fill them */
+static void bin_widgets(UIContext *ctx, int n, int active) {
+    int used = 0;
+
+    for (int a = 0; a < active; a++) {
+        ctx->tiles[ctx->active_tiles[a]].count = 0;
+    }
+
+    for (int pass = 0; pass < 2; pass++) {
+        for (int i = 0; i < n; i++) {
+            const FbRect *clip = &render_list[i].clip;
+            uint32_t color;
+
+            /* Containers paint nothing */
+            if (!widget_fill(render_list[i].widget, &color) &&
+                !widget_has_overlay(render_list[i].widget)) {
+                continue;
+            }
+
+            for (int ty = clip->y / UI_TILE; ty <= (clip->y + clip->h - 1) / UI_TILE; ty++) {
+                for (int tx = clip->x / UI_TILE; tx <= (clip->x + clip->w - 1) / UI_TILE; tx++) {
+                    UITile *tile = &ctx->tiles[(ty * ctx->tile_cols) + tx];
+
+                    if (!tile_touches(tile, clip)) {
+                        continue;
+                    }
+                    if (pass == 0) {
+                        tile->count++;
+                    } else if (tile->first >= 0) {
+                        tile_entries[tile->first + tile->count++] = i;
+                    }
+                }
+            }
+        }
+
+        if (pass == 0) {
+            for (int a = 0; a < active; a++) {
+                UITile *tile = &ctx->tiles[ctx->active_tiles[a]];
+
+                if (used + tile->count <= UI_TILE_ENTRIES) {
+                    tile->first = used;
+                    used += tile->count;
+                } else {
+                    tile->first = -1;
+                }
+                tile->count = 0;
+            }
+        }
+    }
+}
+
+/* Repaint a tile's damage from its bin. Widgets are visited front to back
+   and each opaque one fills only what is still uncovered before removing
+   its bounds, so every pixel gets exactly one fill (widget or background).
+   Text then goes on top, back to front, clipped away from the opaque
+   widgets in front of it. Returns -1 if a region outgrew UI_MAX_REGION;
+   the caller then repaints the tile bottom to top. */
+static int render_bin(UIContext *ctx, Framebuffer *fb, const UITile *tile) {
+    const int *bin = &tile_entries[tile->first];
+    int n = tile->count;
+    FbRect region[UI_MAX_REGION];
+    int region_count;
+
+    /* Work out every fill before drawing, so overflow can still fall back */
+    memcpy(region, tile->area, sizeof(FbRect) * tile->area_count);
+    region_count = tile->area_count;
+    for (int i = n - 1; i >= 0 && region_count > 0; i--) {
+        uint32_t color;
+
+        if (widget_fill(render_list[bin[i]].widget, &color) &&
+            region_subtract(region, &region_count, &render_list[bin[i]].clip) < 0) {
+            return -1;
+        }
+    }
+
+    memcpy(region, tile->area, sizeof(FbRect) * tile->area_count);
+    region_count = tile->area_count;
+    for (int i = n - 1; i >= 0 && region_count > 0; i--) {
+        const RenderEntry *e = &render_list[bin[i]];
+        uint32_t color;
+
+        if (widget_fill(e->widget, &color)) {
+            fill_region(fb, region, region_count, &e->clip, color);
+            region_subtract(region, &region_count, &e->clip);
+        }
+    }
+    fill_region(fb, region, region_count, &tile->bounds, ctx->bg_color);
+
+    for (int i = 0; i < n; i++) {
+        const RenderEntry *e = &render_list[bin[i]];
+        int ok = 1;
+
+        if (!widget_has_overlay(e->widget)) {
+            continue;
+        }
+
+        memcpy(region, tile->area, sizeof(FbRect) * tile->area_count);
+        region_count = tile->area_count;
+        for (int j = i + 1; j < n && ok && region_count > 0; j++) {
+            uint32_t color;
+
+            if (widget_fill(render_list[bin[j]].widget, &color)) {
+                ok = region_subtract(region, &region_count, &render_list[bin[j]].clip) == 0;
+            }
+        }
+        if (!ok) {
+            return -1;
+        }
+
+        for (int r = 0; r < region_count; r++) {
+            FbRect part;
+
+            if (rect_intersect(&part, &region[r], &e->clip)) {
+                fb_push_clip(fb, part.x, part.y, part.w, part.h);
+                render_overlay(e->widget, fb);
+                fb_pop_clip(fb);
+            }
+        }
+    }
+    return 0;
+}
+
+/* Too fragmented to cull, or binning ran out: background, then the
+   widgets bottom to top (from the tree if the tile has no bin) */
+static void render_tile_overdraw(UIContext *ctx, Framebuffer *fb, const UITile *tile) {
+    for (int a = 0; a < tile->area_count; a++) {
+        const FbRect *area = &tile->area[a];
+
+        fb_push_clip(fb, area->x, area->y, area->w, area->h);
+        fb_draw_rect(fb, area->x, area->y, area->w, area->h, ctx->bg_color);
+        if (tile->first < 0) {
+            render_subtree(ctx->root, fb, area);
+        } else {
+            for (int i = 0; i < tile->count; i++) {
+                const RenderEntry *e = &render_list[tile_entries[tile->first + i]];
+
+                fb_push_clip(fb, e->clip.x, e->clip.y, e->clip.w, e->clip.h);
+                ui_render_widget(e->widget, fb);
+                fb_pop_clip(fb);
+            }
+        }
+        fb_pop_clip(fb);
+    }
+}
+
+/* One parallel_for item. Tiles never overlap, so each can draw into the
+   shared pixels through its own copy of the framebuffer, which keeps the
+   clip stack and dirty list private; ui_render marks the damage after. */
+static void render_tile_job(void *arg, int index) {
+    RenderJob *job = arg;
+    UIContext *ctx = job->ctx;
+    const UITile *tile = &ctx->tiles[ctx->active_tiles[index]];
+    Framebuffer view = *job->fb;
+
+    view.dirty_count = 0;
+    fb_reset_clip(&view);
+    fb_set_clip(&view, tile->bounds.x, tile->bounds.y, tile->bounds.w, tile->bounds.h);
+
+    if (tile->first < 0 || render_bin(ctx, &view, tile) < 0) {
+        render_tile_overdraw(ctx, &view, tile);
+    }
+}
+
+/* Remember what the rendered widgets cover for the next invalidation;
+   only dirty widgets can have moved, resized or changed visibility */
+static void record_drawn(Widget *dirty) {
+    while (dirty) {
+        Widget *w = dirty;
+
+        dirty = w->next;
+        if (widget_shown(w)) {
+            widget_bounds(w, &w->drawn);
+        } else {
+            w->drawn.w = 0;
+            w->drawn.h = 0;
+        }
+        w->queued = 0;
+        w->next = NULL;
+    }
+}
+
 void ui_render(UIContext *ctx, Framebuffer *fb) {
-    Widget *w;
-    
+    FbRect screen, bounds = { 0, 0, 0, 0 };
+    Widget *dirty;
+    int active = 0;
+
     if (!ctx || !fb || !ctx->root) {
         return;
     }
-    
-    /* Simple forward rendering - render widgets from oldest to newest */
-    /* We need to reverse the list first since root points to newest */
-    Widget *stack[MAX_WIDGETS];
-    int count = 0;
-    
-    /* Build array of widgets */
-    w = ctx->root;
-    while (w && count < MAX_WIDGETS) {
-        stack[count++] = w;
-        w = w->next;
+
+    /* Turn dirty widgets into damage: where they were and where they are now.
+       The list is kept until the end, to record what each one covers. */
+    dirty = ctx->dirty_list;
+    ctx->dirty_list = NULL;
+    for (Widget *w = dirty; w; w = w->next) {
+        ui_invalidate(ctx, w->drawn.x, w->drawn.y, w->drawn.w, w->drawn.h);
+        if (widget_shown(w)) {
+            FbRect now;
+
+            widget_bounds(w, &now);
+            ui_invalidate(ctx, now.x, now.y, now.w, now.h);
+        }
+        w->dirty = 0;
+    }
+
+    if (ctx->damage_count == 0) {
+        record_drawn(dirty);
+        return;
+    }
+    TRACE_SCOPE_BEGIN(TRACE_UI_RENDER, ctx->damage_count, 0);
+
+    /* Split the damage into the tiles it covers */
+    screen.x = 0;
+    screen.y = 0;
+    screen.w = ctx->width;
+    screen.h = ctx->height;
+    for (int d = 0; d < ctx->damage_count; d++) {
+        FbRect r;
+
+        if (!rect_intersect(&r, &ctx->damage[d], &screen)) {
+            continue;
+        }
+        if (rect_empty(&bounds)) {
+            bounds = r;
+        } else {
+            rect_union(&bounds, &bounds, &r);
+        }
+        for (int ty = r.y / UI_TILE; ty <= (r.y + r.h - 1) / UI_TILE; ty++) {
+            for (int tx = r.x / UI_TILE; tx <= (r.x + r.w - 1) / UI_TILE; tx++) {
+                tile_add_damage(&ctx->tiles[(ty * ctx->tile_cols) + tx], &r);
+            }
+        }
+    }
+
+    /* Row-major, so neighbouring tiles share scanlines in cache */
+    for (int t = 0; t < ctx->tile_cols * ctx->tile_rows; t++) {
+        if (ctx->tiles[t].area_count) {
+            ctx->active_tiles[active++] = t;
+        }
+    }
+
+    if (active) {
+        RenderJob job = { ctx, fb };
+        int n = collect_subtree(ctx->root, &bounds, 0);
+
+        bin_widgets(ctx, n, active);
+        parallel_for(active, render_tile_job, &job);
+
+        for (int a = 0; a < active; a++) {
+            UITile *tile = &ctx->tiles[ctx->active_tiles[a]];
+
+            for (int i = 0; i < tile->area_count; i++) {
+                fb_mark_dirty(fb, tile->area[i].x, tile->area[i].y, tile->area[i].w, tile->area[i].h);
+            }
+            tile->area_count = 0;
+        }
+    }
+    TRACE_SCOPE_END(TRACE_UI_RENDER, ctx->damage_count, active);
+    ctx->damage_count = 0;
+    record_drawn(dirty);
+}
+
+Widget* ui_widget_at(UIContext *ctx, int x, int y) {
+    UIGridNode *node;
+    Widget *best = NULL;
+
+    if (!ctx || !ctx->grid || !ctx->root) {
+        return NULL;
+    }
+    if (x < 0 || y < 0 || x >= ctx->width || y >= ctx->height) {
+        return NULL;
+    }
+
+    if (ctx->order_dirty) {
+        number_subtree(ctx->root, 0);
+        ctx->order_dirty = 0;
     }
-    
-    /* Render from bottom (oldest) to top (newest) */
-    for (int i = count - 1; i >= 0; i--) {
-        if (stack[i]) {
-            ui_render_widget(stack[i], fb);
+
+    /* Only widgets overlapping this cell can contain the point */
+    node = ctx->grid[((y / UI_GRID_CELL) * ctx->grid_cols) + (x / UI_GRID_CELL)];
+    for (; node; node = node->next) {
+        Widget *w = node->widget;
+
+        if ((!best || w->order > best->order) && widget_hittable(w, x, y)) {
+            best = w;
         }
     }
+    return best;
 }
 
 int ui_handle_mouse(UIContext *ctx, const MouseState *mouse, int clicked) {
-    Widget *w;
+    Widget *button;
     int handled = 0;
-    
+
     if (!ctx || !mouse) {
         return 0;
     }
-    
-    w = ctx->root;
-    
-    /* Update hover states and handle clicks */
-    while (w) {
-        if (w->visible && w->type == WIDGET_BUTTON) {
-            w->hovered = point_in_widget(w, mouse->x, mouse->y);
-            
-            if (clicked && w->hovered) {
-                if (w->on_click) {
-                    /* Adjust function pointer: kernel loaded at 0x20000 but linked at 0x0 */
-                    WidgetCallback actual_callback = w->on_click;
-                    if ((uint32_t)actual_callback < 0x20000) {
-                        actual_callback = (WidgetCallback)((uint32_t)actual_callback + 0x20000);
-                    }
-                    
-                    actual_callback(w, w->user_data);
-                    handled = 1;
-                    break; /* Only handle one click at a time */
-                }
-            }
+
+    /* The topmost widget under the pointer, or the button that contains it */
+    button = ui_widget_at(ctx, mouse->x, mouse->y);
+    while (button && button->type != WIDGET_BUTTON) {
+        button = button->parent;
+    }
+
+    if (button != ctx->hovered) {
+        if (ctx->hovered) {
+            ctx->hovered->hovered = 0;
+            mark_dirty(ctx->hovered);
         }
-        w = w->next;
+        if (button) {
+            button->hovered = 1;
+            mark_dirty(button);
+        }
+        ctx->hovered = button;
+        handled = 1;  /* Hover look changed, widgets need repainting */
+    }
+
+    if (clicked && button && button->on_click) {
+        button->on_click(button, button->user_data);
+        handled = 1;
     }
-    
+
     return handled;
 }
@@ -0,0 +1,257 @@
+#define LOG_CATEGORY UI
+
+#include "window.h"
+#include "heap.h"
+#include "string.h"
+#include "debug.h"
+#include <stddef.h>
+
+static void window_bounds(const Window *win, FbRect *r) {
+    r->x = win->x;
+    r->y = win->y;
+    r->w = win->width;
+    r->h = win->height;
+}
+
+static void wm_damage(WindowManager *wm, const FbRect *r) {
+    FbRect screen = { 0, 0, wm->screen->width, wm->screen->height };
+    FbRect area;
+
+    if (rect_intersect(&area, r, &screen)) {
+        rect_list_add(wm->damage, &wm->damage_count, WM_MAX_DAMAGE, &area);
+    }
+}
+
+static void wm_damage_window(WindowManager *wm, const Window *win) {
+    FbRect r;
+
+    if (win->visible) {
+        window_bounds(win, &r);
+        wm_damage(wm, &r);
+    }
+}
+
+void wm_init(WindowManager *wm, Framebuffer *screen, uint32_t desktop_color) {
+    FbRect all = { 0, 0, screen->width, screen->height };
+
+    memset(wm, 0, sizeof(*wm));
+    wm->screen = screen;
+    wm->desktop_color = desktop_color;
+    wm->clips_dirty = 1;
+    wm_damage(wm, &all);
+}
+
+void wm_set_wallpaper(WindowManager *wm, const Framebuffer *image) {
+    FbRect all = { 0, 0, wm->screen->width, wm->screen->height };
+
+    wm->wallpaper = image;
+    wm_damage(wm, &all);
+}
+
+Window *wm_create_window(WindowManager *wm, int x, int y, int width, int height) {
+    Window *win;
+    void *pixels;
+
+    if (wm->count == WM_MAX_WINDOWS || width <= 0 || height <= 0) {
+        return NULL;
+    }
+
+    win = heap_alloc(sizeof(Window), 16);
+    pixels = heap_alloc((uint32_t)width * height * wm->screen->bytes_per_pixel, 16);
+    if (!win || !pixels) {
+        ERROR("No memory for a %dx%d window", width, height);
+        return NULL;
+    }
+
+    memset(win, 0, sizeof(*win));
+    win->x = x;
+    win->y = y;
+    win->width = width;
+    win->height = height;
+    win->visible = 1;
+    fb_init_surface(&win->surface, wm->screen, (uint16_t)width, (uint16_t)height, pixels);
+
+    wm->windows[wm->count++] = win;
+    wm->clips_dirty = 1;
+    return win;
+}
+
+void wm_move(WindowManager *wm, Window *win, int x, int y) {
+    if (win->x == x && win->y == y) {
+        return;
+    }
+
+    /* Old and new bounds: the first exposes what was below, the second shows the window */
+    wm_damage_window(wm, win);
+    win->x = x;
+    win->y = y;
+    wm_damage_window(wm, win);
+    wm->clips_dirty = 1;
+}
+
+void wm_raise(WindowManager *wm, Window *win) {
+    int i;
+
+    for (i = 0; i < wm->count && wm->windows[i] != win; i++);
+    if (i >= wm->count - 1) {
+        return;  /* Not ours, or already on top */
+    }
+
+    for (; i < wm->count - 1; i++) {
+        wm->windows[i] = wm->windows[i + 1];
+    }
+    wm->windows[wm->count - 1] = win;
+    wm_damage_window(wm, win);
+    wm->clips_dirty = 1;
+}
+
+void wm_set_visible(WindowManager *wm, Window *win, int visible) {
+    visible = visible ? 1 : 0;
+    if (win->visible == visible) {
+        return;
+    }
+
+    if (visible) {
+        win->visible = 1;
+        wm_damage_window(wm, win);
+    } else {
+        wm_damage_window(wm, win);
+        win->visible = 0;
+    }
+    wm->clips_dirty = 1;
+}
+
+void wm_invalidate(WindowManager *wm, int x, int y, int width, int height) {
+    FbRect r = { x, y, width, height };
+
+    wm_damage(wm, &r);
+}
+
+Window *wm_window_at(WindowManager *wm, int x, int y) {
+    for (int i = wm->count - 1; i >= 0; i--) {
+        Window *win = wm->windows[i];
+
+        if (win->visible && x >= win->x && x < win->x + win->width &&
+            y >= win->y && y < win->y + win->height) {
+            return win;
+        }
+    }
+    return NULL;
+}
+
+/* Visible region of each window: its bounds minus every window above it */
+static void wm_update_clips(WindowManager *wm) {
+    FbRect screen = { 0, 0, wm->screen->width, wm->screen->height };
+
+    wm->desktop[0] = screen;
+    wm->desktop_count = 1;
+
+    for (int i = wm->count - 1; i >= 0; i--) {
+        Window *win = wm->windows[i];
+        FbRect bounds;
+
+        win->clip_count = 0;
+        if (!win->visible) {
+            continue;
+        }
+        window_bounds(win, &bounds);
+        if (!rect_intersect(&win->clip[0], &bounds, &screen)) {
+            continue;
+        }
+        win->clip_count = 1;
+
+        for (int j = i + 1; j < wm->count; j++) {
+            FbRect above;
+
+            if (!wm->windows[j]->visible) {
+                continue;
+            }
+            window_bounds(wm->windows[j], &above);
+            if (rect_region_subtract(win->clip, &win->clip_count, WM_MAX_CLIP, &above) < 0) {
+                WARN("Window clip list full");
+            }
+        }
+
+        if (rect_region_subtract(wm->desktop, &wm->desktop_count, WM_MAX_CLIP, &bounds) < 0) {
+            WARN("Desktop clip list full");
+        }
+    }
+
+    wm->clips_dirty = 0;
+}
+
+/* Copy the part of area that win shows on screen */
+static void wm_blit_clipped(WindowManager *wm, const Window *win, const FbRect *area) {
+    for (int c = 0; c < win->clip_count; c++) {
+        FbRect part;
+
+        if (rect_intersect(&part, area, &win->clip[c])) {
+            fb_push_clip(wm->screen, part.x, part.y, part.w, part.h);
+            fb_blit(wm->screen, &win->surface, win->x, win->y);
+            fb_pop_clip(wm->screen);
+        }
+    }
+}
+
+/* Bare desktop inside the current clip: wallpaper where it reaches, color around it */
+static void wm_fill_desktop(WindowManager *wm, const FbRect *r) {
+    Framebuffer *screen = wm->screen;
+    FbRect pieces[4];
+    int n = 1;
+
+    pieces[0] = *r;
+    if (wm->wallpaper) {
+        FbRect art = { (screen->width - wm->wallpaper->width) / 2,
+                       (screen->height - wm->wallpaper->height) / 2,
+                       wm->wallpaper->width, wm->wallpaper->height };
+
+        n = rect_subtract(pieces, r, &art);
+        fb_push_clip(screen, r->x, r->y, r->w, r->h);
+        fb_blit(screen, wm->wallpaper, art.x, art.y);
+        fb_pop_clip(screen);
+    }
+
+    for (int i = 0; i < n; i++) {
+        fb_draw_rect(screen, pieces[i].x, pieces[i].y, pieces[i].w, pieces[i].h, wm->desktop_color);
+    }
+}
+
+void wm_compose(WindowManager *wm) {
+    Framebuffer *screen = wm->screen;
+
+    if (wm->clips_dirty) {
+        wm_update_clips(wm);
+    }
+
+    /* Content changes: only the changed window, only where it is exposed */
+    for (int i = 0; i < wm->count; i++) {
+        Window *win = wm->windows[i];
+
+        if (win->visible) {
+            for (int d = 0; d < win->surface.dirty_count; d++) {
+                FbRect area = win->surface.dirty[d];
+
+                area.x += win->x;
+                area.y += win->y;
+                wm_blit_clipped(wm, win, &area);
+            }
+        }
+        win->surface.dirty_count = 0;
+    }
+
+    /* Exposed screen areas: every window's visible part, then bare desktop */
+    for (int d = 0; d < wm->damage_count; d++) {
+        const FbRect *area = &wm->damage[d];
+
+        for (int i = 0; i < wm->count; i++) {
+            wm_blit_clipped(wm, wm->windows[i], area);
+        }
+
+        fb_push_clip(screen, area->x, area->y, area->w, area->h);
+        for (int c = 0; c < wm->desktop_count; c++) {
+            wm_fill_desktop(wm, &wm->desktop[c]);
+        }
+        fb_pop_clip(screen);
+    }
+    wm->damage_count = 0;
+}
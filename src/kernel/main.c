@@ -3,16 +3,62 @@
 
 #include "bootinfo.h"
 #include "framebuffer.h"
+#include "bga.h"
 #include "mouse.h"
 #include "time.h"
+#include "bios.h"
 #include "ui_widget.h"
 #include "debug.h"
 #include "fat12.h"
+#include "paging.h"
+#include "heap.h"
+#include "cpu.h"
+#include "blit.h"
+#include "text.h"
+#include "cursor.h"
+#include "interrupt.h"
+#include "timer.h"
+#include "event.h"
+#include "keyboard.h"
+#include "trace.h"
+#include "profile.h"
+#include "format.h"
+#include "window.h"
+#include "image.h"
+#include "thread.h"
+#include "smp.h"
+#include "parallel.h"
+#include "elf.h"
 
 /* Global UI state */
 static Framebuffer g_fb;
 static int show_info = 0;
-static int prev_mouse_x = -1, prev_mouse_y = -1;  /* Track if mouse just entered window */
+
+/* Each window draws its own widget tree into its surface */
+typedef struct {
+    Window *win;
+    UIContext ui;
+} AppWindow;
+
+enum { APP_BAR, APP_INFO, APP_COUNT };
+
+static WindowManager g_wm;
+static AppWindow app_windows[APP_COUNT];
+
+/* Frame pacing: input is coalesced and painted at most this often */
+#define FRAME_HZ 60
+#define FRAME_MS (1000 / FRAME_HZ)
+#define TIMER_FRAME 1
+#define TIMER_CLOCK 2   /* Top-bar clock, once per second */
+
+/* Jobs run on background threads, reported back as EVENT_TASK */
+#define TASK_FILES 1    /* Mount the floppy, read test.txt, decode the wallpaper */
+
+/* Debug dumps, from the keyboard or typed on the serial console */
+#define SCANCODE_F11 0x57   /* Profile histogram */
+#define SCANCODE_F12 0x58   /* Trace ring */
+#define SERIAL_CMD_PROFILE 'p'
+#define SERIAL_CMD_TRACE 't'
 
 /* Progress bar state */
 static void draw_progress_bar(Framebuffer *fb, int progress_percent) {
@@ -67,19 +113,25 @@ static void draw_progress_bar(Framebuffer *fb, int progress_percent) {
     progress_text[percent_pos + digit_count] = '%';
     progress_text[percent_pos + digit_count + 1] = '\0';
     
-    fb_draw_text(fb, bar_x + 20, bar_y - 30, progress_text, 0xCCCCCC);
+    {
+        const Font *font = text_font(FONT_8X16);
+        int text_w, text_h;
+
+        text_measure(font, progress_text, &text_w, &text_h);
+        text_draw(fb, font, (fb->width - text_w) / 2, bar_y - 5 - text_h, progress_text, 0xCCCCCC);
+    }
 }
 
 static void update_progress(Framebuffer *fb, int percent) {
-    fb_clear(fb, 0x000000);
-    draw_progress_bar(fb, percent);
-}
+    static int cleared = 0;
 
-/* Simple delay function - approximate milliseconds using busy wait */
-static void delay_ms(uint32_t ms) {
-    for (uint32_t i = 0; i < ms * 100000; i++) {
-        __asm__ volatile ("nop");
+    /* The bar box repaints itself; only the first step needs the screen cleared */
+    if (!cleared) {
+        fb_clear(fb, 0x000000);
+        cleared = 1;
     }
+    draw_progress_bar(fb, percent);
+    fb_swap(fb);
 }
 
 static void clamp_mouse(MouseState *mouse, const Framebuffer *fb) {
@@ -121,9 +173,85 @@ static void on_halt_clicked(Widget *widget, void *user_data) {
     shutdown();
 }
 
+static int app_window_create(AppWindow *aw, int x, int y, int width, int height, uint32_t bg) {
+    aw->win = wm_create_window(&g_wm, x, y, width, height);
+    if (!aw->win) {
+        return -1;
+    }
+    ui_context_init(&aw->ui, width, height);
+    ui_set_background(&aw->ui, bg);
+    ui_invalidate(&aw->ui, 0, 0, width, height);
+    return 0;
+}
+
+/* Give the pointer to the window under it in window coordinates; the others
+   see it leave so their hover state clears */
+static int app_window_mouse(AppWindow *aw, const MouseState *mouse, const Window *under, int clicked) {
+    MouseState local = *mouse;
+
+    if (aw->win != under) {
+        local.x = -1;
+        local.y = -1;
+        clicked = 0;
+    } else {
+        local.x -= aw->win->x;
+        local.y -= aw->win->y;
+    }
+    return ui_handle_mouse(&aw->ui, &local, clicked);
+}
+
+/* Disk thread: everything that waits on the floppy, so the UI thread can
+   paint and take input meanwhile. The decoded wallpaper is handed back
+   through the task event; only the UI thread touches the window manager. */
+static const Framebuffer *task_wallpaper = NULL;
+
+static void load_files(void *arg) {
+    static uint8_t file_buffer[4096];
+    FileHandle test_file;
+    Event done = { .type = EVENT_TASK };
+
+    (void)arg;
+    INFO("Initializing FAT12 file system");
+    fat12_init();
+
+    /* Test: Try to read test.txt */
+    INFO("Testing file system - attempting to read test.txt");
+    if (fat12_open("test.txt", &test_file) == 0) {
+        INFO("test.txt opened successfully");
+        int bytes_read = fat12_read(&test_file, file_buffer, sizeof(file_buffer) - 1);
+        if (bytes_read > 0) {
+            INFO("Read %d bytes from test.txt", bytes_read);
+            file_buffer[bytes_read] = '\0';  /* Null terminate */
+        } else {
+            INFO("Failed to read test.txt");
+        }
+        fat12_close(&test_file);
+    } else {
+        INFO("Failed to open test.txt");
+    }
+
+    /* Decoded once into the screen format; every repaint is then a blit */
+    task_wallpaper = image_get("logo.bmp", &g_fb);
+
+    /* Only its headers are read here; pages come in as it runs */
+    if (fat12_file_exists("init.elf")) {
+        elf_exec("init.elf", THREAD_PRIO_LOW);
+    }
+
+    done.task.id = TASK_FILES;
+    done.task.status = task_wallpaper ? 0 : -1;
+    event_post(&done);
+}
+
+static void format_clock(char *buf, size_t size) {
+    WallTime now;
+
+    time_get(&now);
+    ksnprintf(buf, size, "%02u:%02u:%02u", now.hours, now.minutes, now.seconds);
+}
+
 void kmain(struct BootInfo *info) {
-    UIContext ui_ctx;
-    MouseState mouse = { 40, 40, 0 };
+    MouseState mouse = { 40, 40, 0, 0 };
     char time_text[9] = "12:00:00";
     Widget *top_bar, *btn_info, *btn_halt, *lbl_time;
     Widget *info_panel, *info_bg, *lbl_info_title, *lbl_res, *lbl_res_val, *lbl_bpp, *lbl_bpp_val;
@@ -132,189 +260,307 @@ void kmain(struct BootInfo *info) {
     debug_set_level(LOG_DEBUG);  /* Show all log levels */
     INFO("Kernel started");
 
-    if (info->magic != BOOTINFO_MAGIC || info->bpp != 32) {
+    if (info->magic != BOOTINFO_MAGIC) {
         ERROR("Boot info invalid!");
         for (;;) {
             __asm__ volatile ("hlt");
         }
     }
 
+    cpu_init();
+    smp_early_init();
+    cpu_enable_sse();
+    blit_init();
+
+    interrupt_init();
+    debug_start_async();
+    event_init();
+    timer_init();
+    interrupts_enable();
+    time_init();
+
+    INFO("Enabling paging");
+    paging_init();
+    paging_set_write_combining(info->lfb, (uint32_t)info->pitch * info->height);
+
+    {
+        uint16_t cylinders;
+        uint8_t heads, spt;
+
+        /* One real-mode round trip; also checks the BIOS trampoline early */
+        if (bios_get_drive_params(info->boot_drive, &cylinders, &heads, &spt)) {
+            INFO("Boot drive 0x%02x: %u cylinders, %u heads, %u sectors",
+                 info->boot_drive, cylinders, heads, spt);
+        } else {
+            WARN("BIOS drive query failed");
+        }
+    }
+
     INFO("Initializing framebuffer");
-    fb_init(&g_fb, info);
+    heap_init(HEAP_START, HEAP_END);
+    thread_init();
+    trace_init();
+    profile_init();
+    if (fb_init(&g_fb, info) < 0) {
+        for (;;) {
+            __asm__ volatile ("hlt");
+        }
+    }
+    text_init(info);
+    {
+        void *back = heap_alloc((uint32_t)g_fb.pitch * g_fb.height, 4096);
+        if (back) {
+            fb_enable_double_buffer(&g_fb, back);
+            /* On Bochs/QEMU, present by flipping instead of copying to the visible page */
+            bga_enable_page_flip(&g_fb);
+        } else {
+            WARN("No memory for back buffer, drawing direct to LFB");
+        }
+    }
+
+    /* After every memory-type change above, so the APs pick them all up */
+    smp_init();
+    parallel_init();
+    elf_init();
+
     update_progress(&g_fb, 10);
-    delay_ms(300);
+    timer_sleep(300);
     
     INFO("Initializing mouse");
     mouse_init();
+    keyboard_init();
     mouse.x = g_fb.width / 2;
     mouse.y = g_fb.height / 2;
     update_progress(&g_fb, 20);
-    delay_ms(300);
+    timer_sleep(300);
 
     INFO("Initializing UI");
     /* Initialize UI */
-    ui_context_init(&ui_ctx);
+    wm_init(&g_wm, &g_fb, 0x1C2433);
+    cursor_init(NULL);
     update_progress(&g_fb, 30);
-    delay_ms(300);
+    timer_sleep(300);
 
-    INFO("Initializing FAT12 file system");
-    update_progress(&g_fb, 40);
-    delay_ms(300);
-    fat12_init();
-    update_progress(&g_fb, 50);
-    delay_ms(200);
-    update_progress(&g_fb, 60);
-    delay_ms(300);
-    
-    /* Test: Try to read test.txt */
-    INFO("Testing file system - attempting to read test.txt");
-    FileHandle test_file;
-    static uint8_t file_buffer[4096];
-    
-    update_progress(&g_fb, 75);
-    delay_ms(300);
-    
-    if (fat12_open("test.txt", &test_file) == 0) {
-        INFO("test.txt opened successfully");
-        int bytes_read = fat12_read(&test_file, file_buffer, sizeof(file_buffer) - 1);
-        if (bytes_read > 0) {
-            INFO("Read %d bytes from test.txt", bytes_read);
-            file_buffer[bytes_read] = '\0';  /* Null terminate */
-        } else {
-            INFO("Failed to read test.txt");
-        }
-        fat12_close(&test_file);
-    } else {
-        INFO("Failed to open test.txt");
+    /* The floppy is slow and polled; let it spin below the UI's priority.
+       The wallpaper shows up whenever it finishes. */
+    if (!thread_create("disk", load_files, NULL, THREAD_PRIO_LOW)) {
+        WARN("No disk thread, running without files");
     }
+    update_progress(&g_fb, 60);
+    timer_sleep(300);
     update_progress(&g_fb, 90);
-    delay_ms(300);
+    timer_sleep(300);
 
     /* Boot complete, switch to normal UI */
     update_progress(&g_fb, 100);
-    delay_ms(500);
-    fb_clear(&g_fb, 0xFFFFFF);  /* Clear progress bar and show white background */
-    
-    /* Create top bar */
+    timer_sleep(500);
+
+    /* Top bar window */
+    if (app_window_create(&app_windows[APP_BAR], 0, 0, g_fb.width, 28, 0x3B4A68) < 0) {
+        panic("Cannot create the top bar");
+    }
     top_bar = ui_create_panel(0, 0, g_fb.width, 28, 0x3B4A68);
-    ui_add_widget(&ui_ctx, top_bar);
+    ui_add_widget(&app_windows[APP_BAR].ui, top_bar);
 
     /* Create buttons */
     btn_info = ui_create_button("Info", 8, 4, 96, 20);
     ui_set_callback(btn_info, on_info_clicked, NULL);
-    ui_add_widget(&ui_ctx, btn_info);
+    ui_add_child(top_bar, btn_info);
 
     btn_halt = ui_create_button("Halt", 112, 4, 96, 20);
     ui_set_callback(btn_halt, on_halt_clicked, NULL);
-    ui_add_widget(&ui_ctx, btn_halt);
+    ui_add_child(top_bar, btn_halt);
 
     /* Create time label */
+    format_clock(time_text, sizeof(time_text));
     lbl_time = ui_create_label(time_text, g_fb.width - 72, 10, 0xB4D5FF);
-    ui_add_widget(&ui_ctx, lbl_time);
+    ui_add_child(top_bar, lbl_time);
 
-    /* Create info panel widgets (hidden initially) */
+    /* Info window (hidden initially, draggable); widgets are window-relative */
     int panel_w = 320;
     int panel_h = 120;
     int panel_x = (g_fb.width - panel_w) / 2;
     int panel_y = (g_fb.height - panel_h) / 2;
 
-    info_panel = ui_create_panel(panel_x, panel_y, panel_w, panel_h, 0x2A2F3A);
-    info_panel->visible = 0;
-    ui_add_widget(&ui_ctx, info_panel);
+    if (app_window_create(&app_windows[APP_INFO], panel_x, panel_y, panel_w, panel_h, 0x2A2F3A) < 0) {
+        panic("Cannot create the info window");
+    }
+    wm_set_visible(&g_wm, app_windows[APP_INFO].win, 0);
+
+    info_panel = ui_create_panel(0, 0, panel_w, panel_h, 0x2A2F3A);
+    ui_add_widget(&app_windows[APP_INFO].ui, info_panel);
 
-    info_bg = ui_create_panel(panel_x + 2, panel_y + 2, panel_w - 4, panel_h - 4, 0x1B1E24);
-    info_bg->visible = 0;
-    ui_add_widget(&ui_ctx, info_bg);
+    info_bg = ui_create_panel(2, 2, panel_w - 4, panel_h - 4, 0x1B1E24);
+    ui_add_child(info_panel, info_bg);
 
-    lbl_info_title = ui_create_label("Display info", panel_x + 12, panel_y + 16, 0xF1F4F8);
-    lbl_info_title->visible = 0;
-    ui_add_widget(&ui_ctx, lbl_info_title);
+    lbl_info_title = ui_create_label("Display info", 12, 16, 0xF1F4F8);
+    ui_add_child(info_panel, lbl_info_title);
 
-    lbl_res = ui_create_label("Resolution:", panel_x + 12, panel_y + 32, 0xF1F4F8);
-    lbl_res->visible = 0;
-    ui_add_widget(&ui_ctx, lbl_res);
+    lbl_res = ui_create_label("Resolution:", 12, 32, 0xF1F4F8);
+    ui_add_child(info_panel, lbl_res);
 
-    lbl_res_val = ui_create_label("800x600", panel_x + 120, panel_y + 32, 0xB4D5FF);
-    lbl_res_val->visible = 0;
-    ui_add_widget(&ui_ctx, lbl_res_val);
+    lbl_res_val = ui_create_label("800x600", 120, 32, 0xB4D5FF);
+    ui_add_child(info_panel, lbl_res_val);
 
-    lbl_bpp = ui_create_label("BPP:", panel_x + 12, panel_y + 48, 0xF1F4F8);
-    lbl_bpp->visible = 0;
-    ui_add_widget(&ui_ctx, lbl_bpp);
+    lbl_bpp = ui_create_label("BPP:", 12, 48, 0xF1F4F8);
+    ui_add_child(info_panel, lbl_bpp);
 
-    lbl_bpp_val = ui_create_label("32", panel_x + 120, panel_y + 48, 0xB4D5FF);
-    lbl_bpp_val->visible = 0;
-    ui_add_widget(&ui_ctx, lbl_bpp_val);
+    lbl_bpp_val = ui_create_label("32", 120, 48, 0xB4D5FF);
+    ui_add_child(info_panel, lbl_bpp_val);
 
-    /* Initial render */
+    /* Initial render: every window into its surface, then compose the screen */
     INFO("Performing initial render");
-    fb_clear(&g_fb, 0x1C2433);
-    ui_render(&ui_ctx, &g_fb);
-    fb_draw_rect(&g_fb, mouse.x, mouse.y, 6, 6, 0xB4D5FF);
+    for (int i = 0; i < APP_COUNT; i++) {
+        ui_render(&app_windows[i].ui, &app_windows[i].win->surface);
+    }
+    wm_compose(&g_wm);
+    cursor_show(&g_fb, mouse.x, mouse.y);
     fb_swap(&g_fb);
     INFO("Initial render complete");
 
-    /* Main loop */
-    for (;;) {
-        uint8_t prev_buttons = mouse.buttons;
-        int needs_redraw = 0;
-        int clicked = 0;
-
-        if (mouse_poll(&mouse)) {
-            clamp_mouse(&mouse, &g_fb);
-            
-            /* Sync cursor to pointer position when mouse enters from edges */
-            if (prev_mouse_x != -1) {
-                int dx = mouse.x - prev_mouse_x;
-                int dy = mouse.y - prev_mouse_y;
-                /* If large jump (>50px), assume mouse re-entered and sync cursor */
-                if ((dx > 50 || dx < -50 || dy > 50 || dy < -50) || 
-                    (prev_mouse_x == 0 && mouse.x > 50) || (prev_mouse_x == g_fb.width - 1 && mouse.x < g_fb.width - 50)) {
-                    DEBUG("Cursor synchronized to mouse entry point");
+    /* Main loop: sleep until events arrive, then paint at most once per frame */
+    {
+        uint32_t last_frame = timer_ms() - FRAME_MS;
+        int frame_pending = 0;
+        int moved = 0;
+        int ui_changed = 0;
+        Window *drag_win = NULL;
+        int drag_dx = 0, drag_dy = 0;
+
+        /* One-shot per second, re-aimed each time so an RTC resync that
+           moves the phase does not leave the label a fraction behind */
+        timer_arm(TIMER_CLOCK, time_ms_to_next_second(), 0);
+
+        for (;;) {
+            Event ev;
+            int frame_due = 0;
+
+            event_wait(&ev);
+            do {
+                switch (ev.type) {
+                    case EVENT_MOUSE: {
+                        uint8_t prev_buttons = mouse.buttons;
+
+                        mouse.x += ev.mouse.dx;
+                        mouse.y += ev.mouse.dy;
+                        mouse.wheel += ev.mouse.dz;
+                        mouse.buttons = ev.mouse.buttons;
+                        clamp_mouse(&mouse, &g_fb);
+                        moved = 1;
+
+                        if (!(mouse.buttons & 0x01)) {
+                            drag_win = NULL;
+                        }
+
+                        /* Clicks are handled per packet so a quick press is never lost */
+                        if ((mouse.buttons & 0x01) && !(prev_buttons & 0x01)) {
+                            Window *under = wm_window_at(&g_wm, mouse.x, mouse.y);
+
+                            for (int i = 0; i < APP_COUNT; i++) {
+                                AppWindow *aw = &app_windows[i];
+
+                                if (app_window_mouse(aw, &mouse, under, 1)) {
+                                    ui_changed = 1;
+                                }
+                                /* Pressing the info window off its buttons drags it */
+                                if (i == APP_INFO && aw->win == under && !aw->ui.hovered) {
+                                    wm_raise(&g_wm, aw->win);
+                                    drag_win = aw->win;
+                                    drag_dx = mouse.x - aw->win->x;
+                                    drag_dy = mouse.y - aw->win->y;
+                                }
+                            }
+                        }
+                        break;
+                    }
+
+                    case EVENT_KEY:
+                        if (ev.key.scancode == SCANCODE_F11) {
+                            profile_dump();
+                        } else if (ev.key.scancode == SCANCODE_F12) {
+                            trace_dump();
+                        }
+                        break;
+
+                    case EVENT_SERIAL:
+                        if (ev.serial.ch == SERIAL_CMD_PROFILE) {
+                            profile_dump();
+                        } else if (ev.serial.ch == SERIAL_CMD_TRACE) {
+                            trace_dump();
+                        }
+                        break;
+
+                    case EVENT_TIMER:
+                        if (ev.timer.id == TIMER_FRAME) {
+                            frame_due = 1;
+                        } else if (ev.timer.id == TIMER_CLOCK) {
+                            format_clock(time_text, sizeof(time_text));
+                            ui_set_text(lbl_time, time_text);
+                            ui_changed = 1;
+                            timer_arm(TIMER_CLOCK, time_ms_to_next_second(), 0);
+                        }
+                        break;
+
+                    case EVENT_TASK:
+                        if (ev.task.id == TASK_FILES && task_wallpaper) {
+                            wm_set_wallpaper(&g_wm, task_wallpaper);
+                            ui_changed = 1;
+                        }
+                        break;
+
+                    default:
+                        break;
                 }
-            }
-            
-            prev_mouse_x = mouse.x;
-            prev_mouse_y = mouse.y;
-            needs_redraw = 1;
-        }
+            } while (event_poll(&ev));
 
-        if ((mouse.buttons & 0x01) && !(prev_buttons & 0x01)) {
-            clicked = 1;
-        }
+            /* Schedule one frame for everything that arrived since the last */
+            if ((moved || ui_changed) && !frame_pending) {
+                int32_t wait = (int32_t)(last_frame + FRAME_MS - timer_ms());
 
-        /* Handle mouse events */
-        if (ui_handle_mouse(&ui_ctx, &mouse, clicked)) {
-            /* Update info panel visibility */
-            if (info_panel) info_panel->visible = show_info;
-            if (info_bg) info_bg->visible = show_info;
-            if (lbl_info_title) lbl_info_title->visible = show_info;
-            if (lbl_res) lbl_res->visible = show_info;
-            if (lbl_res_val) lbl_res_val->visible = show_info;
-            if (lbl_bpp) lbl_bpp->visible = show_info;
-            if (lbl_bpp_val) lbl_bpp_val->visible = show_info;
-            needs_redraw = 1;
-        }
+                timer_arm(TIMER_FRAME, wait > 0 ? (uint32_t)wait : 0, 0);
+                frame_pending = 1;
+            }
 
-        if (needs_redraw) {
-            /* Clear background */
-            fb_clear(&g_fb, 0x1C2433);
-            
-            /* Render all widgets */
-            ui_render(&ui_ctx, &g_fb);
-            
-            /* Draw mouse cursor */
-            fb_draw_rect(&g_fb, mouse.x, mouse.y, 6, 6, 0xB4D5FF);
-        }
-        
-        /* Always render at least once to show initial screen */
-        if (prev_mouse_x == -1) {
-            prev_mouse_x = 0;  /* Mark initial render done */
-            fb_clear(&g_fb, 0x1C2433);
-            ui_render(&ui_ctx, &g_fb);
-            fb_draw_rect(&g_fb, mouse.x, mouse.y, 6, 6, 0xB4D5FF);
-        }
+            if (!frame_due) {
+                continue;
+            }
+            frame_pending = 0;
+            last_frame = timer_ms();
+            TRACE_SCOPE_BEGIN(TRACE_FRAME, moved, ui_changed);
+
+            /* Hover and dragging only need the final pointer position of the frame */
+            if (moved && drag_win) {
+                wm_move(&g_wm, drag_win, mouse.x - drag_dx, mouse.y - drag_dy);
+                ui_changed = 1;
+            } else if (moved) {
+                Window *under = wm_window_at(&g_wm, mouse.x, mouse.y);
+
+                for (int i = 0; i < APP_COUNT; i++) {
+                    if (app_window_mouse(&app_windows[i], &mouse, under, 0)) {
+                        ui_changed = 1;
+                    }
+                }
+            }
 
-        for (volatile int delay = 0; delay < 10000; delay++);
+            if (ui_changed) {
+                /* Windows redraw their own damage off-screen; the compositor
+                   then copies what changed or was exposed under a hidden cursor */
+                wm_set_visible(&g_wm, app_windows[APP_INFO].win, show_info);
+                for (int i = 0; i < APP_COUNT; i++) {
+                    ui_render(&app_windows[i].ui, &app_windows[i].win->surface);
+                }
+                cursor_hide(&g_fb);
+                wm_compose(&g_wm);
+                cursor_show(&g_fb, mouse.x, mouse.y);
+                fb_swap(&g_fb);
+            } else if (moved) {
+                /* Pointer only: restore the old save-under and draw at the new spot */
+                cursor_move(&g_fb, mouse.x, mouse.y);
+                fb_swap(&g_fb);
+            }
+            TRACE_SCOPE_END(TRACE_FRAME, 0, 0);
+            moved = 0;
+            ui_changed = 0;
+        }
     }
 }